@@ -0,0 +1,1063 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "archive.h"
+#include "files.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef CVC_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CVC_ZSTD
+#include <zstd.h>
+#endif
+
+#define UNPACK_BUF_SIZE (64U * 1024U)
+#define TAR_BLOCK       (512U)
+#define ZIP_EOCD_SIZE   (22U)
+#define ZIP_TAIL_MAX    (ZIP_EOCD_SIZE + 0xFFFFU) /* with the longest comment */
+#define ZIP_CD_MAX      (256U * 1024U * 1024U)    /* central directory read */
+
+typedef enum
+{
+    CODEC_NONE,
+    CODEC_GZIP,
+    CODEC_DEFLATE, /* raw, of zip members */
+    CODEC_ZSTD
+} codec_t;
+
+/*
+ * State of the thread that unpacks an archive. The pipe carries per member
+ * the length of its name as uint16_t, the name and the contents in frames,
+ * see reader_frames().
+ */
+typedef struct
+{
+    archive_t* a;
+    unsigned char* in;       /* bytes of the file */
+    size_t in_pos;
+    size_t in_len;
+    uint64_t in_left;        /* still to be read as input, UINT64_MAX all */
+    unsigned char* out;      /* unpacked bytes */
+    codec_t codec;
+    bool done;               /* the compressed stream ended */
+#ifdef CVC_ZLIB
+    z_stream z;
+    bool z_init;
+#endif
+#ifdef CVC_ZSTD
+    ZSTD_DStream* zstd;
+    size_t zstd_hint;        /* 0 behind a complete frame */
+#endif
+    archive_status_t status; /* the first error */
+    bool stopped;            /* the reading end is closed */
+    char name[ARCHIVE_NAME_MAX + 1U];
+} unpack_t;
+
+static bool
+fail(unpack_t* u, archive_status_t status)
+{
+    if (u->status == ARCHIVE_OK)
+    {
+        u->status = status;
+    }
+
+    return false;
+}
+
+static uint16_t
+le16(const unsigned char* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t
+le32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16)
+           | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t
+le64(const unsigned char* p)
+{
+    return (uint64_t)le32(p) | ((uint64_t)le32(p + 4) << 32);
+}
+
+/* Refills the input, false at its end or on errors. */
+static bool
+raw_fill(unpack_t* u)
+{
+    size_t want = UNPACK_BUF_SIZE;
+    ssize_t n;
+
+    if (u->in_left < want)
+    {
+        want = (size_t)u->in_left;
+    }
+    if (want == 0U)
+    {
+        return false;
+    }
+    do
+    {
+        n = read(u->a->fd, u->in, want);
+    } while ((n < 0) && (errno == EINTR));
+    if (n <= 0)
+    {
+        u->in_left = 0U;
+        return (n == 0) ? false : fail(u, ARCHIVE_ERROR_READ);
+    }
+    u->in_pos = 0U;
+    u->in_len = (size_t)n;
+    if (u->in_left != UINT64_MAX)
+    {
+        u->in_left -= (uint64_t)n;
+    }
+
+    return true;
+}
+
+/* Reads len bytes at offset of the file, for the directory of zip. */
+static bool
+read_at(unpack_t* u, uint64_t offset, unsigned char* dst, size_t len)
+{
+    while (len > 0U)
+    {
+        ssize_t n = pread(u->a->fd, dst, len, (off_t)offset);
+        if (n > 0)
+        {
+            dst += n;
+            len -= (size_t)n;
+            offset += (uint64_t)n;
+        }
+        else if ((n == 0) || (errno != EINTR))
+        {
+            return fail(u, (n == 0) ? ARCHIVE_ERROR_FORMAT : ARCHIVE_ERROR_READ);
+        }
+    }
+
+    return true;
+}
+
+/* Continues with the next len bytes of the file at offset as input. */
+static bool
+raw_seek(unpack_t* u, uint64_t offset, uint64_t len)
+{
+    if (lseek(u->a->fd, (off_t)offset, SEEK_SET) == (off_t)-1)
+    {
+        return fail(u, ARCHIVE_ERROR_READ);
+    }
+    u->in_pos = 0U;
+    u->in_len = 0U;
+    u->in_left = len;
+
+    return true;
+}
+
+/* (Re)starts decoding the input with codec. */
+static bool
+codec_start(unpack_t* u, codec_t codec)
+{
+    u->codec = codec;
+    u->done = false;
+    switch (codec)
+    {
+        case CODEC_NONE:
+            return true;
+#ifdef CVC_ZLIB
+        case CODEC_GZIP:
+        case CODEC_DEFLATE:
+            if (u->z_init)
+            {
+                (void)inflateEnd(&u->z);
+            }
+            memset(&u->z, 0, sizeof(u->z));
+            /* 16 + 15 for the gzip header, -15 for a bare deflate stream */
+            u->z_init = (inflateInit2(&u->z, (codec == CODEC_GZIP) ? 31 : -15)
+                         == Z_OK);
+            return u->z_init ? true : fail(u, ARCHIVE_ERROR_READ);
+#endif
+#ifdef CVC_ZSTD
+        case CODEC_ZSTD:
+            if ((u->zstd == NULL) && ((u->zstd = ZSTD_createDStream()) == NULL))
+            {
+                return fail(u, ARCHIVE_ERROR_READ);
+            }
+            u->zstd_hint = 0U;
+            return ZSTD_isError(ZSTD_initDStream(u->zstd))
+                   ? fail(u, ARCHIVE_ERROR_READ) : true;
+#endif
+        default:
+            return fail(u, ARCHIVE_ERROR_UNSUPPORTED);
+    }
+}
+
+static void
+codec_end(unpack_t* u)
+{
+#ifdef CVC_ZLIB
+    if (u->z_init)
+    {
+        (void)inflateEnd(&u->z);
+        u->z_init = false;
+    }
+#endif
+#ifdef CVC_ZSTD
+    if (u->zstd != NULL)
+    {
+        (void)ZSTD_freeDStream(u->zstd);
+        u->zstd = NULL;
+    }
+#endif
+    (void)u;
+}
+
+#ifdef CVC_ZLIB
+static size_t
+inflate_some(unpack_t* u, unsigned char* dst, size_t len)
+{
+    z_stream* z = &u->z;
+
+    z->next_out = dst;
+    z->avail_out = (uInt)len;
+    while ((z->avail_out == len) && !u->done)
+    {
+        if ((u->in_pos == u->in_len) && !raw_fill(u))
+        {
+            (void)fail(u, ARCHIVE_ERROR_FORMAT); /* truncated */
+            return 0U;
+        }
+        z->next_in = u->in + u->in_pos;
+        z->avail_in = (uInt)(u->in_len - u->in_pos);
+        int rc = inflate(z, Z_NO_FLUSH);
+        u->in_pos = u->in_len - z->avail_in;
+        if (rc == Z_STREAM_END)
+        {
+            /* gzip files may be concatenated */
+            if ((u->codec == CODEC_GZIP)
+                && ((u->in_pos < u->in_len) || raw_fill(u)))
+            {
+                (void)inflateReset(z);
+            }
+            else
+            {
+                u->done = true;
+            }
+        }
+        else if ((rc != Z_OK) && (rc != Z_BUF_ERROR))
+        {
+            (void)fail(u, (rc == Z_MEM_ERROR) ? ARCHIVE_ERROR_READ
+                                              : ARCHIVE_ERROR_FORMAT);
+            return 0U;
+        }
+    }
+
+    return len - z->avail_out;
+}
+#endif
+
+#ifdef CVC_ZSTD
+static size_t
+zstd_some(unpack_t* u, unsigned char* dst, size_t len)
+{
+    ZSTD_outBuffer out = {dst, len, 0U};
+
+    while ((out.pos == 0U) && !u->done)
+    {
+        bool more = (u->in_pos < u->in_len) || raw_fill(u);
+        if (u->status != ARCHIVE_OK)
+        {
+            return 0U;
+        }
+        if (!more && (u->zstd_hint == 0U))
+        {
+            u->done = true; /* behind the last frame */
+            break;
+        }
+        ZSTD_inBuffer in = {u->in + u->in_pos, more ? u->in_len - u->in_pos : 0U,
+                            0U};
+        size_t rc = ZSTD_decompressStream(u->zstd, &out, &in);
+        u->in_pos += in.pos;
+        if (ZSTD_isError(rc) || (!more && (out.pos == 0U)))
+        {
+            (void)fail(u, ARCHIVE_ERROR_FORMAT); /* or truncated */
+            return 0U;
+        }
+        u->zstd_hint = rc;
+    }
+
+    return out.pos;
+}
+#endif
+
+/* Unpacks up to len bytes to dst, 0 at the end of the stream or on errors. */
+static size_t
+unpack_some(unpack_t* u, unsigned char* dst, size_t len)
+{
+    switch (u->codec)
+    {
+#ifdef CVC_ZLIB
+        case CODEC_GZIP:
+        case CODEC_DEFLATE:
+            return inflate_some(u, dst, len);
+#endif
+#ifdef CVC_ZSTD
+        case CODEC_ZSTD:
+            return zstd_some(u, dst, len);
+#endif
+        default:
+            break;
+    }
+
+    if ((u->in_pos == u->in_len) && !raw_fill(u))
+    {
+        return 0U;
+    }
+    size_t n = u->in_len - u->in_pos;
+    if (n > len)
+    {
+        n = len;
+    }
+    memcpy(dst, u->in + u->in_pos, n);
+    u->in_pos += n;
+
+    return n;
+}
+
+/* Unpacks len bytes to dst, fewer only at the end of the stream. */
+static size_t
+unpack_full(unpack_t* u, unsigned char* dst, size_t len)
+{
+    size_t done = 0U;
+
+    while (done < len)
+    {
+        size_t n = unpack_some(u, dst + done, len - done);
+        if (n == 0U)
+        {
+            break;
+        }
+        done += n;
+    }
+
+    return done;
+}
+
+static bool
+unpack_skip(unpack_t* u, uint64_t len)
+{
+    while (len > 0U)
+    {
+        size_t n = (len < UNPACK_BUF_SIZE) ? (size_t)len : UNPACK_BUF_SIZE;
+        if (unpack_full(u, u->out, n) != n)
+        {
+            return fail(u, ARCHIVE_ERROR_FORMAT);
+        }
+        len -= n;
+    }
+
+    return true;
+}
+
+static bool
+emit(unpack_t* u, const void* data, size_t len)
+{
+    const char* p = data;
+
+    while (len > 0U)
+    {
+        ssize_t n = write(u->a->in, p, len);
+        if (n > 0)
+        {
+            p += n;
+            len -= (size_t)n;
+        }
+        else if ((n < 0) && (errno != EINTR))
+        {
+            u->stopped = true; /* EPIPE once archive_finish() was called */
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+emit_frame(unpack_t* u, const unsigned char* data, size_t len)
+{
+    uint32_t frame = (uint32_t)len;
+
+    return emit(u, &frame, sizeof(frame)) && ((len == 0U) || emit(u, data, len));
+}
+
+/*
+ * Hands out the member name with the head_len bytes at head and size bytes
+ * of the stream, all up to its end if size is UINT64_MAX. Returns false if
+ * unpacking is to stop.
+ */
+static bool
+emit_member(unpack_t* u, const char* name, const unsigned char* head,
+            size_t head_len, uint64_t size)
+{
+    while ((name[0] == '.') && (name[1] == '/'))
+    {
+        name += 2;
+    }
+    uint16_t name_len = (uint16_t)strlen(name);
+    if (!emit(u, &name_len, sizeof(name_len)) || !emit(u, name, name_len)
+        || ((head_len > 0U) && !emit_frame(u, head, head_len)))
+    {
+        return false;
+    }
+
+    while (size > 0U)
+    {
+        size_t want = (size < UNPACK_BUF_SIZE) ? (size_t)size : UNPACK_BUF_SIZE;
+        size_t n = unpack_some(u, u->out, want);
+        if (n == 0U)
+        {
+            if ((size != UINT64_MAX) || (u->status != ARCHIVE_OK))
+            {
+                return fail(u, ARCHIVE_ERROR_FORMAT);
+            }
+            break;
+        }
+        if (!emit_frame(u, u->out, n))
+        {
+            return false;
+        }
+        size -= (size != UINT64_MAX) ? n : 0U;
+    }
+
+    return emit_frame(u, NULL, 0U);
+}
+
+/* Parses a numeric field of tar, octal or base-256 for large values. */
+static uint64_t
+tar_number(const unsigned char* field, size_t len, bool* ok)
+{
+    uint64_t n = 0U;
+    size_t i = 0U;
+
+    if ((field[0] & 0x80U) != 0U)
+    {
+        for (i = 1U; i < len; i++)
+        {
+            if ((field[0] != 0x80U) || ((n >> 56) != 0U))
+            {
+                *ok = false; /* negative or too large */
+                return 0U;
+            }
+            n = (n << 8) | field[i];
+        }
+        return n;
+    }
+
+    while ((i < len) && (field[i] == ' '))
+    {
+        i++;
+    }
+    for (; (i < len) && (field[i] >= '0') && (field[i] <= '7'); i++)
+    {
+        if ((n >> 61) != 0U)
+        {
+            *ok = false;
+            return 0U;
+        }
+        n = (n << 3) | (uint64_t)(field[i] - '0');
+    }
+    if ((i < len) && (field[i] != '\0') && (field[i] != ' '))
+    {
+        *ok = false;
+    }
+
+    return n;
+}
+
+static bool
+all_zero(const unsigned char* p, size_t len)
+{
+    for (size_t i = 0U; i < len; i++)
+    {
+        if (p[i] != 0U)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Checks a header block by its checksum, also as some tars sum signed. */
+static bool
+tar_header(const unsigned char* h)
+{
+    bool ok = true;
+    uint64_t sum = tar_number(h + 148, 8U, &ok);
+    uint64_t unsigned_sum = 8U * ' ';
+    int64_t signed_sum = 8 * ' ';
+
+    for (size_t i = 0U; i < TAR_BLOCK; i++)
+    {
+        if ((i < 148U) || (i >= 156U))
+        {
+            unsigned_sum += h[i];
+            signed_sum += (signed char)h[i];
+        }
+    }
+
+    return ok && ((sum == unsigned_sum) || ((int64_t)sum == signed_sum));
+}
+
+static void
+copy_name(char* name, const void* src, size_t len)
+{
+    const char* end = memchr(src, '\0', len);
+    size_t n = (end != NULL) ? (size_t)(end - (const char*)src) : len;
+
+    if (n > ARCHIVE_NAME_MAX)
+    {
+        n = ARCHIVE_NAME_MAX;
+    }
+    memcpy(name, src, n);
+    name[n] = '\0';
+}
+
+/* The name of a ustar header, with the prefix of POSIX ones. */
+static void
+tar_name(const unsigned char* h, char* name)
+{
+    size_t n = 0U;
+
+    if ((memcmp(h + 257, "ustar", 6U) == 0) && (h[345] != '\0'))
+    {
+        copy_name(name, h + 345, 155U);
+        n = strlen(name);
+        name[n++] = '/';
+    }
+    copy_name(name + n, h, 100U);
+}
+
+/* Takes path and size of the records "LEN KEY=VALUE\n" of a pax header. */
+static bool
+pax_parse(unpack_t* u, const unsigned char* p, size_t len, bool* named,
+          bool* sized, uint64_t* size)
+{
+    while (len > 0U)
+    {
+        size_t n = 0U;
+        size_t i = 0U;
+        for (; (i < len) && (p[i] >= '0') && (p[i] <= '9') && (n <= len); i++)
+        {
+            n = (n * 10U) + (size_t)(p[i] - '0');
+        }
+        if ((i == 0U) || (i >= len) || (p[i] != ' ') || (n <= (i + 1U))
+            || (n > len) || (p[n - 1U] != '\n'))
+        {
+            return fail(u, ARCHIVE_ERROR_FORMAT);
+        }
+
+        const unsigned char* key = p + i + 1U;
+        const unsigned char* end = p + n - 1U;
+        const unsigned char* eq = memchr(key, '=', (size_t)(end - key));
+        if (eq != NULL)
+        {
+            size_t key_len = (size_t)(eq - key);
+            size_t value_len = (size_t)(end - eq) - 1U;
+            if ((key_len == 4U) && (memcmp(key, "path", 4U) == 0)
+                && (value_len <= ARCHIVE_NAME_MAX))
+            {
+                copy_name(u->name, eq + 1, value_len);
+                *named = true;
+            }
+            else if ((key_len == 4U) && (memcmp(key, "size", 4U) == 0))
+            {
+                bool ok = true;
+                *size = 0U;
+                for (size_t k = 1U; k <= value_len; k++)
+                {
+                    unsigned char c = eq[k];
+                    ok = ok && (c >= '0') && (c <= '9')
+                         && (*size <= (UINT64_MAX / 10U) - 1U);
+                    *size = (*size * 10U) + (uint64_t)(c - '0');
+                }
+                if (!ok || (value_len == 0U))
+                {
+                    return fail(u, ARCHIVE_ERROR_FORMAT);
+                }
+                *sized = true;
+            }
+        }
+        p += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+/*
+ * Hands out the regular files of a tar stream, h holds its first block.
+ * GNU long names and the path and size of pax headers are taken.
+ */
+static bool
+unpack_tar(unpack_t* u, unsigned char* h)
+{
+    bool named = false; /* by the header before */
+    bool sized = false;
+    uint64_t pax_size = 0U;
+
+    while (!all_zero(h, TAR_BLOCK))
+    {
+        bool ok = tar_header(h);
+        uint64_t size = tar_number(h + 124, 12U, &ok);
+        unsigned char type = h[156];
+        if (!ok)
+        {
+            return fail(u, ARCHIVE_ERROR_FORMAT);
+        }
+
+        if ((type == 'L') || (type == 'x'))
+        {
+            if (size > UNPACK_BUF_SIZE)
+            {
+                if ((type == 'L') || !unpack_skip(u, (size + 511U) & ~511ULL))
+                {
+                    return fail(u, ARCHIVE_ERROR_FORMAT);
+                }
+            }
+            else
+            {
+                size_t padded = ((size_t)size + 511U) & ~(size_t)511U;
+                if (unpack_full(u, u->out, padded) != padded)
+                {
+                    return fail(u, ARCHIVE_ERROR_FORMAT);
+                }
+                if (type == 'L')
+                {
+                    copy_name(u->name, u->out, (size_t)size);
+                    named = true;
+                }
+                else if (!pax_parse(u, u->out, (size_t)size, &named, &sized,
+                                    &pax_size))
+                {
+                    return false;
+                }
+            }
+        }
+        else
+        {
+            if (sized)
+            {
+                size = pax_size;
+            }
+            if (size > (UINT64_MAX - 511U))
+            {
+                return fail(u, ARCHIVE_ERROR_FORMAT);
+            }
+            if (!named)
+            {
+                tar_name(h, u->name);
+            }
+            size_t len = strlen(u->name);
+            uint64_t skip = ((size + 511U) & ~511ULL) - size;
+            if (((type == '0') || (type == '\0') || (type == '7'))
+                && (len > 0U) && (u->name[len - 1U] != '/')
+                && has_extension(u->name, u->a->exts))
+            {
+                if (!emit_member(u, u->name, NULL, 0U, size))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                skip += size;
+            }
+            if (!unpack_skip(u, skip))
+            {
+                return false;
+            }
+            named = false;
+            sized = false;
+        }
+
+        size_t n = unpack_full(u, h, TAR_BLOCK);
+        if (n != TAR_BLOCK)
+        {
+            /* the blocks of zeros at the end are often left out */
+            return (n == 0U) ? (u->status == ARCHIVE_OK)
+                             : fail(u, ARCHIVE_ERROR_FORMAT);
+        }
+    }
+
+    return true;
+}
+
+/* Finds the central directory of a zip file of size bytes. */
+static bool
+zip_directory(unpack_t* u, uint64_t size, uint64_t* count, uint64_t* offset,
+              uint64_t* len)
+{
+    size_t tail_len = (size < ZIP_TAIL_MAX) ? (size_t)size : ZIP_TAIL_MAX;
+    unsigned char* tail = malloc(tail_len);
+    if (tail == NULL)
+    {
+        return fail(u, ARCHIVE_ERROR_READ);
+    }
+    if (!read_at(u, size - tail_len, tail, tail_len))
+    {
+        free(tail);
+        return false;
+    }
+
+    size_t found = tail_len; /* index of the end record */
+    for (size_t i = tail_len - ZIP_EOCD_SIZE + 1U; i-- > 0U;)
+    {
+        if ((le32(tail + i) == 0x06054B50U)
+            && ((i + ZIP_EOCD_SIZE + le16(tail + i + 20)) <= tail_len))
+        {
+            found = i;
+            break;
+        }
+    }
+    if (found < tail_len)
+    {
+        *count = le16(tail + found + 10);
+        *len = le32(tail + found + 12);
+        *offset = le32(tail + found + 16);
+    }
+    free(tail);
+    if (found == tail_len)
+    {
+        return fail(u, ARCHIVE_ERROR_FORMAT);
+    }
+    uint64_t at = (size - tail_len) + found;
+
+    /* Zip64, found by the locator in front of the end record */
+    if ((*count == 0xFFFFU) || (*len == 0xFFFFFFFFU)
+        || (*offset == 0xFFFFFFFFU))
+    {
+        unsigned char record[56];
+        if ((at < 20U) || !read_at(u, at - 20U, record, 20U)
+            || (le32(record) != 0x07064B50U)
+            || !read_at(u, le64(record + 8), record, sizeof(record))
+            || (le32(record) != 0x06064B50U))
+        {
+            return fail(u, ARCHIVE_ERROR_FORMAT);
+        }
+        *count = le64(record + 32);
+        *len = le64(record + 40);
+        *offset = le64(record + 48);
+    }
+    if ((*offset > size) || (*len > (size - *offset)))
+    {
+        return fail(u, ARCHIVE_ERROR_FORMAT);
+    }
+
+    return (*len <= ZIP_CD_MAX) ? true : fail(u, ARCHIVE_ERROR_UNSUPPORTED);
+}
+
+/*
+ * Hands out the files of a zip archive, taken from its central directory.
+ * Members stored or deflated are unpacked, encrypted ones or those of other
+ * methods are left out and make the archive unsupported in the end.
+ */
+static bool
+unpack_zip(unpack_t* u)
+{
+    struct stat st;
+    uint64_t count = 0U;
+    uint64_t offset = 0U;
+    uint64_t len = 0U;
+
+    if ((fstat(u->a->fd, &st) != 0) || !S_ISREG(st.st_mode))
+    {
+        return fail(u, ARCHIVE_ERROR_UNSUPPORTED); /* zip needs seeking */
+    }
+    uint64_t size = (uint64_t)st.st_size;
+    if ((size < ZIP_EOCD_SIZE) || !zip_directory(u, size, &count, &offset, &len))
+    {
+        return fail(u, ARCHIVE_ERROR_FORMAT);
+    }
+    unsigned char* cd = malloc((len > 0U) ? (size_t)len : 1U);
+    if (cd == NULL)
+    {
+        return fail(u, ARCHIVE_ERROR_READ);
+    }
+    bool ok = read_at(u, offset, cd, (size_t)len);
+    bool unsupported = false;
+
+    size_t pos = 0U;
+    for (uint64_t e = 0U; ok && (e < count); e++)
+    {
+        const unsigned char* c = cd + pos;
+        if (((len - pos) < 46U) || (le32(c) != 0x02014B50U))
+        {
+            ok = fail(u, ARCHIVE_ERROR_FORMAT);
+            break;
+        }
+        uint16_t flags = le16(c + 8);
+        uint16_t method = le16(c + 10);
+        uint64_t csize = le32(c + 20);
+        uint64_t usize = le32(c + 24);
+        size_t name_len = le16(c + 28);
+        size_t extra_len = le16(c + 30);
+        size_t entry_len = 46U + name_len + extra_len + le16(c + 32);
+        uint64_t local = le32(c + 42);
+        if ((len - pos) < entry_len)
+        {
+            ok = fail(u, ARCHIVE_ERROR_FORMAT);
+            break;
+        }
+        pos += entry_len;
+
+        /* Zip64 sizes and offset, those set to all ones in the entry */
+        for (const unsigned char* x = c + 46 + name_len;
+             x + 4 <= c + 46 + name_len + extra_len;
+             x += 4 + le16(x + 2))
+        {
+            const unsigned char* q = x + 4;
+            const unsigned char* end = q + le16(x + 2);
+            if ((le16(x) != 0x0001U) || (end > (c + 46 + name_len + extra_len)))
+            {
+                continue;
+            }
+            uint64_t* fields[] = {&usize, &csize, &local};
+            for (size_t k = 0U; k < 3U; k++)
+            {
+                if ((*fields[k] == 0xFFFFFFFFU) && ((q + 8) <= end))
+                {
+                    *fields[k] = le64(q);
+                    q += 8;
+                }
+            }
+        }
+
+        copy_name(u->name, c + 46, name_len);
+        if ((name_len == 0U) || (name_len > ARCHIVE_NAME_MAX)
+            || (u->name[name_len - 1U] == '/')
+            || !has_extension(u->name, u->a->exts))
+        {
+            continue; /* directories and filtered files */
+        }
+#ifdef CVC_ZLIB
+        bool known = (method == 0U) || (method == 8U);
+#else
+        bool known = (method == 0U);
+#endif
+        if (((flags & 0x0001U) != 0U) || !known)
+        {
+            unsupported = true;
+            continue;
+        }
+
+        unsigned char header[30];
+        ok = read_at(u, local, header, sizeof(header));
+        uint64_t data = local + sizeof(header) + le16(header + 26)
+                        + le16(header + 28);
+        if (ok && ((le32(header) != 0x04034B50U) || (data > size)
+                   || (csize > (size - data))
+                   || ((method == 0U) && (csize != usize))))
+        {
+            ok = fail(u, ARCHIVE_ERROR_FORMAT);
+        }
+        ok = ok && raw_seek(u, data, csize)
+             && codec_start(u, (method == 8U) ? CODEC_DEFLATE : CODEC_NONE)
+             && emit_member(u, u->name, NULL, 0U, usize);
+    }
+    free(cd);
+
+    return (ok && unsupported) ? fail(u, ARCHIVE_ERROR_UNSUPPORTED) : ok;
+}
+
+static bool
+unpack_archive(unpack_t* u)
+{
+    if (!raw_fill(u))
+    {
+        return fail(u, ARCHIVE_ERROR_FORMAT); /* empty */
+    }
+
+    const unsigned char* m = u->in;
+    codec_t codec = CODEC_NONE;
+    if ((u->in_len >= 4U) && (m[0] == 'P') && (m[1] == 'K')
+        && (((m[2] == 3U) && (m[3] == 4U)) || ((m[2] == 5U) && (m[3] == 6U))))
+    {
+        return unpack_zip(u);
+    }
+    if ((u->in_len >= 2U) && (m[0] == 0x1FU) && (m[1] == 0x8BU))
+    {
+        codec = CODEC_GZIP;
+    }
+    else if ((u->in_len >= 4U) && (le32(m) == 0xFD2FB528U))
+    {
+        codec = CODEC_ZSTD;
+    }
+    if (!codec_start(u, codec))
+    {
+        return false;
+    }
+
+    unsigned char h[TAR_BLOCK];
+    size_t n = unpack_full(u, h, sizeof(h));
+    if (u->status != ARCHIVE_OK)
+    {
+        return false;
+    }
+    if ((n == sizeof(h)) && (all_zero(h, sizeof(h)) || tar_header(h)))
+    {
+        return unpack_tar(u, h);
+    }
+    if (codec == CODEC_NONE)
+    {
+        return fail(u, ARCHIVE_ERROR_UNSUPPORTED);
+    }
+
+    /* a single compressed file, named as the archive without extension */
+    const char* base = strrchr(u->a->path, '/');
+    copy_name(u->name, (base != NULL) ? base + 1 : u->a->path,
+              ARCHIVE_NAME_MAX);
+    char* dot = strrchr(u->name, '.');
+    if (dot != NULL)
+    {
+        *dot = '\0';
+    }
+    if (!has_extension(u->name, u->a->exts))
+    {
+        return true;
+    }
+
+    return emit_member(u, "", h, n, UINT64_MAX);
+}
+
+static void*
+unpack_thread(void* arg)
+{
+    archive_t* a = arg;
+    unpack_t* u = calloc(1U, sizeof(unpack_t));
+    sigset_t pipe_signal;
+
+    /* a stopped reader shows as EPIPE here, as for git */
+    sigemptyset(&pipe_signal);
+    sigaddset(&pipe_signal, SIGPIPE);
+    (void)pthread_sigmask(SIG_BLOCK, &pipe_signal, NULL);
+
+    if (u == NULL)
+    {
+        a->status = ARCHIVE_ERROR_READ;
+    }
+    else
+    {
+        u->a = a;
+        u->in_left = UINT64_MAX;
+        u->status = ARCHIVE_OK;
+        u->in = malloc(UNPACK_BUF_SIZE);
+        u->out = malloc(UNPACK_BUF_SIZE);
+        if ((u->in == NULL) || (u->out == NULL))
+        {
+            u->status = ARCHIVE_ERROR_READ;
+        }
+        else
+        {
+            (void)unpack_archive(u);
+        }
+        codec_end(u);
+        free(u->in);
+        free(u->out);
+        a->status = u->status;
+        free(u);
+    }
+    (void)close(a->in);
+    a->in = -1;
+
+    return NULL;
+}
+
+bool
+archive_start(archive_t* a, const char* path, const char* exts, char* buf,
+              size_t buf_size)
+{
+    int fds[2];
+
+    a->path = path;
+    a->exts = exts;
+    a->status = ARCHIVE_OK;
+    a->unpacking = false;
+    a->fd = open(path, O_RDONLY);
+    if (a->fd < 0)
+    {
+        return false;
+    }
+    if (pipe(fds) != 0)
+    {
+        (void)close(a->fd);
+        return false;
+    }
+    a->in = fds[1];
+    reader_attach(&a->out, fds[0], buf, buf_size);
+    reader_limit(&a->out, 0U);
+    a->unpacking = (pthread_create(&a->unpacker, NULL, unpack_thread, a) == 0);
+    if (!a->unpacking)
+    {
+        (void)close(a->in);
+        reader_close(&a->out);
+        (void)close(a->fd);
+    }
+
+    return a->unpacking;
+}
+
+bool
+archive_next(archive_t* a, const char** name)
+{
+    const char* data;
+    size_t len;
+    uint16_t name_len;
+
+    while (reader_next(&a->out, &data, &len))
+    {
+    }
+    if (a->out.error || !reader_read(&a->out, &name_len, sizeof(name_len))
+        || (name_len > ARCHIVE_NAME_MAX)
+        || !reader_read(&a->out, a->name, name_len))
+    {
+        return false;
+    }
+    a->name[name_len] = '\0';
+    reader_frames(&a->out);
+    *name = a->name;
+
+    return true;
+}
+
+archive_status_t
+archive_finish(archive_t* a)
+{
+    reader_close(&a->out); /* the thread stops with EPIPE, if still writing */
+    if (a->unpacking)
+    {
+        (void)pthread_join(a->unpacker, NULL);
+        a->unpacking = false;
+    }
+    (void)close(a->fd);
+    a->fd = -1;
+
+    return a->status;
+}
@@ -0,0 +1,74 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_ARCHIVE_H
+#define CVC_ARCHIVE_H
+
+#include "reader.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Extensions of archives, as for has_extension(). */
+#define ARCHIVE_EXTS        "tar,tgz,tzst,gz,zst,zip"
+#define ARCHIVE_NAME_MAX    (4096U) /* bytes of a member name */
+
+typedef enum
+{
+    ARCHIVE_OK,
+    ARCHIVE_ERROR_READ,        /* of the file, or out of memory */
+    ARCHIVE_ERROR_FORMAT,      /* malformed or truncated */
+    ARCHIVE_ERROR_UNSUPPORTED  /* format, compression or encryption */
+} archive_status_t;
+
+/*
+ * Members of a tar or zip archive, or the single file compressed by gzip
+ * or zstd, told by their contents, also for a tar archive compressed by
+ * either. A thread of its own unpacks the archive into a pipe, so unpacking
+ * overlaps with validation and nothing is written to disk. gzip and zip
+ * need CVC_ZLIB, zstd CVC_ZSTD.
+ */
+typedef struct
+{
+    int fd;
+    int in;        /* write end of the pipe, closed by the thread */
+    reader_t out;
+    pthread_t unpacker;
+    bool unpacking;
+    const char* path;
+    const char* exts;
+    archive_status_t status; /* of the thread, read once it is joined */
+    char name[ARCHIVE_NAME_MAX + 1U];
+} archive_t;
+
+/*
+ * Starts unpacking the archive at path, only members with one of exts (as
+ * for has_extension(), NULL for all) are provided. Both strings have to
+ * outlive a, buf is used for reading. Returns false if the file cannot be
+ * opened.
+ */
+bool
+archive_start(archive_t* a, const char* path, const char* exts, char* buf,
+              size_t buf_size);
+
+/*
+ * Moves on to the contents of the next regular member, which are then
+ * provided by reader_next() on a->out and need not be read completely.
+ * Sets *name to its path within the archive, or to "" for a single
+ * compressed file. Returns false after the last member or on errors.
+ */
+bool
+archive_next(archive_t* a, const char** name);
+
+/* Stops unpacking, also before the last member. */
+archive_status_t
+archive_finish(archive_t* a);
+
+#endif /* CVC_ARCHIVE_H */
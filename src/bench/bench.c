@@ -0,0 +1,626 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Benchmark driver: generates synthetic corpora, runs cvc on them with each
+ * input reader and scanner backend and reports throughput and peak memory.
+ * Results are written as tab-separated values, two result files can be
+ * compared to catch regressions between commits.
+ */
+
+#define _DEFAULT_SOURCE /* wait4(), mkdtemp() */
+
+#include "cargs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PROGRAM_NAME    "cvc-bench"
+#define FORMAT_VERSION  "1"
+
+#define KIB             (1024UL)
+#define MIB             (1024UL * 1024UL)
+#define PATH_LEN        (4096U)
+#define RETURN_OPTIONS  (5) /* cvc: invalid option, e.g. unsupported backend */
+
+enum
+{
+    ARG_ID_OUTPUT,
+    ARG_ID_SCALE,
+    ARG_ID_REPEAT,
+    ARG_ID_DIR,
+    ARG_ID_LABEL,
+    ARG_ID_COMPARE,
+    ARG_ID_THRESHOLD,
+    ARG_ID_HELP
+};
+
+const struct cag_option options[] =
+{
+    {
+        .identifier = ARG_ID_OUTPUT,
+        .access_letters = "o",
+        .access_name = "output",
+        .value_name = "FILE",
+        .description = "Write results to FILE (default: stdout)"
+    },
+    {
+        .identifier = ARG_ID_SCALE,
+        .access_letters = "s",
+        .access_name = "scale",
+        .value_name = "N",
+        .description = "Multiply corpus sizes by N (default: 1)"
+    },
+    {
+        .identifier = ARG_ID_REPEAT,
+        .access_letters = "r",
+        .access_name = "repeat",
+        .value_name = "N",
+        .description = "Runs per configuration, the best counts (default: 3)"
+    },
+    {
+        .identifier = ARG_ID_DIR,
+        .access_letters = "d",
+        .access_name = "dir",
+        .value_name = "DIR",
+        .description = "Generate corpora below DIR (default: temporary)"
+    },
+    {
+        .identifier = ARG_ID_LABEL,
+        .access_letters = "l",
+        .access_name = "label",
+        .value_name = "LABEL",
+        .description = "Label of this run, e.g. a commit (default: -)"
+    },
+    {
+        .identifier = ARG_ID_COMPARE,
+        .access_letters = "c",
+        .access_name = "compare",
+        .value_name = NULL,
+        .description = "Compare two result files BASE NEW instead"
+    },
+    {
+        .identifier = ARG_ID_THRESHOLD,
+        .access_letters = "t",
+        .access_name = "threshold",
+        .value_name = "PCT",
+        .description = "Slowdown reported as regression (default: 10)"
+    },
+    {
+        .identifier = ARG_ID_HELP,
+        .access_letters = "h",
+        .access_name = "help",
+        .value_name = NULL,
+        .description = "Show the command help"
+    }
+};
+
+typedef struct
+{
+    const char* name;
+    unsigned long files;
+    unsigned long size;       /* bytes per file */
+    const char* eol;
+    unsigned int invalid_pm;  /* invalid bytes per mille */
+    bool mixed_eol;           /* EOL mismatch close to the end of each file */
+} corpus_t;
+
+/* Sizes for scale 1, about 200 MiB in total. */
+static const corpus_t corpora[] =
+{
+    {"clean",   32UL,    1UL * MIB,  "\n",   0U,   false},
+    {"crlf",    32UL,    1UL * MIB,  "\r\n", 0U,   false},
+    {"mixed",   32UL,    1UL * MIB,  "\n",   0U,   true},
+    {"invalid", 32UL,    1UL * MIB,  "\n",   100U, false},
+    {"huge",    1UL,     64UL * MIB, "\n",   0U,   false},
+    {"tiny",    10000UL, 1UL * KIB,  "\n",   0U,   false}
+};
+
+static const char* const readers[] = {"mmap", "read"};
+static const char* const backends[] = {"scalar", "sse2", "avx2", "neon"};
+
+static const char* const columns =
+    "label\tcorpus\treader\tbackend\tfiles\tbytes\tseconds\tmb_per_s\t"
+    "files_per_s\tmax_rss_kb\n";
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t
+rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+
+    return (uint32_t)(rng_state >> 32);
+}
+
+static void
+fail(const char* what, const char* arg)
+{
+    fprintf(stderr, "Error: %s '%s': %s\n", what, arg, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+/* Fills buf with C-like text, every character valid with default options. */
+static void
+generate(char* buf, size_t size, const corpus_t* c)
+{
+    static const char* const words[] =
+    {
+        "int", "return", "static", "const", "char*", "buffer", "size_t",
+        "if", "(", ")", "{", "}", "=", "+", "0x7F", ";", "/* note */",
+        "while", "->", "value", "[i]", "#include", "<stdio.h>", "&&"
+    };
+    size_t eol_len = strlen(c->eol);
+    size_t mixed_from = size - (size / 100U);
+    size_t i = 0U;
+    size_t col = 0U;
+
+    while (i < size)
+    {
+        if ((col > 60U) || ((rng() % 16U) == 0U))
+        {
+            const char* eol = c->eol;
+            size_t len = eol_len;
+            if (c->mixed_eol && (i >= mixed_from) && ((rng() % 2U) == 0U))
+            {
+                eol = "\r\n";
+                len = 2U;
+            }
+            for (size_t k = 0U; (k < len) && (i < size); k++)
+            {
+                buf[i++] = eol[k];
+            }
+            col = 0U;
+            continue;
+        }
+        const char* w = words[rng() % (sizeof(words) / sizeof(words[0]))];
+        for (; (*w != '\0') && (i < size); w++, col++)
+        {
+            buf[i++] = *w;
+        }
+        if (i < size)
+        {
+            buf[i++] = ((rng() % 8U) == 0U) ? '\t' : ' ';
+            col++;
+        }
+    }
+
+    if (c->invalid_pm > 0U)
+    {
+        static const char invalid[] = {'@', '$', '`', '\x0B', '\x80', '\xE2'};
+        for (i = 0U; i < size; i++)
+        {
+            if (((rng() % 1000U) < c->invalid_pm) && (buf[i] != '\n')
+                && (buf[i] != '\r'))
+            {
+                buf[i] = invalid[rng() % sizeof(invalid)];
+            }
+        }
+    }
+}
+
+static void
+write_corpus(const char* dir, const corpus_t* c, unsigned long scale,
+             char* buf, unsigned long* files, unsigned long* bytes)
+{
+    char path[PATH_LEN];
+    unsigned long size = c->size;
+    unsigned long count = c->files;
+
+    /* many small files scale in number, everything else in size */
+    if (c->size < MIB)
+    {
+        count *= scale;
+    }
+    else
+    {
+        size *= scale;
+    }
+
+    (void)snprintf(path, sizeof(path), "%s/%s", dir, c->name);
+    if ((mkdir(path, 0755) != 0) && (errno != EEXIST))
+    {
+        fail("Failed to create directory", path);
+    }
+
+    for (unsigned long f = 0U; f < count; f++)
+    {
+        (void)snprintf(path, sizeof(path), "%s/%s/f%06lu.c", dir, c->name, f);
+        FILE* out = fopen(path, "wb");
+        if (out == NULL)
+        {
+            fail("Failed to create file", path);
+        }
+        generate(buf, size, c);
+        if (fwrite(buf, 1U, size, out) != size)
+        {
+            fail("Failed to write file", path);
+        }
+        fclose(out);
+    }
+
+    *files = count;
+    *bytes = count * size;
+}
+
+/*
+ * Runs cvc once, returning its exit code or -1. Wall time and peak resident
+ * set size of the child are returned in seconds and kib.
+ */
+static int
+run_cvc(const char* cvc, const char* path, const char* reader,
+        const char* backend, double* seconds, long* max_rss_kb)
+{
+    char backend_opt[64];
+    (void)snprintf(backend_opt, sizeof(backend_opt), "--backend=%s", backend);
+    char no_mmap[] = "--no-mmap";
+    char* argv[5];
+    size_t argc = 0U;
+    argv[argc++] = (char*)cvc;
+    argv[argc++] = backend_opt;
+    if (strcmp(reader, "read") == 0)
+    {
+        argv[argc++] = no_mmap;
+    }
+    argv[argc++] = (char*)path;
+    argv[argc] = NULL;
+
+    struct timespec t0;
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        return -1;
+    }
+    if (pid == 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0)
+        {
+            (void)dup2(null, STDOUT_FILENO);
+            (void)dup2(null, STDERR_FILENO);
+        }
+        execv(cvc, argv);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid)
+    {
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    *seconds = (double)(t1.tv_sec - t0.tv_sec)
+               + ((double)(t1.tv_nsec - t0.tv_nsec) / 1e9);
+    *max_rss_kb = usage.ru_maxrss;
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+#define CORPUS_COUNT (sizeof(corpora) / sizeof(corpora[0]))
+
+static bool
+generate_all(const char* dir, unsigned long scale, unsigned long* files,
+             unsigned long* bytes)
+{
+    unsigned long max_size = 0U;
+    for (size_t i = 0U; i < CORPUS_COUNT; i++)
+    {
+        if (corpora[i].size > max_size)
+        {
+            max_size = corpora[i].size;
+        }
+    }
+    char* buf = malloc(max_size * scale);
+    if (buf == NULL)
+    {
+        fprintf(stderr, "Error: Memory allocation failed!\n");
+        return false;
+    }
+
+    for (size_t i = 0U; i < CORPUS_COUNT; i++)
+    {
+        fprintf(stderr, "generating %s...\n", corpora[i].name);
+        write_corpus(dir, &corpora[i], scale, buf, &files[i], &bytes[i]);
+    }
+    free(buf);
+
+    return true;
+}
+
+static int
+bench(const char* cvc, const char* dir, unsigned long scale,
+      unsigned int repeat, const char* label, FILE* out)
+{
+    unsigned long files[CORPUS_COUNT];
+    unsigned long bytes[CORPUS_COUNT];
+
+    /*
+     * All corpora are written before the first run and the buffer is gone:
+     * the children are forked from this process, its resident pages would
+     * otherwise count into their peak memory.
+     */
+    if (!generate_all(dir, scale, files, bytes))
+    {
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "# " PROGRAM_NAME " " FORMAT_VERSION "\n%s", columns);
+    for (size_t i = 0U; i < CORPUS_COUNT; i++)
+    {
+        char path[PATH_LEN];
+        (void)snprintf(path, sizeof(path), "%s/%s", dir, corpora[i].name);
+
+        for (size_t r = 0U; r < (sizeof(readers) / sizeof(readers[0])); r++)
+        {
+            for (size_t b = 0U; b < (sizeof(backends) / sizeof(backends[0])); b++)
+            {
+                double best = 0.0;
+                long rss = 0L;
+                int rc = 0;
+                /* the first run warms up the page cache and is not counted */
+                for (unsigned int k = 0U; k <= repeat; k++)
+                {
+                    double seconds;
+                    long max_rss_kb;
+                    rc = run_cvc(cvc, path, readers[r], backends[b], &seconds,
+                                 &max_rss_kb);
+                    if ((rc < 0) || (rc == RETURN_OPTIONS))
+                    {
+                        break;
+                    }
+                    if ((k > 0U) && ((best == 0.0) || (seconds < best)))
+                    {
+                        best = seconds;
+                    }
+                    if (max_rss_kb > rss)
+                    {
+                        rss = max_rss_kb;
+                    }
+                }
+                if (rc == RETURN_OPTIONS)
+                {
+                    continue; /* backend not supported by this CPU */
+                }
+                if (rc < 0)
+                {
+                    fprintf(stderr, "Error: Failed to run '%s'!\n", cvc);
+                    return EXIT_FAILURE;
+                }
+                fprintf(out, "%s\t%s\t%s\t%s\t%lu\t%lu\t%.6f\t%.1f\t%.1f\t%ld\n",
+                        label, corpora[i].name, readers[r], backends[b],
+                        files[i], bytes[i], best,
+                        ((double)bytes[i] / (double)MIB) / best,
+                        (double)files[i] / best, rss);
+                fflush(out);
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+typedef struct
+{
+    char key[128]; /* corpus, reader and backend */
+    double mb_per_s;
+} result_t;
+
+static size_t
+load_results(const char* path, result_t* results, size_t max)
+{
+    FILE* in = fopen(path, "r");
+    if (in == NULL)
+    {
+        fail("Failed to open file", path);
+    }
+
+    char line[1024];
+    size_t n = 0U;
+    while ((n < max) && (fgets(line, sizeof(line), in) != NULL))
+    {
+        char corpus[32];
+        char reader[32];
+        char backend[32];
+        double mb_per_s;
+        if ((line[0] == '#') || (strncmp(line, "label\t", 6U) == 0))
+        {
+            continue;
+        }
+        if (sscanf(line, "%*[^\t]\t%31[^\t]\t%31[^\t]\t%31[^\t]\t%*s\t%*s\t%*s\t%lf",
+                   corpus, reader, backend, &mb_per_s) == 4)
+        {
+            (void)snprintf(results[n].key, sizeof(results[n].key), "%s/%s/%s",
+                           corpus, reader, backend);
+            results[n].mb_per_s = mb_per_s;
+            n++;
+        }
+    }
+    fclose(in);
+
+    return n;
+}
+
+static int
+compare(const char* base_path, const char* new_path, double threshold)
+{
+    static result_t base[256];
+    static result_t next[256];
+    size_t base_count = load_results(base_path, base, 256U);
+    size_t next_count = load_results(new_path, next, 256U);
+    int rc = EXIT_SUCCESS;
+
+    printf("%-28s %10s %10s %8s\n", "configuration", "base MB/s", "new MB/s",
+           "change");
+    for (size_t i = 0U; i < next_count; i++)
+    {
+        for (size_t j = 0U; j < base_count; j++)
+        {
+            if (strcmp(next[i].key, base[j].key) != 0)
+            {
+                continue;
+            }
+            double change = ((next[i].mb_per_s / base[j].mb_per_s) - 1.0) * 100.0;
+            bool regression = (change < -threshold);
+            printf("%-28s %10.1f %10.1f %+7.1f%%%s\n", next[i].key,
+                   base[j].mb_per_s, next[i].mb_per_s, change,
+                   regression ? "  REGRESSION" : "");
+            if (regression)
+            {
+                rc = EXIT_FAILURE;
+            }
+            break;
+        }
+    }
+
+    return rc;
+}
+
+static bool
+parse_number(const char* s, unsigned long* value)
+{
+    char* end;
+
+    errno = 0;
+    *value = strtoul((s != NULL) ? s : "", &end, 10);
+
+    return (s != NULL) && (end != s) && (*end == '\0') && (errno == 0)
+           && (*value > 0U);
+}
+
+static void
+show_usage(void)
+{
+    printf("Usage: "PROGRAM_NAME" [OPTION]... CVC\n"
+           "       "PROGRAM_NAME" -c [OPTION]... BASE NEW\n\n");
+    cag_option_print(options, CAG_ARRAY_SIZE(options), stdout);
+}
+
+int
+main(int argc, char** argv)
+{
+    const char* output = NULL;
+    const char* dir = NULL;
+    const char* label = "-";
+    unsigned long scale = 1U;
+    unsigned long repeat = 3U;
+    unsigned long threshold = 10U;
+    bool compare_mode = false;
+
+    cag_option_context context;
+    cag_option_init(&context, options, CAG_ARRAY_SIZE(options), argc, argv);
+    while (cag_option_fetch(&context))
+    {
+        switch (cag_option_get_identifier(&context))
+        {
+            case ARG_ID_OUTPUT:
+                output = cag_option_get_value(&context);
+                break;
+            case ARG_ID_SCALE:
+                if (!parse_number(cag_option_get_value(&context), &scale))
+                {
+                    fprintf(stderr, "Error: invalid scale!\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case ARG_ID_REPEAT:
+                if (!parse_number(cag_option_get_value(&context), &repeat))
+                {
+                    fprintf(stderr, "Error: invalid number of runs!\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case ARG_ID_DIR:
+                dir = cag_option_get_value(&context);
+                break;
+            case ARG_ID_LABEL:
+                label = cag_option_get_value(&context);
+                break;
+            case ARG_ID_COMPARE:
+                compare_mode = true;
+                break;
+            case ARG_ID_THRESHOLD:
+                if (!parse_number(cag_option_get_value(&context), &threshold))
+                {
+                    fprintf(stderr, "Error: invalid threshold!\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case ARG_ID_HELP:
+                show_usage();
+                return EXIT_SUCCESS;
+            default:
+                fprintf(stderr, "Error: invalid option!\n");
+                show_usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    int index = cag_option_get_index(&context);
+    if (compare_mode)
+    {
+        if ((argc - index) != 2)
+        {
+            show_usage();
+            return EXIT_FAILURE;
+        }
+        return compare(argv[index], argv[index + 1], (double)threshold);
+    }
+    if ((argc - index) != 1)
+    {
+        show_usage();
+        return EXIT_FAILURE;
+    }
+
+    char tmp[] = "/tmp/cvc-bench-XXXXXX";
+    if ((dir == NULL) && ((dir = mkdtemp(tmp)) == NULL))
+    {
+        fail("Failed to create directory", tmp);
+    }
+
+    FILE* out = stdout;
+    if ((output != NULL) && ((out = fopen(output, "w")) == NULL))
+    {
+        fail("Failed to create file", output);
+    }
+
+    int rc = bench(argv[index], dir, scale, (unsigned int)repeat, label, out);
+
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    if (dir == tmp)
+    {
+        char cmd[PATH_LEN + 16U];
+        (void)snprintf(cmd, sizeof(cmd), "rm -rf '%s'", tmp);
+        if (system(cmd) != 0)
+        {
+            fprintf(stderr, "Warning: Failed to remove '%s'!\n", tmp);
+        }
+    }
+
+    return rc;
+}
@@ -0,0 +1,691 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC      "CVCCACHE"
+#define CACHE_VERSION    (1U)
+#define CACHE_BYTE_ORDER (0x01020304U)
+#define CACHE_INDEX      "index"
+#define CACHE_RACY_NSEC  (0xFFFFFFFFU) /* mtime too recent to be trusted */
+#define CACHE_OBJECT_PREFIX "git" /* object keys "git/ID", paths are absolute */
+
+#define HASH_K1 (0x9E3779B97F4A7C15ULL)
+#define HASH_K2 (0xC2B2AE3D27D4EB4FULL)
+
+/*
+ * Index file layout: header, records sorted by path and fingerprint, then
+ * the paths of all records without terminators. All fields are stored in
+ * host byte order, an index of another byte order is ignored.
+ */
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t count;
+    uint32_t strings_len;
+} cache_header_t;
+
+typedef struct
+{
+    uint64_t fingerprint;
+    uint64_t size;
+    int64_t mtime_sec;
+    uint64_t hash;
+    uint32_t mtime_nsec;
+    uint32_t path_offset;
+    uint32_t path_len;
+    uint32_t errors;
+    uint32_t eol_error_line;
+    uint32_t result;
+} cache_record_t;
+
+typedef struct
+{
+    char* key; /* absolute path, NULL if slot unused */
+    size_t key_len;
+    cache_entry_t entry;
+    bool stored;
+} cache_slot_t;
+
+struct cache
+{
+    char* dir;
+    char* cwd;
+    time_t now;
+    void* map;
+    size_t map_len;
+    const cache_record_t* records;
+    uint32_t count;
+    const char* strings;
+    cache_slot_t* slots;
+    size_t slot_count;
+};
+
+/* Entry to be written, from the old index or from a slot. */
+typedef struct
+{
+    const char* path;
+    size_t path_len;
+    cache_entry_t entry;
+    bool update;
+} cache_item_t;
+
+static inline uint64_t
+hash_mix(uint64_t h, uint64_t w)
+{
+    h ^= w * HASH_K1;
+    h = (h << 31) | (h >> 33);
+
+    return h * HASH_K2;
+}
+
+static inline uint64_t
+load_le64(const unsigned char* p)
+{
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+void
+cache_hash_init(cache_hash_t* h)
+{
+    h->h = HASH_K2;
+    h->tail = 0U;
+    h->len = 0U;
+}
+
+void
+cache_hash_update(cache_hash_t* h, const void* data, size_t len)
+{
+    const unsigned char* p = data;
+    const unsigned char* end = p + len;
+    unsigned int fill = (unsigned int)(h->len % 8U);
+
+    h->len += len;
+    if (fill != 0U)
+    {
+        /* complete the word left over from the previous call */
+        for (; (fill < 8U) && (p < end); fill++, p++)
+        {
+            h->tail |= (uint64_t)*p << (8U * fill);
+        }
+        if (fill < 8U)
+        {
+            return;
+        }
+        h->h = hash_mix(h->h, h->tail);
+        h->tail = 0U;
+    }
+    for (; (size_t)(end - p) >= 8U; p += 8)
+    {
+        h->h = hash_mix(h->h, load_le64(p));
+    }
+    for (fill = 0U; p < end; fill++, p++)
+    {
+        h->tail |= (uint64_t)*p << (8U * fill);
+    }
+}
+
+uint64_t
+cache_hash_final(const cache_hash_t* h)
+{
+    uint64_t x = h->h;
+
+    if ((h->len % 8U) != 0U)
+    {
+        x = hash_mix(x, h->tail);
+    }
+    x ^= h->len;
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    x ^= x >> 33;
+
+    return x;
+}
+
+uint64_t
+cache_hash(const void* data, size_t len)
+{
+    cache_hash_t h;
+    cache_hash_init(&h);
+    cache_hash_update(&h, data, len);
+
+    return cache_hash_final(&h);
+}
+
+static char*
+current_dir(void)
+{
+    size_t size = 256U;
+
+    for (;;)
+    {
+        char* buf = malloc(size);
+        if (buf == NULL)
+        {
+            return NULL;
+        }
+        if (getcwd(buf, size) != NULL)
+        {
+            return buf;
+        }
+        free(buf);
+        if (errno != ERANGE)
+        {
+            return NULL;
+        }
+        size *= 2U;
+    }
+}
+
+static char*
+join(const char* dir, const char* name, size_t* len)
+{
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char* s = malloc(dir_len + name_len + 2U);
+    if (s != NULL)
+    {
+        memcpy(s, dir, dir_len);
+        s[dir_len] = '/';
+        memcpy(s + dir_len + 1U, name, name_len + 1U);
+        if (len != NULL)
+        {
+            *len = dir_len + 1U + name_len;
+        }
+    }
+
+    return s;
+}
+
+/* Maps the index of c->dir if it is intact, leaves the cache empty if not. */
+static void
+map_index(cache_t* c)
+{
+    char* path = join(c->dir, CACHE_INDEX, NULL);
+    if (path == NULL)
+    {
+        return;
+    }
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(cache_header_t)))
+    {
+        close(fd);
+        return;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return;
+    }
+
+    const cache_header_t* header = map;
+    size_t len = (size_t)st.st_size;
+    bool valid = (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) == 0)
+                 && (header->version == CACHE_VERSION)
+                 && (header->byte_order == CACHE_BYTE_ORDER)
+                 && ((sizeof(cache_header_t) + header->strings_len
+                      + ((size_t)header->count * sizeof(cache_record_t))) == len);
+    const cache_record_t* records =
+        (const cache_record_t*)((const char*)map + sizeof(cache_header_t));
+    for (uint32_t i = 0U; valid && (i < header->count); i++)
+    {
+        valid = (records[i].path_offset <= header->strings_len)
+                && (records[i].path_len
+                    <= (header->strings_len - records[i].path_offset));
+    }
+    if (!valid)
+    {
+        munmap(map, len);
+        return;
+    }
+
+    c->map = map;
+    c->map_len = len;
+    c->records = records;
+    c->count = header->count;
+    c->strings = (const char*)(records + header->count);
+}
+
+cache_t*
+cache_open(const char* dir, size_t slots)
+{
+    if ((mkdir(dir, 0777) != 0) && (errno != EEXIST))
+    {
+        return NULL;
+    }
+    struct stat st;
+    if ((stat(dir, &st) != 0) || !S_ISDIR(st.st_mode))
+    {
+        return NULL;
+    }
+
+    cache_t* c = calloc(1U, sizeof(cache_t));
+    if (c == NULL)
+    {
+        return NULL;
+    }
+    c->dir = malloc(strlen(dir) + 1U);
+    c->cwd = current_dir();
+    c->slots = calloc((slots > 0U) ? slots : 1U, sizeof(cache_slot_t));
+    if ((c->dir == NULL) || (c->cwd == NULL) || (c->slots == NULL))
+    {
+        free(c->dir);
+        free(c->cwd);
+        free(c->slots);
+        free(c);
+        return NULL;
+    }
+    strcpy(c->dir, dir);
+    c->slot_count = slots;
+    c->now = time(NULL);
+    map_index(c);
+
+    return c;
+}
+
+static int
+compare_key(const char* a, size_t a_len, uint64_t a_fp,
+            const char* b, size_t b_len, uint64_t b_fp)
+{
+    int cmp = memcmp(a, b, (a_len < b_len) ? a_len : b_len);
+    if (cmp != 0)
+    {
+        return cmp;
+    }
+    if (a_len != b_len)
+    {
+        return (a_len < b_len) ? -1 : 1;
+    }
+    if (a_fp != b_fp)
+    {
+        return (a_fp < b_fp) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static const cache_record_t*
+find(const cache_t* c, const char* key, size_t key_len, uint64_t fingerprint)
+{
+    size_t lo = 0U;
+    size_t hi = c->count;
+
+    while (lo < hi)
+    {
+        size_t mid = lo + ((hi - lo) / 2U);
+        const cache_record_t* r = &c->records[mid];
+        int cmp = compare_key(key, key_len, fingerprint,
+                              c->strings + r->path_offset, r->path_len,
+                              r->fingerprint);
+        if (cmp == 0)
+        {
+            return r;
+        }
+        if (cmp < 0)
+        {
+            hi = mid;
+        }
+        else
+        {
+            lo = mid + 1U;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Drops empty and "." components of the absolute path in place and lets ".."
+ * remove the one before, so that all spellings of a path share one key.
+ */
+static size_t
+normalize(char* path)
+{
+    size_t len = 0U;
+    const char* c = path;
+
+    while (*c != '\0')
+    {
+        while (*c == '/')
+        {
+            c++;
+        }
+        const char* end = c;
+        while ((*end != '\0') && (*end != '/'))
+        {
+            end++;
+        }
+        size_t n = (size_t)(end - c);
+        if ((n == 2U) && (c[0] == '.') && (c[1] == '.'))
+        {
+            while ((len > 0U) && (path[--len] != '/'))
+            {
+            }
+        }
+        else if ((n > 0U) && ((n != 1U) || (c[0] != '.')))
+        {
+            path[len++] = '/';
+            memmove(path + len, c, n);
+            len += n;
+        }
+        c = end;
+    }
+    if (len == 0U)
+    {
+        path[len++] = '/';
+    }
+    path[len] = '\0';
+
+    return len;
+}
+
+static bool
+set_key(cache_slot_t* s, const char* prefix, const char* name)
+{
+    free(s->key);
+    if (prefix != NULL)
+    {
+        s->key = join(prefix, name, &s->key_len);
+    }
+    else
+    {
+        s->key_len = strlen(name);
+        s->key = malloc(s->key_len + 1U);
+        if (s->key != NULL)
+        {
+            memcpy(s->key, name, s->key_len + 1U);
+        }
+    }
+
+    return (s->key != NULL);
+}
+
+cache_state_t
+cache_lookup(cache_t* c, size_t slot, const char* path, uint64_t fingerprint,
+             cache_entry_t* entry)
+{
+    cache_slot_t* s = &c->slots[slot];
+    struct stat st;
+
+    if ((stat(path, &st) != 0) || !S_ISREG(st.st_mode)
+        || !set_key(s, (path[0] != '/') ? c->cwd : NULL, path))
+    {
+        return CACHE_UNAVAILABLE;
+    }
+    s->key_len = normalize(s->key);
+
+    entry->size = (uint64_t)st.st_size;
+    entry->mtime_sec = (int64_t)st.st_mtim.tv_sec;
+    entry->mtime_nsec = (uint32_t)st.st_mtim.tv_nsec;
+    entry->fingerprint = fingerprint;
+
+    const cache_record_t* r = find(c, s->key, s->key_len, fingerprint);
+    if ((r == NULL) || (r->size != entry->size))
+    {
+        return CACHE_MISS;
+    }
+    entry->hash = r->hash;
+    entry->errors = r->errors;
+    entry->eol_error_line = r->eol_error_line;
+    entry->result = (int)r->result;
+
+    return ((r->mtime_sec == entry->mtime_sec)
+            && (r->mtime_nsec == entry->mtime_nsec)) ? CACHE_HIT : CACHE_CHANGED;
+}
+
+cache_state_t
+cache_lookup_object(cache_t* c, size_t slot, const char* id,
+                    uint64_t fingerprint, cache_entry_t* entry)
+{
+    cache_slot_t* s = &c->slots[slot];
+
+    if (!set_key(s, CACHE_OBJECT_PREFIX, id))
+    {
+        return CACHE_UNAVAILABLE;
+    }
+
+    entry->size = 0U;
+    entry->mtime_sec = 0;
+    entry->mtime_nsec = 0U;
+    entry->hash = 0U;
+    entry->fingerprint = fingerprint;
+
+    const cache_record_t* r = find(c, s->key, s->key_len, fingerprint);
+    if (r == NULL)
+    {
+        return CACHE_MISS;
+    }
+    entry->size = r->size;
+    entry->errors = r->errors;
+    entry->eol_error_line = r->eol_error_line;
+    entry->result = (int)r->result;
+
+    return CACHE_HIT;
+}
+
+void
+cache_store(cache_t* c, size_t slot, const cache_entry_t* entry)
+{
+    cache_slot_t* s = &c->slots[slot];
+
+    s->entry = *entry;
+    /*
+     * A file modified again within the timestamp granularity would keep its
+     * mtime. Recent ones are therefore verified by the hash next time.
+     */
+    if (entry->mtime_sec >= ((int64_t)c->now - 1))
+    {
+        s->entry.mtime_nsec = CACHE_RACY_NSEC;
+    }
+    s->stored = true;
+}
+
+static int
+compare_items(const void* a, const void* b)
+{
+    const cache_item_t* x = a;
+    const cache_item_t* y = b;
+    int cmp = compare_key(x->path, x->path_len, x->entry.fingerprint,
+                          y->path, y->path_len, y->entry.fingerprint);
+    if (cmp == 0)
+    {
+        cmp = (int)y->update - (int)x->update; /* updates first */
+    }
+
+    return cmp;
+}
+
+static bool
+write_items(FILE* out, const cache_item_t* items, size_t n)
+{
+    cache_header_t header;
+    uint64_t strings_len = 0U;
+
+    for (size_t i = 0U; i < n; i++)
+    {
+        strings_len += items[i].path_len;
+    }
+    if ((n > UINT32_MAX) || (strings_len > UINT32_MAX))
+    {
+        return false;
+    }
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.byte_order = CACHE_BYTE_ORDER;
+    header.count = (uint32_t)n;
+    header.strings_len = (uint32_t)strings_len;
+    bool ok = (fwrite(&header, sizeof(header), 1U, out) == 1U);
+
+    uint32_t offset = 0U;
+    for (size_t i = 0U; ok && (i < n); i++)
+    {
+        const cache_entry_t* e = &items[i].entry;
+        cache_record_t r =
+        {
+            .fingerprint = e->fingerprint,
+            .size = e->size,
+            .mtime_sec = e->mtime_sec,
+            .hash = e->hash,
+            .mtime_nsec = e->mtime_nsec,
+            .path_offset = offset,
+            .path_len = (uint32_t)items[i].path_len,
+            .errors = e->errors,
+            .eol_error_line = e->eol_error_line,
+            .result = (uint32_t)e->result
+        };
+        offset += r.path_len;
+        ok = (fwrite(&r, sizeof(r), 1U, out) == 1U);
+    }
+    for (size_t i = 0U; ok && (i < n); i++)
+    {
+        ok = (fwrite(items[i].path, 1U, items[i].path_len, out)
+              == items[i].path_len);
+    }
+
+    return ok;
+}
+
+/* Merges the old index with the slots into a new one, replaced atomically. */
+static bool
+write_index(const cache_t* c)
+{
+    cache_item_t* items = malloc((c->count + c->slot_count + 1U)
+                                 * sizeof(cache_item_t));
+    if (items == NULL)
+    {
+        return false;
+    }
+
+    size_t n = 0U;
+    for (uint32_t i = 0U; i < c->count; i++)
+    {
+        const cache_record_t* r = &c->records[i];
+        items[n].path = c->strings + r->path_offset;
+        items[n].path_len = r->path_len;
+        items[n].entry.fingerprint = r->fingerprint;
+        items[n].entry.size = r->size;
+        items[n].entry.mtime_sec = r->mtime_sec;
+        items[n].entry.mtime_nsec = r->mtime_nsec;
+        items[n].entry.hash = r->hash;
+        items[n].entry.errors = r->errors;
+        items[n].entry.eol_error_line = r->eol_error_line;
+        items[n].entry.result = (int)r->result;
+        items[n].update = false;
+        n++;
+    }
+    for (size_t i = 0U; i < c->slot_count; i++)
+    {
+        if (c->slots[i].stored)
+        {
+            items[n].path = c->slots[i].key;
+            items[n].path_len = c->slots[i].key_len;
+            items[n].entry = c->slots[i].entry;
+            items[n].update = true;
+            n++;
+        }
+    }
+    qsort(items, n, sizeof(cache_item_t), compare_items);
+
+    /* keep the first of equal keys, a stored result is sorted before */
+    size_t unique = 0U;
+    for (size_t i = 0U; i < n; i++)
+    {
+        if ((unique == 0U)
+            || (compare_key(items[i].path, items[i].path_len,
+                            items[i].entry.fingerprint,
+                            items[unique - 1U].path, items[unique - 1U].path_len,
+                            items[unique - 1U].entry.fingerprint) != 0))
+        {
+            items[unique++] = items[i];
+        }
+    }
+
+    bool ok = false;
+    char* path = join(c->dir, CACHE_INDEX, NULL);
+    char* tmp = join(c->dir, CACHE_INDEX ".XXXXXX", NULL);
+    int fd = ((path != NULL) && (tmp != NULL)) ? mkstemp(tmp) : -1;
+    if (fd >= 0)
+    {
+        FILE* out = fdopen(fd, "wb");
+        if (out == NULL)
+        {
+            close(fd);
+        }
+        else
+        {
+            ok = write_items(out, items, unique);
+            ok = (fclose(out) == 0) && ok;
+        }
+        ok = ok && (rename(tmp, path) == 0);
+        if (!ok)
+        {
+            (void)unlink(tmp);
+        }
+    }
+    free(path);
+    free(tmp);
+    free(items);
+
+    return ok;
+}
+
+bool
+cache_close(cache_t* c)
+{
+    bool modified = false;
+    for (size_t i = 0U; i < c->slot_count; i++)
+    {
+        modified = modified || c->slots[i].stored;
+    }
+    bool ok = !modified || write_index(c);
+
+    for (size_t i = 0U; i < c->slot_count; i++)
+    {
+        free(c->slots[i].key);
+    }
+    if (c->map != NULL)
+    {
+        munmap(c->map, c->map_len);
+    }
+    free(c->slots);
+    free(c->cwd);
+    free(c->dir);
+    free(c);
+
+    return ok;
+}
@@ -0,0 +1,103 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_CACHE_H
+#define CVC_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Incremental validation cache. Results are kept in a single binary index
+ * file, keyed by absolute path, with ".", ".." and empty components
+ * resolved lexically, and the fingerprint of the options used: unchanged
+ * files (same size and mtime) are not read again. If only the mtime
+ * differs, e.g. after a fresh checkout, the content hash decides.
+ */
+typedef struct cache cache_t;
+
+typedef struct
+{
+    uint64_t size;
+    int64_t mtime_sec;
+    uint32_t mtime_nsec;
+    uint64_t hash;           /* content hash, see cache_hash_update() */
+    uint64_t fingerprint;    /* of the options the result depends on */
+    uint32_t errors;
+    uint32_t eol_error_line; /* 0 if none */
+    int result;              /* RETURN_* code */
+} cache_entry_t;
+
+typedef enum
+{
+    CACHE_UNAVAILABLE, /* file not found or path too long, do not store */
+    CACHE_MISS,
+    CACHE_CHANGED,     /* same size but different mtime: compare the hash */
+    CACHE_HIT
+} cache_state_t;
+
+/* Streaming content hash, independent of how the input is split. */
+typedef struct
+{
+    uint64_t h;
+    uint64_t tail;
+    uint64_t len;
+} cache_hash_t;
+
+void
+cache_hash_init(cache_hash_t* h);
+
+void
+cache_hash_update(cache_hash_t* h, const void* data, size_t len);
+
+uint64_t
+cache_hash_final(const cache_hash_t* h);
+
+uint64_t
+cache_hash(const void* data, size_t len);
+
+/*
+ * Opens the cache in dir, creating dir if needed, with room to store the
+ * results of slots files. An unreadable or incompatible index is treated as
+ * empty. Returns NULL if dir cannot be used.
+ */
+cache_t*
+cache_open(const char* dir, size_t slots);
+
+/*
+ * Looks up path for slot. On return, entry holds the current size and mtime
+ * of the file and, unless CACHE_MISS or CACHE_UNAVAILABLE, the hash and the
+ * results stored. Different slots may be used concurrently.
+ */
+cache_state_t
+cache_lookup(cache_t* c, size_t slot, const char* path, uint64_t fingerprint,
+             cache_entry_t* entry);
+
+/*
+ * Looks up a git object by its id for slot. The id names the content, so
+ * there are no changes to detect: the result is CACHE_HIT or CACHE_MISS.
+ * The size stored is returned only for hits, the caller sets it otherwise.
+ */
+cache_state_t
+cache_lookup_object(cache_t* c, size_t slot, const char* id,
+                    uint64_t fingerprint, cache_entry_t* entry);
+
+/* Records entry for the file looked up in slot, replacing a stored one. */
+void
+cache_store(cache_t* c, size_t slot, const cache_entry_t* entry);
+
+/*
+ * Writes the updated index if anything was stored and frees the cache.
+ * Returns false if the index could not be written.
+ */
+bool
+cache_close(cache_t* c);
+
+#endif /* CVC_CACHE_H */
@@ -0,0 +1,290 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#include "cvc.h"
+#include "lex.h"
+#include "match.h"
+#include "scan.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct cvc
+{
+    char_table_t table;
+    lex_table_t lex;
+    bool context;
+    match_t* match; /* NULL without forbidden sequences */
+    scan_t scan;
+    eol_t eol;
+    bool first;
+    cvc_callback_t callback;
+    void* user;
+    uint64_t size;
+    bool eol_reported;
+};
+
+static const eol_t eol_modes[] =
+{
+    [CVC_EOL_AUTO] = EOL_AUTO_NA,
+    [CVC_EOL_LF] = EOL_LF,
+    [CVC_EOL_CRLF] = EOL_CRLF,
+    [CVC_EOL_CR] = EOL_CR
+};
+
+#define EOL_MODES (sizeof(eol_modes) / sizeof(eol_modes[0]))
+
+void
+cvc_options_init(cvc_options_t* options)
+{
+    memset(options, 0, sizeof(*options));
+    for (size_t i = 0x20U; i < MAX_VALID_CHAR; i++)
+    {
+        options->allowed[i] = true;
+    }
+    options->allowed['\t'] = true;
+    options->allowed['$'] = false;
+    options->allowed['@'] = false;
+    options->allowed['`'] = false;
+    for (size_t i = 0x20U; i < MAX_VALID_CHAR; i++)
+    {
+        options->extended[i] = true;
+    }
+    options->extended['\t'] = true;
+    options->eol = CVC_EOL_AUTO;
+    options->ranges[0].first = 0xA0U;
+    options->ranges[0].last = UTF8_MAX;
+    options->range_count = 1U;
+}
+
+static void
+on_char(void* user, const scan_violation_t* violation)
+{
+    const cvc_t* ctx = user;
+    const cvc_violation_t v =
+    {
+        .kind = (violation->kind == SCAN_VIOLATION_SEQUENCE)
+                ? CVC_VIOLATION_SEQUENCE : CVC_VIOLATION_CHAR,
+        .line = violation->line,
+        .column = violation->column,
+        .char_column = violation->char_column,
+        .offset = violation->offset,
+        .byte = violation->c,
+        .code_point = violation->code_point,
+        .length = violation->length
+    };
+
+    ctx->callback(&v, ctx->user);
+}
+
+/* Builds the matcher of the forbidden sequences, if there are any. */
+static bool
+build_match(cvc_t* ctx, const cvc_options_t* options)
+{
+    const char* patterns[CVC_FORBID_MAX];
+    size_t lengths[CVC_FORBID_MAX];
+    unsigned int count = (options->forbid_count < CVC_FORBID_MAX)
+                         ? options->forbid_count : CVC_FORBID_MAX;
+
+    ctx->match = NULL;
+    if (count == 0U)
+    {
+        return true;
+    }
+    for (unsigned int i = 0U; i < count; i++)
+    {
+        const cvc_sequence_t* seq = &options->forbid[i];
+        if ((seq->bytes == NULL) || (seq->length == 0U)
+            || (seq->length > MATCH_PATTERN_MAX)
+            || (memchr(seq->bytes, '\r', seq->length) != NULL)
+            || (memchr(seq->bytes, '\n', seq->length) != NULL))
+        {
+            return false;
+        }
+        patterns[i] = seq->bytes;
+        lengths[i] = seq->length;
+    }
+    ctx->match = match_build(patterns, lengths, count, simd_detect());
+
+    return (ctx->match != NULL);
+}
+
+cvc_t*
+cvc_create(const cvc_options_t* options)
+{
+    cvc_t* ctx = malloc(sizeof(cvc_t));
+    if (ctx == NULL)
+    {
+        return NULL;
+    }
+    if (!build_match(ctx, options))
+    {
+        free(ctx);
+        return NULL;
+    }
+
+    bool valid[CHAR_TABLE_SIZE];
+    memcpy(valid, options->allowed, sizeof(valid));
+    valid['\r'] = true;
+    valid['\n'] = true;
+    utf8_range_t ranges[UTF8_RANGES_MAX];
+    unsigned int count = (options->range_count < UTF8_RANGES_MAX)
+                         ? options->range_count : UTF8_RANGES_MAX;
+    for (unsigned int i = 0U; i < count; i++)
+    {
+        ranges[i].first = options->ranges[i].first;
+        ranges[i].last = options->ranges[i].last;
+    }
+    char_table_build(&ctx->table, valid, simd_detect());
+    if (options->utf8)
+    {
+        char_table_set_utf8(&ctx->table, ranges, count);
+    }
+    ctx->context = options->context;
+    if (ctx->context)
+    {
+        bool extended[CHAR_TABLE_SIZE];
+        memcpy(extended, options->extended, sizeof(extended));
+        extended['\r'] = true;
+        extended['\n'] = true;
+        lex_table_build(&ctx->lex, valid, extended, options->utf8, ranges,
+                        count, simd_detect());
+    }
+    ctx->eol = EOL_AUTO_NA;
+    if ((unsigned int)options->eol < EOL_MODES)
+    {
+        ctx->eol = eol_modes[options->eol];
+    }
+    ctx->first = options->first;
+    ctx->callback = options->callback;
+    ctx->user = options->user;
+    cvc_reset(ctx);
+
+    return ctx;
+}
+
+void
+cvc_destroy(cvc_t* ctx)
+{
+    if (ctx != NULL)
+    {
+        match_free(ctx->match);
+    }
+    free(ctx);
+}
+
+void
+cvc_reset(cvc_t* ctx)
+{
+    scan_init(&ctx->scan, &ctx->table, ctx->eol, NULL, ctx->first);
+    if (ctx->context)
+    {
+        scan_set_lexer(&ctx->scan, &ctx->lex);
+    }
+    if (ctx->match != NULL)
+    {
+        scan_set_matcher(&ctx->scan, ctx->match);
+    }
+    if (ctx->callback != NULL)
+    {
+        scan_set_callback(&ctx->scan, on_char, ctx);
+    }
+    ctx->size = 0U;
+    ctx->eol_reported = false;
+}
+
+/* Reports an EOL mismatch found by the scanner, once. */
+static void
+report_eol(cvc_t* ctx)
+{
+    if ((ctx->scan.eol_error_line == 0U) || ctx->eol_reported)
+    {
+        return;
+    }
+    ctx->eol_reported = true;
+    if (ctx->callback != NULL)
+    {
+        const cvc_violation_t v =
+        {
+            .kind = CVC_VIOLATION_EOL,
+            .line = ctx->scan.eol_error_line,
+            .column = ctx->scan.eol_error_column,
+            .char_column = ctx->scan.eol_error_char_column,
+            .offset = ctx->scan.eol_error_offset,
+            .byte = 0U,
+            .code_point = 0U,
+            .length = 0U
+        };
+        ctx->callback(&v, ctx->user);
+    }
+}
+
+bool
+cvc_feed(cvc_t* ctx, const void* data, size_t len)
+{
+    ctx->size += len;
+    if (scan_chunk(&ctx->scan, data, len))
+    {
+        return true;
+    }
+    report_eol(ctx);
+
+    return false;
+}
+
+cvc_result_t
+cvc_finish(cvc_t* ctx, cvc_summary_t* summary)
+{
+    scan_finish(&ctx->scan);
+    report_eol(ctx);
+
+    cvc_result_t result = CVC_VALID;
+    if (ctx->scan.eol_error_line != 0U)
+    {
+        result = CVC_ERROR_EOL;
+    }
+    else if (ctx->scan.errors != 0U)
+    {
+        result = CVC_INVALID;
+    }
+
+    if (summary != NULL)
+    {
+        summary->result = result;
+        summary->errors = ctx->scan.errors;
+        summary->eol_error_line = ctx->scan.eol_error_line;
+        summary->size = ctx->size;
+        switch (ctx->scan.eol)
+        {
+            case EOL_LF:
+                summary->eol = CVC_EOL_LF;
+                break;
+            case EOL_CRLF:
+                summary->eol = CVC_EOL_CRLF;
+                break;
+            case EOL_CR:
+                summary->eol = CVC_EOL_CR;
+                break;
+            default:
+                summary->eol = CVC_EOL_AUTO;
+                break;
+        }
+    }
+
+    return result;
+}
+
+cvc_result_t
+cvc_validate(cvc_t* ctx, const void* data, size_t len, cvc_summary_t* summary)
+{
+    cvc_reset(ctx);
+    (void)cvc_feed(ctx, data, len);
+
+    return cvc_finish(ctx, summary);
+}
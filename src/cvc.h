@@ -0,0 +1,159 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+/*
+ * libcvc: in-process validation of buffers and streams. A context holds the
+ * compiled character classes and the EOL policy and validates one input at
+ * a time, fed in chunks of any size. Contexts are independent, each may be
+ * used by another thread.
+ */
+
+#ifndef CVC_H
+#define CVC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define CVC_API __attribute__((visibility("default")))
+#else
+#define CVC_API
+#endif
+
+#define CVC_BYTE_VALUES (256)
+#define CVC_RANGES_MAX  (32)
+#define CVC_FORBID_MAX  (64) /* forbidden sequences */
+#define CVC_SEQUENCE_MAX (64) /* bytes of a forbidden sequence */
+
+typedef enum
+{
+    CVC_EOL_AUTO, /* the first EOL indicator sets it */
+    CVC_EOL_LF,
+    CVC_EOL_CRLF,
+    CVC_EOL_CR
+} cvc_eol_t;
+
+/* Same values as the exit codes of the cvc program. */
+typedef enum
+{
+    CVC_VALID = 0,
+    CVC_INVALID,   /* invalid characters or forbidden sequences found */
+    CVC_ERROR_EOL  /* inconsistent EOL indicators, validation stopped */
+} cvc_result_t;
+
+typedef enum
+{
+    CVC_VIOLATION_CHAR,
+    CVC_VIOLATION_EOL,
+    CVC_VIOLATION_SEQUENCE /* forbidden, see cvc_options_t */
+} cvc_violation_kind_t;
+
+typedef struct
+{
+    cvc_violation_kind_t kind;
+    unsigned long line;    /* starting at 1 */
+    unsigned long column;  /* in bytes, starting at 1 */
+    unsigned long char_column; /* in characters, code points with utf8 */
+    uint64_t offset;       /* of the offending byte in the input */
+    unsigned char byte;    /* the invalid character, 0 for EOL */
+    uint32_t code_point;   /* decoded with utf8, U+FFFD if ill-formed */
+    unsigned int length;   /* bytes of the character or sequence, 0 for EOL */
+} cvc_violation_t;
+
+/* Inclusive range of code points. */
+typedef struct
+{
+    uint32_t first;
+    uint32_t last;
+} cvc_range_t;
+
+/* Byte sequence, which must not contain CR or LF. */
+typedef struct
+{
+    const char* bytes;
+    size_t length; /* 1 to CVC_SEQUENCE_MAX */
+} cvc_sequence_t;
+
+typedef void (*cvc_callback_t)(const cvc_violation_t* violation, void* user);
+
+typedef struct
+{
+    bool allowed[CVC_BYTE_VALUES]; /* CR and LF are subject to eol only */
+    cvc_eol_t eol;
+    bool first;                    /* stop at the first invalid character */
+    bool utf8;                     /* decode UTF-8 above 0x7F, see ranges */
+    cvc_range_t ranges[CVC_RANGES_MAX]; /* permitted above U+007F */
+    unsigned int range_count;
+    bool context;                  /* tell code from comments and literals */
+    bool extended[CVC_BYTE_VALUES]; /* permitted in those, with context */
+    cvc_sequence_t forbid[CVC_FORBID_MAX]; /* invalid wherever they occur */
+    unsigned int forbid_count;
+    cvc_callback_t callback;       /* per violation, or NULL */
+    void* user;                    /* passed to callback */
+} cvc_options_t;
+
+typedef struct
+{
+    cvc_result_t result;
+    unsigned long errors;         /* invalid characters and sequences */
+    unsigned long eol_error_line; /* 0 if none */
+    cvc_eol_t eol;                /* expected or detected, AUTO if no EOL */
+    uint64_t size;                /* bytes fed */
+} cvc_summary_t;
+
+typedef struct cvc cvc_t;
+
+/*
+ * Sets the defaults of the cvc program: printable ASCII and horizontal tab,
+ * except $, @ and `, with automatic EOL detection. Without utf8, allowed
+ * covers all bytes, with utf8 only ASCII. The ranges permit U+00A0 and up
+ * then, bidirectional formatting and invisible characters are always
+ * invalid. With context, allowed applies to code and extended, all printable
+ * ASCII and horizontal tab, to comments and literals. The ranges only apply
+ * to those then, code is restricted to ASCII.
+ */
+CVC_API void
+cvc_options_init(cvc_options_t* options);
+
+/*
+ * Returns NULL if out of memory or a forbidden sequence is empty, too long or
+ * contains CR or LF. The options are copied, the sequences as well. Each
+ * occurrence of one counts as one error at its first byte, on top of any
+ * invalid characters in it.
+ */
+CVC_API cvc_t*
+cvc_create(const cvc_options_t* options);
+
+CVC_API void
+cvc_destroy(cvc_t* ctx);
+
+/* Starts a new input, with the same options. */
+CVC_API void
+cvc_reset(cvc_t* ctx);
+
+/*
+ * Validates the next len bytes of the input. Returns false once validation
+ * has stopped, at an EOL mismatch or with first set, further data is ignored.
+ */
+CVC_API bool
+cvc_feed(cvc_t* ctx, const void* data, size_t len);
+
+/*
+ * Ends the input, a truncated UTF-8 character counts as invalid unless
+ * validation has stopped before. Summary may be NULL.
+ */
+CVC_API cvc_result_t
+cvc_finish(cvc_t* ctx, cvc_summary_t* summary);
+
+/* Validates a complete buffer as a new input, see cvc_feed(). */
+CVC_API cvc_result_t
+cvc_validate(cvc_t* ctx, const void* data, size_t len, cvc_summary_t* summary);
+
+#endif /* CVC_H */
@@ -0,0 +1,21 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_EOL_H
+#define CVC_EOL_H
+
+typedef enum
+{
+    EOL_AUTO_NA, /* Not available, placeholder. */
+    EOL_CR,  /* CR = Carriage Return = \r, "Mac" */
+    EOL_LF,  /* LF = Line Feed = \n, "Unix/Linux" */
+    EOL_CRLF /* Sequence of CR and LF, "Windows" */
+} eol_t;
+
+#endif /* CVC_EOL_H */
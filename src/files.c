@@ -0,0 +1,290 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "files.h"
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define LIST_INITIAL_CAPACITY   (64U)
+
+void
+file_list_init(file_list_t* list)
+{
+    list->paths = NULL;
+    list->count = 0U;
+    list->capacity = 0U;
+}
+
+void
+file_list_free(file_list_t* list)
+{
+    for (size_t i = 0U; i < list->count; i++)
+    {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+    file_list_init(list);
+}
+
+static bool
+list_push(file_list_t* list, char* path)
+{
+    if (list->count == list->capacity)
+    {
+        size_t capacity = (list->capacity == 0U) ? LIST_INITIAL_CAPACITY
+                                                 : (list->capacity * 2U);
+        char** paths = realloc(list->paths, capacity * sizeof(char*));
+        if (paths == NULL)
+        {
+            return false;
+        }
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+    list->paths[list->count++] = path;
+
+    return true;
+}
+
+static char*
+join_path(const char* dir, size_t dir_len, const char* name)
+{
+    size_t name_len = strlen(name);
+    bool slash = (dir_len > 0U) && (dir[dir_len - 1U] != '/');
+    char* path = malloc(dir_len + (slash ? 1U : 0U) + name_len + 1U);
+    if (path != NULL)
+    {
+        memcpy(path, dir, dir_len);
+        if (slash)
+        {
+            path[dir_len++] = '/';
+        }
+        memcpy(path + dir_len, name, name_len + 1U);
+    }
+
+    return path;
+}
+
+bool
+file_list_add(file_list_t* list, const char* path)
+{
+    size_t len = strlen(path) + 1U;
+    char* copy = malloc(len);
+    if (copy != NULL)
+    {
+        memcpy(copy, path, len);
+    }
+    if ((copy == NULL) || !list_push(list, copy))
+    {
+        free(copy);
+        return false;
+    }
+
+    return true;
+}
+
+bool
+file_list_read(file_list_t* list, FILE* stream, int delim)
+{
+    char* record = NULL;
+    size_t len = 0U;
+    size_t capacity = 0U;
+    bool ok = true;
+    int c;
+
+    do
+    {
+        c = getc(stream);
+        if ((c == delim) || (c == EOF))
+        {
+            if ((len > 0U) && (delim == '\n') && (record[len - 1U] == '\r'))
+            {
+                len--;
+            }
+            if (len > 0U)
+            {
+                record[len] = '\0';
+                if (!file_list_add(list, record))
+                {
+                    ok = false;
+                    break;
+                }
+                len = 0U;
+            }
+        }
+        else
+        {
+            if ((len + 1U) >= capacity)
+            {
+                capacity = (capacity == 0U) ? 256U : (capacity * 2U);
+                char* r = realloc(record, capacity);
+                if (r == NULL)
+                {
+                    ok = false;
+                    break;
+                }
+                record = r;
+            }
+            record[len++] = (char)c;
+        }
+    } while (c != EOF);
+
+    if (ferror(stream))
+    {
+        ok = false;
+    }
+    free(record);
+
+    return ok;
+}
+
+bool
+has_extension(const char* name, const char* exts)
+{
+    if (exts == NULL)
+    {
+        return true;
+    }
+
+    const char* dot = strrchr(name, '.');
+    if ((dot == NULL) || (dot == name))
+    {
+        return false;
+    }
+    dot++;
+    size_t dot_len = strlen(dot);
+
+    const char* e = exts;
+    while (*e != '\0')
+    {
+        const char* sep = strchr(e, ',');
+        size_t e_len = (sep != NULL) ? (size_t)(sep - e) : strlen(e);
+        if ((e_len == dot_len) && (strncmp(e, dot, e_len) == 0))
+        {
+            return true;
+        }
+        if (sep == NULL)
+        {
+            break;
+        }
+        e = sep + 1;
+    }
+
+    return false;
+}
+
+static int
+compare_names(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+bool
+is_directory(const char* path)
+{
+    struct stat st;
+
+    return (stat(path, &st) == 0) && S_ISDIR(st.st_mode);
+}
+
+bool
+file_list_walk(file_list_t* list, const char* dir, const char* exts)
+{
+    DIR* d = opendir(dir);
+    if (d == NULL)
+    {
+        fprintf(stderr, "Error: Failed to open directory '%s'!\n", dir);
+        return false;
+    }
+
+    /* collect first, directory order is unspecified and output must not be */
+    file_list_t entries;
+    file_list_init(&entries);
+    bool ok = true;
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL)
+    {
+        if ((strcmp(de->d_name, ".") == 0) || (strcmp(de->d_name, "..") == 0))
+        {
+            continue;
+        }
+        if (!file_list_add(&entries, de->d_name))
+        {
+            ok = false;
+            break;
+        }
+    }
+    closedir(d);
+    if (!ok)
+    {
+        fprintf(stderr, "Error: Memory allocation failed!\n");
+        file_list_free(&entries);
+        return false;
+    }
+
+    qsort(entries.paths, entries.count, sizeof(char*), compare_names);
+
+    size_t dir_len = strlen(dir);
+    for (size_t i = 0U; i < entries.count; i++)
+    {
+        const char* name = entries.paths[i];
+        if (name[0] == '.')
+        {
+            continue; /* hidden, e.g. .git, .cvcrc or a swap file */
+        }
+        char* path = join_path(dir, dir_len, name);
+        struct stat st;
+        if (path == NULL)
+        {
+            fprintf(stderr, "Error: Memory allocation failed!\n");
+            ok = false;
+            break;
+        }
+        if (lstat(path, &st) != 0)
+        {
+            fprintf(stderr, "Error: Failed to stat '%s'!\n", path);
+            ok = false;
+            free(path);
+            continue;
+        }
+        if (S_ISLNK(st.st_mode) && (stat(path, &st) != 0 || S_ISDIR(st.st_mode)))
+        {
+            /* dangling or directory symlink, do not follow loops */
+            free(path);
+            continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            ok = file_list_walk(list, path, exts) && ok;
+            free(path);
+        }
+        else if (S_ISREG(st.st_mode) && has_extension(name, exts))
+        {
+            if (!list_push(list, path))
+            {
+                fprintf(stderr, "Error: Memory allocation failed!\n");
+                free(path);
+                ok = false;
+                break;
+            }
+        }
+        else
+        {
+            free(path);
+        }
+    }
+    file_list_free(&entries);
+
+    return ok;
+}
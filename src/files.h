@@ -0,0 +1,58 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_FILES_H
+#define CVC_FILES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Ordered list of input paths, each entry is an owned copy. */
+typedef struct
+{
+    char** paths;
+    size_t count;
+    size_t capacity;
+} file_list_t;
+
+void
+file_list_init(file_list_t* list);
+
+void
+file_list_free(file_list_t* list);
+
+bool
+file_list_add(file_list_t* list, const char* path);
+
+/*
+ * Adds all paths of a list read from stream, one path per delim-terminated
+ * record ('\n' or '\0'). Empty records are ignored.
+ */
+bool
+file_list_read(file_list_t* list, FILE* stream, int delim);
+
+/*
+ * Adds all regular files below dir recursively, in sorted order. Hidden
+ * files and directories (e.g. .git) are skipped. If exts is not NULL, only files with
+ * one of the comma-separated extensions are added, e.g. "c,h,cpp".
+ * Returns false if any directory could not be read; errors are reported on
+ * stderr and the walk continues with the remaining entries.
+ */
+bool
+file_list_walk(file_list_t* list, const char* dir, const char* exts);
+
+bool
+is_directory(const char* path);
+
+/* Matches name against exts as given to file_list_walk(), NULL matches all. */
+bool
+has_extension(const char* name, const char* exts);
+
+#endif /* CVC_FILES_H */
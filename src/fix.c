@@ -0,0 +1,326 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700 /* realpath() */
+
+#include "fix.h"
+#include "reader.h"
+#include "utf8.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ESCAPE_MAX_LEN  (10U) /* \UXXXXXXXX */
+
+static const char hex[] = "0123456789ABCDEF";
+
+/*
+ * The input is normalized to the target EOL first and then scanned, only the
+ * violations the scanner reports are rewritten. Bytes of a UTF-8 character
+ * not complete at the end of a chunk are carried over to the next, as the
+ * character may turn out invalid.
+ */
+typedef struct
+{
+    const fix_options_t* options;
+    FILE* out;
+    char* window;         /* carried bytes, then the normalized chunk */
+    uint64_t window_base; /* offset of window[0] in the normalized input */
+    uint64_t copied;      /* offset of the first byte not written yet */
+    unsigned int column;  /* characters written to the output line */
+    eol_t eol;            /* target, once known */
+    bool cr_pending;      /* the last input chunk ended with a CR */
+    bool sequence;        /* a forbidden sequence was found */
+} fixer_t;
+
+/* Writes the normalized input up to offset to, as it is. */
+static void
+copy(fixer_t* f, uint64_t to)
+{
+    const char* p = f->window + (f->copied - f->window_base);
+    size_t len = (size_t)(to - f->copied);
+
+    (void)fwrite(p, 1U, len, f->out);
+    for (size_t i = 0U; i < len; i++)
+    {
+        unsigned char b = (unsigned char)p[i];
+        if ((b == '\n') || (b == '\r'))
+        {
+            f->column = 0U;
+        }
+        else if ((b & 0xC0U) != 0x80U) /* not a UTF-8 continuation byte */
+        {
+            f->column++;
+        }
+    }
+    f->copied = to;
+}
+
+static void
+fix_violation(void* user, const scan_violation_t* v)
+{
+    fixer_t* f = user;
+    char escape[ESCAPE_MAX_LEN * UTF8_SEQ_MAX];
+    char* q = escape;
+
+    if (v->kind == SCAN_VIOLATION_SEQUENCE)
+    {
+        f->sequence = true; /* the output is dropped */
+        return;
+    }
+    copy(f, v->offset);
+    if ((v->c == '\t') && (v->length == 1U))
+    {
+        unsigned int spaces = FIX_TAB_WIDTH - (f->column % FIX_TAB_WIDTH);
+        memset(q, ' ', spaces);
+        q += spaces;
+    }
+    else if (!f->options->escape)
+    {
+        /* removed */
+    }
+    else if ((v->length > 1U) && (v->code_point != UTF8_MALFORMED))
+    {
+        int digits = (v->code_point > 0xFFFFU) ? 8 : 4;
+        *q++ = '\\';
+        *q++ = (digits == 8) ? 'U' : 'u';
+        for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4)
+        {
+            *q++ = hex[(v->code_point >> shift) & 0x0FU];
+        }
+    }
+    else
+    {
+        const unsigned char* p = (const unsigned char*)f->window
+                                 + (v->offset - f->window_base);
+        for (unsigned int i = 0U; i < v->length; i++)
+        {
+            *q++ = '\\';
+            *q++ = (char)('0' + (p[i] >> 6));
+            *q++ = (char)('0' + ((p[i] >> 3) & 7U));
+            *q++ = (char)('0' + (p[i] & 7U));
+        }
+    }
+    (void)fwrite(escape, 1U, (size_t)(q - escape), f->out);
+    f->column += (unsigned int)(q - escape);
+    f->copied = v->offset + v->length;
+}
+
+static char*
+put_eol(char* q, eol_t eol)
+{
+    if (eol != EOL_LF)
+    {
+        *q++ = '\r';
+    }
+    if (eol != EOL_CR)
+    {
+        *q++ = '\n';
+    }
+
+    return q;
+}
+
+/*
+ * Writes the input with the target EOL to dst, which needs room for twice as
+ * many bytes, and returns the number of bytes written. A CR at the end is
+ * held back until the following byte is known, a NULL data flushes it.
+ */
+static size_t
+normalize(fixer_t* f, const char* data, size_t len, char* dst)
+{
+    char* q = dst;
+
+    if (data == NULL)
+    {
+        if (f->cr_pending)
+        {
+            f->cr_pending = false;
+            if (f->eol == EOL_AUTO_NA)
+            {
+                f->eol = EOL_CR;
+            }
+            q = put_eol(q, f->eol);
+        }
+        return (size_t)(q - dst);
+    }
+
+    for (size_t i = 0U; i < len; i++)
+    {
+        char c = data[i];
+        if (f->cr_pending)
+        {
+            f->cr_pending = false;
+            if (f->eol == EOL_AUTO_NA)
+            {
+                f->eol = (c == '\n') ? EOL_CRLF : EOL_CR;
+            }
+            q = put_eol(q, f->eol);
+            if (c == '\n')
+            {
+                continue;
+            }
+        }
+        if (c == '\r')
+        {
+            f->cr_pending = true;
+        }
+        else if (c == '\n')
+        {
+            if (f->eol == EOL_AUTO_NA)
+            {
+                f->eol = EOL_LF;
+            }
+            q = put_eol(q, f->eol);
+        }
+        else
+        {
+            *q++ = c;
+        }
+    }
+
+    return (size_t)(q - dst);
+}
+
+/* Normalizes and scans a chunk, NULL at the end, and writes what is final. */
+static void
+fix_chunk(fixer_t* f, scan_t* scan, const char* data, size_t len)
+{
+    size_t carried = (size_t)(scan->offset - f->copied);
+    memmove(f->window, f->window + (f->copied - f->window_base), carried);
+    f->window_base = f->copied;
+
+    size_t n = normalize(f, data, len, f->window + carried);
+    (void)scan_chunk(scan, f->window + carried, n); /* no EOL mismatch left */
+    if (data == NULL)
+    {
+        scan_finish(scan);
+        copy(f, scan->offset);
+    }
+    else
+    {
+        copy(f, (scan->utf8_len != 0U) ? scan->utf8_offset : scan->offset);
+    }
+}
+
+fix_result_t
+fix_file(const char* path, const fix_options_t* options, char* buf,
+         size_t size)
+{
+    /*
+     * A symbolic link stays, its target is rewritten. A file with other hard
+     * links would be split from them by the rename, it is left alone.
+     */
+    struct stat st;
+    reader_t reader;
+    char* real = realpath(path, NULL);
+    if ((real == NULL) || (stat(real, &st) != 0) || !S_ISREG(st.st_mode)
+        || (st.st_nlink > 1U)
+        || !reader_open(&reader, real, buf, size, false))
+    {
+        free(real);
+        return FIX_ERROR;
+    }
+
+    size_t path_len = strlen(real);
+    char* temp = malloc(path_len + sizeof(".cvc-XXXXXX"));
+    char* window = malloc(UTF8_SEQ_MAX + (2U * size) + 2U);
+    int fd = -1;
+    FILE* out = NULL;
+    if ((temp != NULL) && (window != NULL))
+    {
+        memcpy(temp, real, path_len);
+        memcpy(temp + path_len, ".cvc-XXXXXX", sizeof(".cvc-XXXXXX"));
+        fd = mkstemp(temp);
+    }
+    mode_t mode = st.st_mode & 07777U;
+    if ((fd >= 0) && (fchown(fd, st.st_uid, st.st_gid) != 0))
+    {
+        /* not permitted, the file becomes ours like any written anew */
+        mode &= 0777U; /* without setuid, setgid and sticky bits */
+    }
+    if ((fd >= 0) && (fchmod(fd, mode) == 0))
+    {
+        out = fdopen(fd, "wb");
+    }
+    if (out == NULL)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(temp);
+        }
+        reader_close(&reader);
+        free(window);
+        free(temp);
+        free(real);
+        return FIX_ERROR;
+    }
+
+    fixer_t f =
+    {
+        .options = options,
+        .out = out,
+        .window = window,
+        .window_base = 0U,
+        .copied = 0U,
+        .column = 0U,
+        .eol = options->eol,
+        .cr_pending = false,
+        .sequence = false
+    };
+    scan_t scan;
+    scan_init(&scan, options->table, options->eol, NULL, false);
+    if (options->lex != NULL)
+    {
+        scan_set_lexer(&scan, options->lex);
+    }
+    if (options->match != NULL)
+    {
+        scan_set_matcher(&scan, options->match);
+    }
+    scan_set_callback(&scan, fix_violation, &f);
+
+    const char* data;
+    size_t len;
+    while (!f.sequence && reader_next(&reader, &data, &len))
+    {
+        fix_chunk(&f, &scan, data, len);
+    }
+    if (!f.sequence)
+    {
+        fix_chunk(&f, &scan, NULL, 0U);
+    }
+
+    bool ok = !reader.error && !ferror(out);
+    reader_close(&reader);
+    /* on disk before it replaces the original, which a crash must not lose */
+    ok = ok && !f.sequence && (fflush(out) == 0) && (fsync(fileno(out)) == 0);
+    ok = (fclose(out) == 0) && ok;
+    ok = ok && !f.sequence && (rename(temp, real) == 0);
+    if (!ok)
+    {
+        unlink(temp);
+    }
+    free(window);
+    free(temp);
+    free(real);
+
+    if (f.sequence)
+    {
+        return FIX_SEQUENCE;
+    }
+
+    return ok ? FIX_DONE : FIX_ERROR;
+}
@@ -0,0 +1,59 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_FIX_H
+#define CVC_FIX_H
+
+#include "eol.h"
+#include "match.h"
+#include "scan.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FIX_TAB_WIDTH   (8U)
+
+/*
+ * Rewrite of a file. All EOL indicators are replaced by eol, or by the first
+ * one of the file if EOL_AUTO_NA. Invalid tabs are expanded to spaces up to
+ * the next tab stop, other invalid characters are removed or, with escape,
+ * replaced by an escape sequence: \uXXXX or \UXXXXXXXX for a decoded UTF-8
+ * character, an octal escape per byte otherwise. A forbidden sequence has no
+ * replacement, a file with one is not fixed.
+ */
+typedef struct
+{
+    const char_table_t* table;
+    const lex_table_t* lex; /* NULL if comments and literals are not told */
+    const match_t* match;   /* NULL without forbidden sequences */
+    eol_t eol;
+    bool escape;
+} fix_options_t;
+
+typedef enum
+{
+    FIX_DONE,
+    FIX_ERROR,   /* not read or written */
+    FIX_SEQUENCE /* forbidden sequences found, not fixable */
+} fix_result_t;
+
+/*
+ * Rewrites the file at path chunk-wise into a temporary file next to it, which
+ * is synced and then replaces the file by rename(), with its mode and, where
+ * permitted, its owner; setuid, setgid and sticky bits are kept only with the
+ * owner. A symbolic link is followed, the file it points to is rewritten.
+ * buf of size bytes is used for reading. Returns FIX_ERROR if the file could
+ * not be read or written, or is not a regular file or has other hard links;
+ * the file is unchanged then, as with FIX_SEQUENCE.
+ */
+fix_result_t
+fix_file(const char* path, const fix_options_t* options, char* buf,
+         size_t size);
+
+#endif /* CVC_FIX_H */
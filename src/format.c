@@ -0,0 +1,334 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#include "format.h"
+
+#include <string.h>
+
+#define MESSAGE_MAX_LEN (64U)
+
+static const char hex[] = "0123456789ABCDEF";
+
+static void
+put(report_t* out, const char* s)
+{
+    report_write(out, s, strlen(s));
+}
+
+static void
+put_uint(report_t* out, unsigned long value)
+{
+    char* q = report_reserve(out, REPORT_UINT_MAX_LEN);
+    if (q != NULL)
+    {
+        report_commit(out, report_format_uint(q, value));
+    }
+}
+
+/* Writes s as JSON string, bytes above 0x7F are taken as they are. */
+static void
+put_json(report_t* out, const char* s)
+{
+    size_t len = strlen(s);
+    char* q = report_reserve(out, (6U * len) + 2U);
+    if (q == NULL)
+    {
+        return;
+    }
+
+    *q++ = '"';
+    for (size_t i = 0U; i < len; i++)
+    {
+        unsigned char c = (unsigned char)s[i];
+        if ((c == '"') || (c == '\\'))
+        {
+            *q++ = '\\';
+            *q++ = (char)c;
+        }
+        else if (c < 0x20U)
+        {
+            memcpy(q, "\\u00", 4U);
+            q = report_format_hex(q + 4, c);
+        }
+        else
+        {
+            *q++ = (char)c;
+        }
+    }
+    *q++ = '"';
+    report_commit(out, q);
+}
+
+/* Writes a path as JSON string of a URI reference, percent-encoded. */
+static void
+put_uri(report_t* out, const char* path)
+{
+    size_t len = strlen(path);
+    char* q = report_reserve(out, (3U * len) + 9U);
+    if (q == NULL)
+    {
+        return;
+    }
+
+    *q++ = '"';
+    if (path[0] == '/')
+    {
+        memcpy(q, "file://", 7U);
+        q += 7;
+    }
+    for (size_t i = 0U; i < len; i++)
+    {
+        unsigned char c = (unsigned char)path[i];
+        if (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z'))
+            || ((c >= '0') && (c <= '9')) || (strchr("-._~/", (int)c) != NULL))
+        {
+            *q++ = (char)c;
+        }
+        else
+        {
+            *q++ = '%';
+            q = report_format_hex(q, c);
+        }
+    }
+    *q++ = '"';
+    report_commit(out, q);
+}
+
+static char*
+format_code_point(char* q, uint32_t cp)
+{
+    memcpy(q, "U+", 2U);
+    q += 2;
+    for (int shift = (cp > 0xFFFFU) ? ((cp > 0xFFFFFU) ? 20 : 16) : 12;
+         shift >= 0; shift -= 4)
+    {
+        *q++ = hex[(cp >> shift) & 0x0FU];
+    }
+
+    return q;
+}
+
+/* Writes the description of a violation, at most MESSAGE_MAX_LEN bytes. */
+static void
+put_message(report_t* out, const scan_violation_t* v)
+{
+    char* q = report_reserve(out, MESSAGE_MAX_LEN);
+    if (q == NULL)
+    {
+        return;
+    }
+
+    if (v->kind == SCAN_VIOLATION_EOL)
+    {
+        static const char eol[] = "unexpected end-of-line indicator";
+        memcpy(q, eol, sizeof(eol) - 1U);
+        q += sizeof(eol) - 1U;
+    }
+    else if (v->kind == SCAN_VIOLATION_SEQUENCE)
+    {
+        static const char sequence[] = "forbidden sequence 0x";
+        unsigned int n = (v->length > 16U) ? 16U : v->length;
+        memcpy(q, sequence, sizeof(sequence) - 1U);
+        q += sizeof(sequence) - 1U;
+        for (unsigned int i = 0U; i < n; i++)
+        {
+            q = report_format_hex(q, (unsigned char)v->sequence[i]);
+        }
+        if (n < v->length)
+        {
+            memcpy(q, "...", 3U);
+            q += 3;
+        }
+    }
+    else if (v->code_point == UTF8_MALFORMED)
+    {
+        static const char malformed[] = "ill-formed UTF-8 sequence 0x";
+        memcpy(q, malformed, sizeof(malformed) - 1U);
+        q = report_format_hex(q + (sizeof(malformed) - 1U), v->c);
+    }
+    else
+    {
+        static const char invalid[] = "invalid character ";
+        memcpy(q, invalid, sizeof(invalid) - 1U);
+        q += sizeof(invalid) - 1U;
+        if (v->length > 1U)
+        {
+            q = format_code_point(q, v->code_point);
+        }
+        else
+        {
+            *q++ = '0';
+            *q++ = 'x';
+            q = report_format_hex(q, v->c);
+        }
+    }
+    report_commit(out, q);
+}
+
+bool
+format_from_name(const char* name, format_t* format)
+{
+    static const struct
+    {
+        const char* name;
+        format_t format;
+    } formats[] =
+    {
+        {"text", FORMAT_TEXT},
+        {"compact", FORMAT_COMPACT},
+        {"jsonl", FORMAT_JSONL},
+        {"sarif", FORMAT_SARIF}
+    };
+
+    for (size_t i = 0U; i < (sizeof(formats) / sizeof(formats[0])); i++)
+    {
+        if (strcmp(name, formats[i].name) == 0)
+        {
+            *format = formats[i].format;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void
+format_begin(report_t* out, format_t format, const char* version)
+{
+    if (format != FORMAT_SARIF)
+    {
+        return;
+    }
+
+    put(out, "{\"version\":\"2.1.0\","
+             "\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\","
+             "\"runs\":[{\"tool\":{\"driver\":{\"name\":\"cvc\",\"version\":");
+    put_json(out, version);
+    put(out, ",\"informationUri\":\"https://github.com/piscilus/cvc\","
+             "\"rules\":["
+             "{\"id\":\"CVC001\",\"name\":\"InvalidCharacter\","
+             "\"shortDescription\":{\"text\":"
+             "\"Character outside of the permitted character set\"}},"
+             "{\"id\":\"CVC002\",\"name\":\"EolMismatch\","
+             "\"shortDescription\":{\"text\":"
+             "\"Inconsistent end-of-line indicator\"}},"
+             "{\"id\":\"CVC003\",\"name\":\"ForbiddenSequence\","
+             "\"shortDescription\":{\"text\":"
+             "\"Forbidden sequence of bytes\"}}]}},"
+             "\"columnKind\":\"unicodeCodePoints\",\"results\":[\n");
+}
+
+void
+format_violation(report_t* out, format_t format, const char* name,
+                 const scan_violation_t* v, bool first)
+{
+    bool eol = (v->kind == SCAN_VIOLATION_EOL);
+    bool sequence = (v->kind == SCAN_VIOLATION_SEQUENCE);
+
+    switch (format)
+    {
+        case FORMAT_COMPACT:
+            put(out, name);
+            report_putc(out, ':');
+            put_uint(out, v->line);
+            report_putc(out, ':');
+            put_uint(out, v->char_column);
+            put(out, ": error: ");
+            put_message(out, v);
+            report_putc(out, '\n');
+            break;
+        case FORMAT_JSONL:
+            put(out, "{\"type\":\"violation\",\"file\":");
+            put_json(out, name);
+            put(out, eol ? ",\"kind\":\"eol\",\"line\":"
+                         : (sequence ? ",\"kind\":\"sequence\",\"line\":"
+                                     : ",\"kind\":\"char\",\"line\":"));
+            put_uint(out, v->line);
+            put(out, ",\"column\":");
+            put_uint(out, v->column);
+            put(out, ",\"char_column\":");
+            put_uint(out, v->char_column);
+            put(out, ",\"offset\":");
+            put_uint(out, (unsigned long)v->offset);
+            put(out, ",\"length\":");
+            put_uint(out, v->length);
+            if (!eol)
+            {
+                put(out, ",\"byte\":");
+                put_uint(out, v->c);
+                put(out, ",\"code_point\":");
+                put_uint(out, v->code_point);
+            }
+            put(out, "}\n");
+            break;
+        case FORMAT_SARIF:
+            put(out, first ? "{\"ruleId\":" : ",\n{\"ruleId\":");
+            put(out, eol ? "\"CVC002\",\"ruleIndex\":1"
+                         : (sequence ? "\"CVC003\",\"ruleIndex\":2"
+                                     : "\"CVC001\",\"ruleIndex\":0"));
+            put(out, ",\"level\":\"error\",\"message\":{\"text\":\"");
+            put_message(out, v);
+            put(out, "\"},\"locations\":[{\"physicalLocation\":"
+                     "{\"artifactLocation\":{\"uri\":");
+            put_uri(out, name);
+            put(out, "},\"region\":{\"startLine\":");
+            put_uint(out, v->line);
+            put(out, ",\"startColumn\":");
+            put_uint(out, v->char_column);
+            put(out, ",\"byteOffset\":");
+            put_uint(out, (unsigned long)v->offset);
+            put(out, ",\"byteLength\":");
+            put_uint(out, v->length);
+            put(out, "}}}]}");
+            break;
+        default:
+            break;
+    }
+}
+
+void
+format_file(report_t* out, format_t format, const char* name, int result,
+            unsigned long errors)
+{
+    if (format != FORMAT_JSONL)
+    {
+        return;
+    }
+
+    put(out, "{\"type\":\"file\",\"file\":");
+    put_json(out, name);
+    put(out, ",\"result\":");
+    put_uint(out, (unsigned long)result);
+    put(out, ",\"errors\":");
+    put_uint(out, errors);
+    put(out, "}\n");
+}
+
+void
+format_end(report_t* out, format_t format, unsigned long files,
+           unsigned long errors, int result)
+{
+    switch (format)
+    {
+        case FORMAT_JSONL:
+            put(out, "{\"type\":\"total\",\"files\":");
+            put_uint(out, files);
+            put(out, ",\"errors\":");
+            put_uint(out, errors);
+            put(out, ",\"result\":");
+            put_uint(out, (unsigned long)result);
+            put(out, "}\n");
+            break;
+        case FORMAT_SARIF:
+            put(out, "\n]}]}\n");
+            break;
+        default:
+            break;
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_FORMAT_H
+#define CVC_FORMAT_H
+
+#include "report.h"
+#include "scan.h"
+
+#include <stdbool.h>
+
+/*
+ * Machine-readable output. Records are written straight into the report of
+ * a file, nothing is kept in between.
+ */
+typedef enum
+{
+    FORMAT_TEXT,    /* counts and verbose lines of cvc */
+    FORMAT_COMPACT, /* one "FILE:LINE:COLUMN: error: ..." line per violation */
+    FORMAT_JSONL,   /* one JSON object per violation, file and the total */
+    FORMAT_SARIF    /* SARIF 2.1.0 log, one result per violation */
+} format_t;
+
+/* Returns false for unknown names. */
+bool
+format_from_name(const char* name, format_t* format);
+
+/* Writes what precedes all files, the header of the SARIF log. */
+void
+format_begin(report_t* out, format_t format, const char* version);
+
+/*
+ * Writes a violation found in the input name. SARIF results are separated by
+ * commas, first tells whether another one precedes it within the log.
+ */
+void
+format_violation(report_t* out, format_t format, const char* name,
+                 const scan_violation_t* v, bool first);
+
+/* Writes the summary of a file, its exit code and number of errors. */
+void
+format_file(report_t* out, format_t format, const char* name, int result,
+            unsigned long errors);
+
+/* Writes what follows all files, the total or the end of the SARIF log. */
+void
+format_end(report_t* out, format_t format, unsigned long files,
+           unsigned long errors, int result);
+
+#endif /* CVC_FORMAT_H */
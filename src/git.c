@@ -0,0 +1,442 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "git.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define GIT_ID_MAX      (64U) /* hex digits of a SHA-256 object id */
+#define GIT_HEADER_MAX  (GIT_ID_MAX + 32U)
+#define GIT_OUTPUT_MIN  (4096U)
+
+void
+git_changes_init(git_changes_t* changes)
+{
+    file_list_init(&changes->paths);
+    file_list_init(&changes->objects);
+}
+
+void
+git_changes_free(git_changes_t* changes)
+{
+    file_list_free(&changes->paths);
+    file_list_free(&changes->objects);
+}
+
+static void
+close_pipe(int fds[2])
+{
+    for (unsigned int i = 0U; i < 2U; i++)
+    {
+        if (fds[i] >= 0)
+        {
+            (void)close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+}
+
+/*
+ * Runs git with argv. If given, in and out receive the ends of pipes to its
+ * standard input and output, which are inherited otherwise. Returns the
+ * process id or -1.
+ */
+static pid_t
+spawn(char* const argv[], int* in, int* out)
+{
+    int to_git[2] = {-1, -1};
+    int from_git[2] = {-1, -1};
+
+    if (((in != NULL) && (pipe(to_git) != 0))
+        || ((out != NULL) && (pipe(from_git) != 0)))
+    {
+        close_pipe(to_git);
+        close_pipe(from_git);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        if (((in != NULL) && (dup2(to_git[0], STDIN_FILENO) < 0))
+            || ((out != NULL) && (dup2(from_git[1], STDOUT_FILENO) < 0)))
+        {
+            _exit(127);
+        }
+        close_pipe(to_git);
+        close_pipe(from_git);
+        execvp("git", argv);
+        _exit(127);
+    }
+    if (pid < 0)
+    {
+        close_pipe(to_git);
+        close_pipe(from_git);
+        return -1;
+    }
+
+    /* keep the ends of this process out of further children */
+    if (in != NULL)
+    {
+        (void)close(to_git[0]);
+        (void)fcntl(to_git[1], F_SETFD, FD_CLOEXEC);
+        *in = to_git[1];
+    }
+    if (out != NULL)
+    {
+        (void)close(from_git[1]);
+        (void)fcntl(from_git[0], F_SETFD, FD_CLOEXEC);
+        *out = from_git[0];
+    }
+
+    return pid;
+}
+
+static bool
+wait_success(pid_t pid)
+{
+    int status;
+    pid_t r;
+
+    do
+    {
+        r = waitpid(pid, &status, 0);
+    } while ((r < 0) && (errno == EINTR));
+
+    return (r == pid) && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+/* Runs git and returns its complete output, NUL-terminated, or NULL. */
+static char*
+run(char* const argv[], size_t* len)
+{
+    int out;
+    pid_t pid = spawn(argv, NULL, &out);
+    if (pid < 0)
+    {
+        return NULL;
+    }
+
+    size_t capacity = GIT_OUTPUT_MIN;
+    char* data = malloc(capacity);
+    bool ok = (data != NULL);
+    *len = 0U;
+    while (ok)
+    {
+        if ((capacity - *len) < 2U)
+        {
+            char* grown = realloc(data, capacity * 2U);
+            if (grown == NULL)
+            {
+                ok = false;
+                break;
+            }
+            data = grown;
+            capacity *= 2U;
+        }
+        ssize_t n = read(out, data + *len, capacity - *len - 1U);
+        if (n > 0)
+        {
+            *len += (size_t)n;
+        }
+        else if ((n == 0) || (errno != EINTR))
+        {
+            ok = (n == 0);
+            break;
+        }
+    }
+    (void)close(out);
+    ok = wait_success(pid) && ok;
+    if (!ok)
+    {
+        free(data);
+        return NULL;
+    }
+    data[*len] = '\0';
+
+    return data;
+}
+
+/*
+ * Parses the raw output of git diff-tree/diff-index -z, where each file is
+ * ":MODE MODE ID ID STATUS" followed by its path, both NUL-terminated.
+ */
+static bool
+parse_raw(git_changes_t* changes, const char* data, size_t len,
+          const char* exts)
+{
+    const char* p = data;
+    const char* end = data + len;
+
+    while (p < end)
+    {
+        const char* info = p;
+        const char* path = info + strlen(info) + 1U;
+        if ((info[0] != ':') || (path >= end))
+        {
+            return false;
+        }
+        p = path + strlen(path) + 1U;
+
+        char mode[8];
+        char id[GIT_ID_MAX + 1U];
+        if (sscanf(info, ":%*7s %7s %*64s %64s", mode, id) != 2)
+        {
+            return false;
+        }
+        /* regular files only, no deletions, symbolic links or submodules */
+        if (((strcmp(mode, "100644") != 0) && (strcmp(mode, "100755") != 0))
+            || !has_extension(path, exts))
+        {
+            continue;
+        }
+        if (!file_list_add(&changes->paths, path)
+            || !file_list_add(&changes->objects, id))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Returns HEAD or, without any commit yet, the id of the empty tree. */
+static char*
+head_or_empty_tree(void)
+{
+    char* verify[] = {"git", "rev-parse", "--verify", "--quiet", "HEAD", NULL};
+    char* empty[] = {"git", "hash-object", "-t", "tree", "/dev/null", NULL};
+    size_t len;
+
+    char* id = run(verify, &len);
+    if (id == NULL)
+    {
+        id = run(empty, &len);
+    }
+    if ((id != NULL) && (len > 0U) && (id[len - 1U] == '\n'))
+    {
+        id[len - 1U] = '\0';
+    }
+
+    return id;
+}
+
+bool
+git_changes_read(git_changes_t* changes, const char* rev, const char* exts)
+{
+    char* base = NULL;
+    char* argv[8];
+    size_t argc = 0U;
+
+    if (rev == NULL)
+    {
+        base = head_or_empty_tree();
+        if (base == NULL)
+        {
+            return false;
+        }
+        argv[argc++] = "git";
+        argv[argc++] = "diff-index";
+        argv[argc++] = "--cached";
+        argv[argc++] = "-r";
+        argv[argc++] = "-z";
+        argv[argc++] = base;
+    }
+    else
+    {
+        argv[argc++] = "git";
+        argv[argc++] = "diff-tree";
+        argv[argc++] = "-r";
+        argv[argc++] = "-z";
+        argv[argc++] = (char*)rev;
+        if (strstr(rev, "..") == NULL)
+        {
+            argv[argc++] = "HEAD";
+        }
+    }
+    argv[argc] = NULL;
+
+    size_t len;
+    char* data = run(argv, &len);
+    bool ok = (data != NULL) && parse_raw(changes, data, len, exts);
+    free(data);
+    free(base);
+
+    return ok;
+}
+
+static void*
+write_ids(void* arg)
+{
+    git_batch_t* b = arg;
+    sigset_t pipe_signal;
+
+    /* a failed git shows as EPIPE here, instead of killing the process */
+    sigemptyset(&pipe_signal);
+    sigaddset(&pipe_signal, SIGPIPE);
+    (void)pthread_sigmask(SIG_BLOCK, &pipe_signal, NULL);
+
+    for (size_t i = 0U; i < b->count; i++)
+    {
+        char line[GIT_ID_MAX + 2U];
+        size_t len = strlen(b->ids[i]);
+        if (len > GIT_ID_MAX)
+        {
+            len = GIT_ID_MAX; /* git answers "missing" */
+        }
+        memcpy(line, b->ids[i], len);
+        line[len++] = '\n';
+
+        for (size_t done = 0U; done < len;)
+        {
+            ssize_t n = write(b->in, line + done, len - done);
+            if (n > 0)
+            {
+                done += (size_t)n;
+            }
+            else if (errno != EINTR)
+            {
+                i = b->count;
+                break;
+            }
+        }
+    }
+    (void)close(b->in);
+    b->in = -1;
+
+    return NULL;
+}
+
+bool
+git_batch_start(git_batch_t* b, char* const* ids, size_t count, char* buf,
+                size_t buf_size)
+{
+    char* argv[] = {"git", "cat-file", "--batch", NULL};
+    int out;
+
+    b->ids = ids;
+    b->count = count;
+    b->next = 0U;
+    b->writing = false;
+    b->contents = false;
+    b->pid = spawn(argv, &b->in, &out);
+    if (b->pid < 0)
+    {
+        return false;
+    }
+    reader_attach(&b->out, out, buf, buf_size);
+    reader_limit(&b->out, 0U);
+    b->writing = (pthread_create(&b->writer, NULL, write_ids, b) == 0);
+    if (!b->writing)
+    {
+        (void)close(b->in);
+        b->in = -1;
+        reader_close(&b->out);
+        (void)wait_success(b->pid);
+    }
+
+    return b->writing;
+}
+
+/* Skips the rest of the current object and the LF following its contents. */
+static bool
+skip_contents(git_batch_t* b)
+{
+    const char* data;
+    size_t len;
+    char lf[1];
+
+    if (!b->contents)
+    {
+        return !b->out.error;
+    }
+    while (reader_next(&b->out, &data, &len))
+    {
+    }
+    reader_limit(&b->out, SIZE_MAX);
+    b->contents = false;
+
+    return !b->out.error && reader_line(&b->out, lf, sizeof(lf));
+}
+
+bool
+git_batch_next(git_batch_t* b, size_t* size)
+{
+    char header[GIT_HEADER_MAX];
+    char type[16];
+    unsigned long long n;
+
+    if (!skip_contents(b) || (b->next == b->count))
+    {
+        return false;
+    }
+    b->next++;
+    reader_limit(&b->out, SIZE_MAX);
+    if (!reader_line(&b->out, header, sizeof(header)))
+    {
+        b->out.error = true;
+        return false;
+    }
+
+    /* "ID TYPE SIZE" followed by the contents, or "ID missing" */
+    int fields = sscanf(header, "%*s %15s %llu", type, &n);
+    if ((fields != 2) || (n >= (unsigned long long)SIZE_MAX))
+    {
+        reader_limit(&b->out, 0U);
+        return false;
+    }
+    reader_limit(&b->out, (size_t)n);
+    b->contents = true;
+    if (strcmp(type, "blob") != 0)
+    {
+        return false; /* skipped by the next call */
+    }
+    *size = (size_t)n;
+
+    return true;
+}
+
+bool
+git_batch_finish(git_batch_t* b)
+{
+    /*
+     * Once all objects are read, git exits at the end of its input. Its
+     * output is read to the end, otherwise git could fail with EPIPE.
+     */
+    bool complete = (b->next == b->count) && skip_contents(b);
+    if (complete)
+    {
+        const char* data;
+        size_t len;
+        reader_limit(&b->out, SIZE_MAX);
+        while (reader_next(&b->out, &data, &len))
+        {
+        }
+        complete = !b->out.error;
+    }
+
+    reader_close(&b->out);
+    if (b->writing)
+    {
+        (void)pthread_join(b->writer, NULL);
+        b->writing = false;
+    }
+    bool success = wait_success(b->pid);
+
+    return (b->next < b->count) || (complete && success);
+}
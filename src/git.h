@@ -0,0 +1,80 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_GIT_H
+#define CVC_GIT_H
+
+#include "files.h"
+#include "reader.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Changed files, paths relative to the top directory of the repository. */
+typedef struct
+{
+    file_list_t paths;
+    file_list_t objects; /* ids of the new contents, in the same order */
+} git_changes_t;
+
+void
+git_changes_init(git_changes_t* changes);
+
+void
+git_changes_free(git_changes_t* changes);
+
+/*
+ * Collects the regular files added or modified from rev to HEAD, within rev
+ * if it is a range A..B, or in the index compared to HEAD if rev is NULL.
+ * Deleted files, symbolic links and submodules are left out, exts filters
+ * names as for file_list_walk(). Returns false if git failed.
+ */
+bool
+git_changes_read(git_changes_t* changes, const char* rev, const char* exts);
+
+/*
+ * Contents of objects read by git cat-file --batch over one pipe. The ids
+ * are written by a thread of their own, so neither side blocks the other.
+ */
+typedef struct
+{
+    pid_t pid;
+    int in;
+    reader_t out;
+    pthread_t writer;
+    bool writing;
+    bool contents; /* of an object follow, up to the LF behind them */
+    char* const* ids;
+    size_t count;
+    size_t next;   /* objects started */
+} git_batch_t;
+
+/* Starts reading the objects ids in this order, buf is used for reading. */
+bool
+git_batch_start(git_batch_t* b, char* const* ids, size_t count, char* buf,
+                size_t buf_size);
+
+/*
+ * Moves on to the contents of the next object, which are then provided by
+ * reader_next() on b->out and need not be read completely. Returns false
+ * if the object is missing or git failed.
+ */
+bool
+git_batch_next(git_batch_t* b, size_t* size);
+
+/*
+ * Stops git, returns false if it did not exit successfully. Reading may end
+ * before all objects, git is considered successful then.
+ */
+bool
+git_batch_finish(git_batch_t* b);
+
+#endif /* CVC_GIT_H */
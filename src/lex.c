@@ -0,0 +1,96 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#include "lex.h"
+
+#include <string.h>
+
+const uint8_t lex_context[LEX_STATES] =
+{
+    [LEX_CODE] = LEX_CONTEXT_CODE,
+    [LEX_SLASH] = LEX_CONTEXT_CODE,
+    [LEX_LINE_COMMENT] = LEX_CONTEXT_COMMENT,
+    [LEX_LINE_COMMENT_ESCAPE] = LEX_CONTEXT_COMMENT,
+    [LEX_BLOCK_COMMENT] = LEX_CONTEXT_COMMENT,
+    [LEX_BLOCK_COMMENT_STAR] = LEX_CONTEXT_COMMENT,
+    [LEX_STRING] = LEX_CONTEXT_LITERAL,
+    [LEX_STRING_ESCAPE] = LEX_CONTEXT_LITERAL,
+    [LEX_CHAR] = LEX_CONTEXT_LITERAL,
+    [LEX_CHAR_ESCAPE] = LEX_CONTEXT_LITERAL,
+    [LEX_RAW_DELIMITER] = LEX_CONTEXT_LITERAL,
+    [LEX_RAW] = LEX_CONTEXT_LITERAL,
+    [LEX_RAW_CLOSE] = LEX_CONTEXT_LITERAL
+};
+
+/* Bytes that may change the state, NULL if all but CR and LF may. */
+static const char* const lex_special[LEX_STATES] =
+{
+    [LEX_CODE] = "/\"'",
+    [LEX_SLASH] = NULL,
+    [LEX_LINE_COMMENT] = "\\",
+    [LEX_LINE_COMMENT_ESCAPE] = NULL,
+    [LEX_BLOCK_COMMENT] = "*",
+    [LEX_BLOCK_COMMENT_STAR] = NULL,
+    [LEX_STRING] = "\"\\",
+    [LEX_STRING_ESCAPE] = NULL,
+    [LEX_CHAR] = "'\\",
+    [LEX_CHAR_ESCAPE] = NULL,
+    [LEX_RAW_DELIMITER] = NULL,
+    [LEX_RAW] = ")",
+    [LEX_RAW_CLOSE] = NULL
+};
+
+/* States in which an EOL does not change the state. */
+static bool
+lex_fast(lex_state_t state)
+{
+    return (state == LEX_CODE) || (state == LEX_BLOCK_COMMENT)
+           || (state == LEX_RAW);
+}
+
+void
+lex_table_build(lex_table_t* t, const bool* code_chars,
+                const bool* extended_chars, bool utf8,
+                const utf8_range_t* ranges, unsigned int count,
+                simd_backend_t backend)
+{
+    char_table_build(&t->contexts[LEX_CONTEXT_CODE], code_chars, backend);
+    char_table_build(&t->contexts[LEX_CONTEXT_COMMENT], extended_chars,
+                     backend);
+    if (utf8)
+    {
+        char_table_set_utf8(&t->contexts[LEX_CONTEXT_CODE], ranges, 0U);
+        char_table_set_utf8(&t->contexts[LEX_CONTEXT_COMMENT], ranges, count);
+    }
+    t->contexts[LEX_CONTEXT_LITERAL] = t->contexts[LEX_CONTEXT_COMMENT];
+
+    for (unsigned int state = 0U; state < LEX_STATES; state++)
+    {
+        const uint8_t* cls = t->contexts[lex_context[state]].cls;
+        const char* special = lex_special[state];
+        bool valid[CHAR_TABLE_SIZE];
+
+        for (unsigned int c = 0U; c < CHAR_TABLE_SIZE; c++)
+        {
+            t->cls[state][c] = cls[c];
+            if ((special == NULL) ? ((c != '\r') && (c != '\n'))
+                                  : ((c != 0U) && (strchr(special, (int)c) != NULL)))
+            {
+                t->cls[state][c] = CHAR_CLASS_LEX;
+            }
+            valid[c] = (t->cls[state][c] == CHAR_CLASS_VALID);
+        }
+
+        simd_set_build(&t->simd[state], valid, backend);
+        if (!lex_fast((lex_state_t)state))
+        {
+            t->simd[state].skip = NULL;
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_LEX_H
+#define CVC_LEX_H
+
+#include "scan.h"
+
+#include <stdbool.h>
+
+/*
+ * States of the lexer that tells code from comments and literals. Those with
+ * a suffix wait for the next byte: after a / in code, after a * in a block
+ * comment, after a backslash, and while a raw string delimiter is read.
+ */
+typedef enum
+{
+    LEX_CODE,
+    LEX_SLASH,
+    LEX_LINE_COMMENT,
+    LEX_LINE_COMMENT_ESCAPE,
+    LEX_BLOCK_COMMENT,
+    LEX_BLOCK_COMMENT_STAR,
+    LEX_STRING,
+    LEX_STRING_ESCAPE,
+    LEX_CHAR,
+    LEX_CHAR_ESCAPE,
+    LEX_RAW_DELIMITER,
+    LEX_RAW,
+    LEX_RAW_CLOSE,
+    LEX_STATES
+} lex_state_t;
+
+typedef enum
+{
+    LEX_CONTEXT_CODE,
+    LEX_CONTEXT_COMMENT,
+    LEX_CONTEXT_LITERAL,
+    LEX_CONTEXTS
+} lex_context_t;
+
+/*
+ * Character tables per lexical context, and the classes per state, in which
+ * bytes that may change the state are CHAR_CLASS_LEX. The fast path is only
+ * taken in states that do not end at an EOL, with those bytes suspicious.
+ */
+struct lex_table
+{
+    char_table_t contexts[LEX_CONTEXTS];
+    uint8_t cls[LEX_STATES][CHAR_TABLE_SIZE];
+    simd_set_t simd[LEX_STATES];
+};
+
+extern const uint8_t lex_context[LEX_STATES];
+
+/*
+ * Builds the tables from the valid characters in code and, for comments and
+ * literals, the extended ones. In UTF-8 mode, characters above U+007F are
+ * only permitted in comments and literals, if within one of the ranges.
+ */
+void
+lex_table_build(lex_table_t* t, const bool* code_chars,
+                const bool* extended_chars, bool utf8,
+                const utf8_range_t* ranges, unsigned int count,
+                simd_backend_t backend);
+
+#endif /* CVC_LEX_H */
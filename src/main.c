@@ -7,19 +7,44 @@
  * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include "archive.h"
+#include "cache.h"
 #include "cargs.h"
+#include "cvc.h"
+#include "files.h"
+#include "fix.h"
+#include "format.h"
+#include "git.h"
+#include "lex.h"
+#include "policy.h"
+#include "pool.h"
+#include "prefetch.h"
+#include "reader.h"
+#include "report.h"
+#include "scan.h"
+#include "segment.h"
+#include "serve.h"
+#include "stats.h"
+#include "utf8.h"
+#include "watch.h"
 
 #include <locale.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define PROGRAM_NAME    "cvc"
 #define VERSION         "0.1.0-alpha"
 
-#define CHUNK_SIZE      (16U * 1024U)
-#define MAX_VALID_CHAR  (126 + 1)
+/* a file too small to be mapped is read with a single read() */
+#define CHUNK_SIZE      READER_MMAP_THRESHOLD
 
 #define CHAR_CODE_HT        (9)
 #define CHAR_CODE_LF        (10)
@@ -30,14 +55,6 @@
 #define CHAR_CODE_AT        (64)
 #define CHAR_CODE_BACKTICK  (96)
 
-typedef enum
-{
-    EOL_AUTO_NA, /* Not available, placeholder. */
-    EOL_CR,  /* CR = Carriage Return = \r, "Mac" */
-    EOL_LF,  /* LF = Line Feed = \n, "Unix/Linux" */
-    EOL_CRLF /* Sequence of CR and LF, "Windows" */
-} eol_t;
-
 enum
 {
     RETURN_VALID = 0,
@@ -51,12 +68,40 @@ enum
 enum
 {
     ARG_ID_FILE,
+    ARG_ID_FILES_FROM,
+    ARG_ID_NULL,
+    ARG_ID_EXT,
+    ARG_ID_ARCHIVES,
+    ARG_ID_GIT_DIFF,
+    ARG_ID_STAGED,
+    ARG_ID_WATCH,
+    ARG_ID_JOBS,
+    ARG_ID_BACKEND,
+    ARG_ID_NO_MMAP,
+    ARG_ID_CACHE,
     ARG_ID_EOL,
     ARG_ID_FF,
     ARG_ID_VT,
     ARG_ID_APA,
     ARG_ID_NOHT,
+    ARG_ID_UTF8,
+    ARG_ID_UNICODE,
+    ARG_ID_CONTEXT,
+    ARG_ID_FORBID,
+    ARG_ID_TRIGRAPHS,
+    ARG_ID_NO_CVCRC,
     ARG_ID_VERBOSE,
+    ARG_ID_FIRST,
+    ARG_ID_QUIET,
+    ARG_ID_FAIL_FAST,
+    ARG_ID_FORMAT,
+    ARG_ID_FIX,
+    ARG_ID_FIX_ESCAPE,
+#if defined(CVC_STATS)
+    ARG_ID_STATS,
+#endif
+    ARG_ID_SERVE,
+    ARG_ID_SOCKET,
     ARG_ID_VERSION,
     ARG_ID_HELP
 };
@@ -68,7 +113,84 @@ const struct cag_option options[] =
         .access_letters = "f",
         .access_name = "file",
         .value_name = "FILE",
-        .description = "Specify a file (default: n/a)"
+        .description = "Specify a file, may be repeated (default: n/a)"
+    },
+    {
+        .identifier = ARG_ID_FILES_FROM,
+        .access_letters = NULL,
+        .access_name = "files-from",
+        .value_name = "LIST",
+        .description = "Read file names from LIST, - for standard input"
+    },
+    {
+        .identifier = ARG_ID_NULL,
+        .access_letters = "0",
+        .access_name = "null",
+        .value_name = NULL,
+        .description = "File names in LIST are terminated by NUL, not newline"
+    },
+    {
+        .identifier = ARG_ID_EXT,
+        .access_letters = NULL,
+        .access_name = "ext",
+        .value_name = "EXTS",
+        .description = "Only files with these extensions in directories, e.g. c,h"
+    },
+    {
+        .identifier = ARG_ID_ARCHIVES,
+        .access_letters = NULL,
+        .access_name = "archives",
+        .value_name = NULL,
+        .description = "Validate the members of tar, zip, gzip and zstd archives"
+    },
+    {
+        .identifier = ARG_ID_GIT_DIFF,
+        .access_letters = NULL,
+        .access_name = "git-diff",
+        .value_name = "REV",
+        .description = "Validate files changed from REV to HEAD or in A..B"
+    },
+    {
+        .identifier = ARG_ID_STAGED,
+        .access_letters = NULL,
+        .access_name = "staged",
+        .value_name = NULL,
+        .description = "Validate files changed in the git index"
+    },
+    {
+        .identifier = ARG_ID_WATCH,
+        .access_letters = NULL,
+        .access_name = "watch",
+        .value_name = "DIR",
+        .description = "Validate DIR, then files in it again as they change"
+    },
+    {
+        .identifier = ARG_ID_JOBS,
+        .access_letters = "j",
+        .access_name = "jobs",
+        .value_name = "N",
+        .description = "Validate files on N threads, 0 = one per CPU (default: 1)"
+    },
+    {
+        .identifier = ARG_ID_BACKEND,
+        .access_letters = NULL,
+        .access_name = "backend",
+        .value_name = "NAME",
+        .description = "Scanner: scalar/sse2/avx2/neon (default: best available)"
+    },
+    {
+        .identifier = ARG_ID_NO_MMAP,
+        .access_letters = NULL,
+        .access_name = "no-mmap",
+        .value_name = NULL,
+        .description = "Read files instead of mapping them into memory"
+    },
+    {
+        .identifier = ARG_ID_CACHE,
+        .access_letters = NULL,
+        .access_name = "cache",
+        .value_name = "DIR",
+        .description = "Skip files unchanged since the last run (default: off)"
     },
     {
         .identifier = ARG_ID_EOL,
@@ -105,6 +227,48 @@ const struct cag_option options[] =
         .value_name = NULL,
         .description = "Permit all printable ASCII characters"
     },
+    {
+        .identifier = ARG_ID_UTF8,
+        .access_letters = "u",
+        .access_name = "utf8",
+        .value_name = NULL,
+        .description = "Decode UTF-8, permit characters in RANGES (default: A0-10FFFF)"
+    },
+    {
+        .identifier = ARG_ID_UNICODE,
+        .access_letters = NULL,
+        .access_name = "unicode",
+        .value_name = "RANGES",
+        .description = "Code points permitted with --utf8 in hex, e.g. A0-FF,20AC"
+    },
+    {
+        .identifier = ARG_ID_CONTEXT,
+        .access_letters = NULL,
+        .access_name = "context",
+        .value_name = NULL,
+        .description = "Permit all printable ASCII and RANGES only in comments and literals"
+    },
+    {
+        .identifier = ARG_ID_FORBID,
+        .access_letters = NULL,
+        .access_name = "forbid",
+        .value_name = "SEQ",
+        .description = "Forbid a byte sequence, \\xHH for a byte, may be repeated"
+    },
+    {
+        .identifier = ARG_ID_TRIGRAPHS,
+        .access_letters = NULL,
+        .access_name = "trigraphs",
+        .value_name = NULL,
+        .description = "Forbid the nine trigraph sequences of C"
+    },
+    {
+        .identifier = ARG_ID_NO_CVCRC,
+        .access_letters = NULL,
+        .access_name = "no-cvcrc",
+        .value_name = NULL,
+        .description = "Ignore the "POLICY_FILE_NAME" policy files of directories"
+    },
     {
         .identifier = ARG_ID_VERBOSE,
         .access_letters = "v",
@@ -112,6 +276,71 @@ const struct cag_option options[] =
         .value_name = NULL,
         .description = "Enable verbose output"
     },
+    {
+        .identifier = ARG_ID_FIRST,
+        .access_letters = NULL,
+        .access_name = "first",
+        .value_name = NULL,
+        .description = "Stop validating a file at the first invalid character"
+    },
+    {
+        .identifier = ARG_ID_QUIET,
+        .access_letters = "q",
+        .access_name = "quiet",
+        .value_name = NULL,
+        .description = "No output, exit code only (implies --first)"
+    },
+    {
+        .identifier = ARG_ID_FAIL_FAST,
+        .access_letters = NULL,
+        .access_name = "fail-fast",
+        .value_name = NULL,
+        .description = "Stop at the first file that fails validation"
+    },
+    {
+        .identifier = ARG_ID_FORMAT,
+        .access_letters = NULL,
+        .access_name = "format",
+        .value_name = "NAME",
+        .description = "Output format: text (default), compact, jsonl or sarif"
+    },
+    {
+        .identifier = ARG_ID_FIX,
+        .access_letters = NULL,
+        .access_name = "fix",
+        .value_name = NULL,
+        .description = "Rewrite invalid files: fix EOL, expand tabs, remove invalid characters"
+    },
+    {
+        .identifier = ARG_ID_FIX_ESCAPE,
+        .access_letters = NULL,
+        .access_name = "fix-escape",
+        .value_name = NULL,
+        .description = "Escape invalid characters instead of removing them (implies --fix)"
+    },
+#if defined(CVC_STATS)
+    {
+        .identifier = ARG_ID_STATS,
+        .access_letters = NULL,
+        .access_name = "stats",
+        .value_name = "text/json",
+        .description = "Write counters and timings of the run to standard error"
+    },
+#endif
+    {
+        .identifier = ARG_ID_SERVE,
+        .access_letters = NULL,
+        .access_name = "serve",
+        .value_name = NULL,
+        .description = "Serve validation requests on standard input/output, implies --no-cvcrc"
+    },
+    {
+        .identifier = ARG_ID_SOCKET,
+        .access_letters = NULL,
+        .access_name = "socket",
+        .value_name = "PATH",
+        .description = "Serve validation requests on a Unix socket at PATH, implies --no-cvcrc"
+    },
     {
         .identifier = ARG_ID_HELP,
         .access_letters = "h",
@@ -128,168 +357,1115 @@ const struct cag_option options[] =
     }
 };
 
-static eol_t
-determine_eol(const char* p)
+static void
+show_usage(void)
+{
+    printf("Usage: "PROGRAM_NAME" [OPTION]... [FILE|DIR]...\n\n");
+    cag_option_print(options, CAG_ARRAY_SIZE(options), stdout);
+}
+
+static void
+show_help(void)
 {
-    eol_t eol = EOL_AUTO_NA;
+    show_usage();
+    printf("\nCharacter Set Validator for C/C++ Source Code\n\n\
+"PROGRAM_NAME" reads from standard input if no file given.\n\
+"PROGRAM_NAME" validates directories recursively, skipping hidden files and directories.\n\
+"PROGRAM_NAME" prints one result per file and a total for multiple files.\n\
+"PROGRAM_NAME" refines the options by "POLICY_FILE_NAME" files in the path of a file, not when serving.\n\
+"PROGRAM_NAME" determines EOL indicator if no eol specified (EOL NA).\n\
+"PROGRAM_NAME" checks for consistent EOL prior validation.\n\n\
+Exit codes:\n");
+    printf("%d = input passed validation\n", RETURN_VALID);
+    printf("%d = input failed validation \n", RETURN_INVALID);
+    printf("%d = EOL indicator mismatch\n", RETURN_ERROR_EOL);
+    printf("%d = unspecific error\n", RETURN_ERROR_UNSPECIFIC);
+    printf("%d = input error, e.g., file could not be read\n", RETURN_ERROR_INPUT);
+    printf("%d = invalid option\n", RETURN_ERROR_OPTIONS);
+}
+
+static void
+show_version(void)
+{
+    printf(PROGRAM_NAME" "VERSION"\n\n\
+Copyright (C) 2024 Julian Kraemer\n\
+MIT license <https://github.com/piscilus/cvc/blob/main/LICENSE>\n\n\
+Get latest version of "PROGRAM_NAME" from <https://github.com/piscilus/cvc>\n");
+}
+
+typedef struct
+{
+    const policy_tables_t* policy; /* of files without a policy file */
+    const policies_t* policies;
+    const size_t* policy_of; /* per input, NULL if all have the one above */
+    bool verbose;
+    bool details;   /* every violation is reported, verbose or formatted */
+    format_t format;
+    bool multi;     /* report per file instead of a plain count */
+    bool first;     /* stop a file at its first invalid character */
+    bool quiet;     /* exit code only */
+    bool fail_fast; /* stop the run at the first failing file */
+    bool fix;       /* rewrite files that fail validation */
+    bool escape;    /* escape invalid characters instead of removing them */
+    bool mmap;      /* map large regular files into memory */
+    unsigned int segments; /* threads for a large input, 1 = not split */
+    cache_t* cache; /* NULL if not enabled */
+    prefetch_t* prefetch; /* NULL if files are not read ahead */
+    stats_t* stats; /* one per thread for --stats, else NULL */
+} config_t;
+
+/* State owned by one thread, reused for all files it validates. */
+typedef struct
+{
+    char* buf; /* page-aligned, CHUNK_SIZE bytes */
+    policy_tables_t policy; /* copy of cfg->policy */
+    stats_t stats;
+} worker_t;
+
+typedef struct
+{
+    report_t out;
+    report_t err;
+    unsigned int errors;
+    int result;
+    bool done;
+} file_result_t;
+
+/* Merged results of all files emitted so far. */
+typedef struct
+{
+    int result;
+    unsigned long errors;
+    unsigned long files;
+    bool results; /* a SARIF result has been written */
+    stats_t stats; /* of writing the output */
+} totals_t;
+
+/* Passed to the scanner to write the violations of a file formatted. */
+typedef struct
+{
+    const config_t* cfg;
+    file_result_t* res;
+    const char* name;
+    unsigned long count;
+} output_t;
+
+/*
+ * Report buffers of emitted results, handed to the files started next, so the
+ * buffers in use are only as many as results are pending.
+ */
+typedef struct
+{
+    report_t* reports;
+    size_t count;
+} spares_t;
+
+typedef struct
+{
+    const config_t* cfg;
+    const file_list_t* inputs;
+    worker_t* workers;
+    file_result_t* results;
+    size_t first_failure; /* lowest failed task with --fail-fast */
+    spares_t spare_out;
+    spares_t spare_err;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} job_t;
+
+static bool
+worker_init(worker_t* w, const config_t* cfg)
+{
+    w->policy.table = cfg->policy->table;
+    w->policy.context = cfg->policy->context;
+    w->policy.match = cfg->policy->match; /* shared, read-only */
+    w->policy.eol = cfg->policy->eol;
+    w->policy.fingerprint = cfg->policy->fingerprint;
+    if (cfg->policy->context)
+    {
+        w->policy.lex = cfg->policy->lex;
+    }
+    memset(&w->stats, 0, sizeof(w->stats));
+    long page = sysconf(_SC_PAGESIZE);
+    void* buf;
+    if (posix_memalign(&buf, (page > 0) ? (size_t)page : 4096U, CHUNK_SIZE) != 0)
+    {
+        w->buf = NULL;
+        return false;
+    }
+    w->buf = buf;
+
+    return true;
+}
+
+static void
+worker_free(worker_t* w)
+{
+    free(w->buf);
+    w->buf = NULL;
+}
+
+/* Tables of the slot-th input, shared by all workers unless the default. */
+static const policy_tables_t*
+input_policy(const config_t* cfg, const worker_t* w, size_t slot)
+{
+    size_t index = (cfg->policy_of != NULL) ? cfg->policy_of[slot] : 0U;
+
+    return (index == 0U) ? &w->policy : policies_get(cfg->policies, index);
+}
+
+/* Appends the result line "N" or, with name, "N name". */
+static void
+report_count(report_t* out, unsigned int errors, const char* name)
+{
+    size_t name_len = (name != NULL) ? strlen(name) : 0U;
+    char* q = report_reserve(out, REPORT_UINT_MAX_LEN + name_len + 2U);
+    if (q != NULL)
+    {
+        q = report_format_uint(q, errors);
+        if (name != NULL)
+        {
+            *q++ = ' ';
+            memcpy(q, name, name_len);
+            q += name_len;
+        }
+        *q++ = '\n';
+        report_commit(out, q);
+    }
+}
+
+/*
+ * Writes the outcome of an input, validated or taken from the cache, to the
+ * reports of res. An EOL mismatch is given by its line, 0 if there is none.
+ */
+static void
+report_result(const char* name, const config_t* cfg, file_result_t* res,
+              bool empty, unsigned int errors, unsigned int eol_error_line)
+{
+    /* other formats are written per violation and file */
+    bool silent = cfg->quiet || (cfg->format != FORMAT_TEXT);
+
+    if (empty)
+    {
+        if (cfg->verbose)
+        {
+            report_printf(&res->out, "Empty input/file.\n");
+        }
+        if (cfg->multi && !silent)
+        {
+            report_count(&res->out, 0U, name);
+        }
+        res->errors = 0U;
+        return;
+    }
+
+    if (eol_error_line != 0U)
+    {
+        if (silent)
+        {
+            /* exit code only */
+        }
+        else if (cfg->multi)
+        {
+            report_printf(&res->err,
+                          "Error: Unexpected end-of-line indicator in line %u of '%s'!\n",
+                          eol_error_line, name);
+        }
+        else if (cfg->verbose)
+        {
+            report_printf(&res->err,
+                          "Error: Unexpected end-of-line indicator in line %u!\n",
+                          eol_error_line);
+        }
+        return;
+    }
+
+    res->errors = errors;
+    if (!silent)
+    {
+        report_count(&res->out, errors, cfg->multi ? name : NULL);
+    }
+}
+
+static void
+output_violation(void* user, const scan_violation_t* v)
+{
+    output_t* o = user;
+
+    format_violation(&o->res->out, o->cfg->format, o->name, v, (o->count == 0U));
+    o->count++;
+}
+
+/* Computes the content hash of a file without validating it. */
+static bool
+hash_file(const char* path, const config_t* cfg, worker_t* w, uint64_t* hash)
+{
+    reader_t reader;
+    if (!reader_open(&reader, path, w->buf, CHUNK_SIZE, cfg->mmap))
+    {
+        return false;
+    }
+
+    cache_hash_t h;
+    const char* data;
+    size_t len;
+    cache_hash_init(&h);
+    while (reader_next(&reader, &data, &len))
+    {
+        cache_hash_update(&h, data, len);
+    }
+    bool ok = !reader.error;
+    reader_close(&reader);
+    *hash = cache_hash_final(&h);
+
+    return ok;
+}
+
+/*
+ * Validates the input of reader, reported under name, against policy and
+ * sets res->result. If hash is given, all of the input is hashed, even where
+ * validation stops early. Returns the scanner state and the bytes read.
+ */
+static size_t
+validate_input(reader_t* reader, const char* name, const config_t* cfg,
+               const policy_tables_t* policy, worker_t* w,
+               file_result_t* res, cache_hash_t* hash, scan_t* scan)
+{
+    size_t total_size = 0U;
+    const char* data;
+    size_t bytes_read;
+    bool scanning = true;
+    output_t output = {.cfg = cfg, .res = res, .name = name, .count = 0U};
+
+    scan_init(scan, &policy->table, policy->eol,
+              cfg->verbose ? &res->out : NULL, cfg->first);
+    if (policy->context)
+    {
+        scan_set_lexer(scan, &policy->lex);
+    }
+    if (policy->match != NULL)
+    {
+        scan_set_matcher(scan, policy->match);
+    }
+    if (cfg->format != FORMAT_TEXT)
+    {
+        scan_set_callback(scan, output_violation, &output);
+    }
+    uint64_t lap = stats_clock();
+    while (reader_next(reader, &data, &bytes_read))
+    {
+        total_size += bytes_read;
+        if (hash != NULL)
+        {
+            cache_hash_update(hash, data, bytes_read);
+        }
+        stats_lap(&w->stats.time[STATS_READ], &lap);
+        /* neither the lexer nor the matcher state is carried across segments */
+        if (scanning && (cfg->segments > 1U) && !policy->context
+            && (policy->match == NULL)
+            && (reader->map != NULL) && (hash == NULL)
+            && segment_scan(scan, data, bytes_read, cfg->segments))
+        {
+            scanning = false; /* the mapping is the whole input */
+        }
+        else if (scanning && !scan_chunk(scan, data, bytes_read))
+        {
+            scanning = false;
+            if (hash == NULL)
+            {
+                stats_lap(&w->stats.time[STATS_SCAN], &lap);
+                break;
+            }
+        }
+        stats_lap(&w->stats.time[STATS_SCAN], &lap);
+    }
+    stats_lap(&w->stats.time[STATS_READ], &lap);
+    stats_count(&w->stats.bytes, total_size);
+    stats_count(&w->stats.mapped, reader->mapped ? 1U : 0U);
+
+    if (reader->error)
+    {
+        report_printf(&res->err, "Error: Failed to read input '%s'!\n", name);
+        res->result = RETURN_ERROR_INPUT;
+        return total_size;
+    }
 
-    for (; *p != '\0'; p++)
+    if (total_size > 0U)
+    {
+        scan_finish(scan);
+    }
+    stats_lap(&w->stats.time[STATS_SCAN], &lap);
+    stats_count(&w->stats.simd_bytes, scan->simd_bytes);
+    if ((scan->eol_error_line != 0U) && (cfg->format != FORMAT_TEXT))
+    {
+        const scan_violation_t v =
+        {
+            .kind = SCAN_VIOLATION_EOL,
+            .offset = scan->eol_error_offset,
+            .line = scan->eol_error_line,
+            .column = scan->eol_error_column,
+            .char_column = scan->eol_error_char_column,
+            .length = 1U
+        };
+        output_violation(&output, &v);
+    }
+    report_result(name, cfg, res, (total_size == 0U), scan->errors,
+                  scan->eol_error_line);
+    if (total_size == 0U)
+    {
+        res->result = RETURN_VALID;
+    }
+    else if (scan->eol_error_line != 0U)
+    {
+        res->result = RETURN_ERROR_EOL;
+    }
+    else
+    {
+        res->result = (scan->errors == 0U) ? RETURN_VALID : RETURN_INVALID;
+    }
+
+    return total_size;
+}
+
+/*
+ * Validates a single input and writes its result to the reports of res.
+ * A path of NULL means standard input. Sets res->result to one of the
+ * RETURN_* codes, res->errors is only updated if the input could be
+ * validated. The input is the slot-th one, which is its place in the cache.
+ */
+static void
+validate_path(const char* path, size_t slot, const config_t* cfg,
+              const policy_tables_t* policy, worker_t* w, file_result_t* res)
+{
+    const char* name = (path != NULL) ? path : "-";
+    cache_state_t state = CACHE_UNAVAILABLE;
+    cache_entry_t entry;
+    bool hashed = false;
+    uint64_t lap = stats_clock();
+
+    if ((cfg->cache != NULL) && (path != NULL))
+    {
+        /* the cache has no details, reporting violations needs validation */
+        stats_count(&w->stats.cache_lookups, 1U);
+        state = cache_lookup(cfg->cache, slot, path, policy->fingerprint,
+                             &entry);
+        if ((state == CACHE_CHANGED) && !cfg->details)
+        {
+            uint64_t stored = entry.hash;
+            hashed = hash_file(path, cfg, w, &entry.hash);
+            if (hashed && (entry.hash == stored))
+            {
+                cache_store(cfg->cache, slot, &entry); /* mtime changed */
+                state = CACHE_HIT;
+            }
+        }
+        if ((state == CACHE_HIT) && !cfg->details)
+        {
+            stats_count(&w->stats.cache_hits, 1U);
+            stats_lap(&w->stats.time[STATS_READ], &lap);
+            report_result(name, cfg, res, (entry.size == 0U), entry.errors,
+                          entry.eol_error_line);
+            res->result = entry.result;
+            return;
+        }
+    }
+
+    reader_t reader;
+    const char* data;
+    size_t len;
+    bool ahead = (cfg->prefetch != NULL) && (path != NULL)
+                 && prefetch_get(cfg->prefetch, slot, &data, &len);
+    if (ahead)
+    {
+        reader_open_memory(&reader, data, len);
+    }
+    else if (!reader_open(&reader, path, w->buf, CHUNK_SIZE, cfg->mmap))
+    {
+        report_printf(&res->err, "Error: Failed to open file '%s'!\n", path);
+        res->result = RETURN_ERROR_INPUT;
+        return;
+    }
+    stats_count(&w->stats.prefetched, ahead ? 1U : 0U);
+    stats_lap(&w->stats.time[STATS_READ], &lap);
+    if ((path != NULL) && cfg->verbose)
+    {
+        report_printf(&res->out, "file %s:\n", path);
+    }
+
+    cache_hash_t hash;
+    bool hashing = (state != CACHE_UNAVAILABLE) && !hashed;
+    if (hashing)
+    {
+        cache_hash_init(&hash);
+    }
+    scan_t scan;
+    size_t total_size = validate_input(&reader, name, cfg, policy, w, res,
+                                       hashing ? &hash : NULL, &scan);
+    lap = stats_clock();
+    reader_close(&reader);
+    if (ahead)
+    {
+        prefetch_release(cfg->prefetch, slot);
+    }
+    stats_lap(&w->stats.time[STATS_READ], &lap);
+
+    /* a file changed while being read is left to the next run */
+    if ((state != CACHE_UNAVAILABLE) && (res->result != RETURN_ERROR_INPUT)
+        && (total_size == entry.size))
+    {
+        if (hashing)
+        {
+            entry.hash = cache_hash_final(&hash);
+        }
+        entry.errors = scan.errors;
+        entry.eol_error_line = scan.eol_error_line;
+        entry.result = res->result;
+        cache_store(cfg->cache, slot, &entry);
+    }
+}
+
+/*
+ * Validates a file as validate_path(), rewrites it with --fix if it failed
+ * and writes its summary, if formatted. The result is that of validation.
+ */
+static void
+validate_file(const char* path, size_t slot, const config_t* cfg,
+              worker_t* w, file_result_t* res)
+{
+    uint64_t start = stats_clock();
+    const policy_tables_t* policy = input_policy(cfg, w, slot);
+    validate_path(path, slot, cfg, policy, w, res);
+    if (cfg->fix && (path != NULL)
+        && ((res->result == RETURN_INVALID) || (res->result == RETURN_ERROR_EOL)))
+    {
+        const fix_options_t options =
+        {
+            .table = &policy->table,
+            .lex = policy->context ? &policy->lex : NULL,
+            .match = policy->match,
+            .eol = policy->eol,
+            .escape = cfg->escape
+        };
+        switch (fix_file(path, &options, w->buf, CHUNK_SIZE))
+        {
+            case FIX_DONE:
+                break;
+            case FIX_SEQUENCE:
+                /* invalid as validated, the file is left as it is */
+                report_printf(&res->err, "Error: Forbidden sequence in file "
+                              "'%s', not fixed!\n", path);
+                break;
+            default:
+                report_printf(&res->err, "Error: Failed to fix file '%s'!\n",
+                              path);
+                res->result = RETURN_ERROR_INPUT;
+                break;
+        }
+    }
+    format_file(&res->out, cfg->format, (path != NULL) ? path : "-",
+                res->result, res->errors);
+    stats_count(&w->stats.files, 1U);
+    stats_lap(&w->stats.busy, &start);
+}
+
+static const char*
+input_path(const file_list_t* inputs, size_t i)
+{
+    const char* path = inputs->paths[i];
+
+    return (strcmp(path, "-") == 0) ? NULL : path;
+}
+
+/*
+ * Writes the reports of a file and merges its result into the totals. SARIF
+ * results of a file are buffered as a whole, to be separated from the last.
+ * The reports are reset with their memory kept for the next file.
+ */
+static void
+emit_result(file_result_t* res, const config_t* cfg, totals_t* totals)
+{
+    uint64_t start = stats_clock();
+    if ((cfg->format == FORMAT_SARIF) && (res->out.len > 0U))
+    {
+        if (totals->results)
+        {
+            fputs(",\n", stdout);
+        }
+        totals->results = true;
+    }
+    report_flush(&res->out, stdout);
+    report_flush(&res->err, stderr);
+    if (res->out.oom || res->err.oom)
+    {
+        fprintf(stderr, "Error: Memory allocation failed!\n");
+        if (res->result < RETURN_ERROR_UNSPECIFIC)
+        {
+            res->result = RETURN_ERROR_UNSPECIFIC;
+        }
+    }
+    report_reset(&res->out);
+    report_reset(&res->err);
+    stats_lap(&totals->stats.time[STATS_OUTPUT], &start);
+
+    totals->errors += res->errors;
+    totals->files++;
+    if (res->result > totals->result)
+    {
+        totals->result = res->result; /* RETURN_* codes are ordered by severity */
+    }
+}
+
+/* Where the output of a file goes while it is validated, SARIF is buffered. */
+static FILE*
+output_stream(const config_t* cfg)
+{
+    return (cfg->format == FORMAT_SARIF) ? NULL : stdout;
+}
+
+/* Moves a spare buffer, if any, to the empty report r. */
+static void
+spare_take(spares_t* spares, report_t* r)
+{
+    if (spares->count > 0U)
+    {
+        *r = spares->reports[--spares->count];
+    }
+}
+
+/* Keeps the memory of the emitted report r for another file. */
+static void
+spare_give(spares_t* spares, report_t* r)
+{
+    if (r->capacity > 0U)
+    {
+        spares->reports[spares->count++] = *r;
+        report_init(r, NULL);
+    }
+}
+
+static void
+validate_task(size_t task, unsigned int worker, void* arg)
+{
+    job_t* job = arg;
+    file_result_t* res = &job->results[task];
+
+    pthread_mutex_lock(&job->lock);
+    /* output stops before files behind a failed one anyway */
+    bool skip = job->cfg->fail_fast && (task > job->first_failure);
+    if (!skip)
+    {
+        spare_take(&job->spare_out, &res->out);
+        spare_take(&job->spare_err, &res->err);
+    }
+    pthread_mutex_unlock(&job->lock);
+    if (!skip)
+    {
+        validate_file(input_path(job->inputs, task), task, job->cfg,
+                      &job->workers[worker], res);
+    }
+
+    pthread_mutex_lock(&job->lock);
+    if (!skip && (res->result != RETURN_VALID) && (task < job->first_failure))
+    {
+        job->first_failure = task;
+    }
+    res->done = true;
+    pthread_cond_signal(&job->cond);
+    pthread_mutex_unlock(&job->lock);
+}
+
+static void
+validate_sequential(const file_list_t* inputs, const config_t* cfg,
+                    totals_t* totals)
+{
+    worker_t w;
+    if (!worker_init(&w, cfg))
+    {
+        fprintf(stderr, "Error: Memory allocation failed!\n");
+        exit(RETURN_ERROR_UNSPECIFIC);
+    }
+
+    file_result_t res;
+    report_init(&res.out, output_stream(cfg));
+    report_init(&res.err, NULL);
+    size_t count = (inputs->count > 0U) ? inputs->count : 1U;
+    for (size_t i = 0U; i < count; i++)
     {
-        if (*p == '\n')
+        res.errors = 0U;
+        res.result = RETURN_VALID;
+        validate_file((inputs->count > 0U) ? input_path(inputs, i) : NULL, i,
+                      cfg, &w, &res);
+        bool failed = (res.result != RETURN_VALID);
+        emit_result(&res, cfg, totals);
+        if (failed && cfg->fail_fast)
         {
-            if (eol == EOL_CR)
+            break;
+        }
+    }
+    report_free(&res.out);
+    report_free(&res.err);
+
+    if (cfg->stats != NULL)
+    {
+        cfg->stats[0] = w.stats;
+    }
+    worker_free(&w);
+}
+
+/*
+ * Threads each of the workers for files may split a large input into, so
+ * that all of them together stay within jobs. Segments are stitched from
+ * counts, with details reported nothing is split.
+ */
+static unsigned int
+segments_per_worker(bool details, unsigned int jobs, size_t files)
+{
+    unsigned int workers = (files < jobs) ? (unsigned int)files : jobs;
+    if (details || (workers == 0U))
+    {
+        return 1U;
+    }
+
+    return (jobs / workers > 1U) ? (jobs / workers) : 1U;
+}
+
+/*
+ * Validates the inputs on a pool of threads. Results are buffered per file
+ * and emitted strictly in input order, independent of completion order.
+ * Returns false if no thread could be started, nothing was validated then.
+ */
+static bool
+validate_parallel(const file_list_t* inputs, const config_t* cfg,
+                  unsigned int jobs, totals_t* totals)
+{
+    job_t job = {.cfg = cfg, .inputs = inputs, .first_failure = SIZE_MAX};
+    job.workers = calloc(jobs, sizeof(worker_t));
+    job.results = calloc(inputs->count, sizeof(file_result_t));
+    job.spare_out.reports = calloc(inputs->count, sizeof(report_t));
+    job.spare_err.reports = calloc(inputs->count, sizeof(report_t));
+    if ((job.workers == NULL) || (job.results == NULL)
+        || (job.spare_out.reports == NULL) || (job.spare_err.reports == NULL))
+    {
+        fprintf(stderr, "Error: Memory allocation failed!\n");
+        exit(RETURN_ERROR_UNSPECIFIC);
+    }
+    for (unsigned int i = 0U; i < jobs; i++)
+    {
+        if (!worker_init(&job.workers[i], cfg))
+        {
+            fprintf(stderr, "Error: Memory allocation failed!\n");
+            exit(RETURN_ERROR_UNSPECIFIC);
+        }
+    }
+    for (size_t i = 0U; i < inputs->count; i++)
+    {
+        report_init(&job.results[i].out, NULL);
+        report_init(&job.results[i].err, NULL);
+    }
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.cond, NULL);
+
+    pool_t* pool = pool_start(jobs, inputs->count, validate_task, &job);
+    if (pool != NULL)
+    {
+        for (size_t i = 0U; i < inputs->count; i++)
+        {
+            pthread_mutex_lock(&job.lock);
+            while (!job.results[i].done)
+            {
+                pthread_cond_wait(&job.cond, &job.lock);
+            }
+            pthread_mutex_unlock(&job.lock);
+            bool failed = (job.results[i].result != RETURN_VALID);
+            emit_result(&job.results[i], cfg, totals);
+            pthread_mutex_lock(&job.lock);
+            spare_give(&job.spare_out, &job.results[i].out);
+            spare_give(&job.spare_err, &job.results[i].err);
+            pthread_mutex_unlock(&job.lock);
+            if (failed && cfg->fail_fast)
             {
-                eol = EOL_CRLF;
+                pool_cancel(pool);
                 break;
             }
+        }
+        pool_join(pool);
+    }
+    for (size_t i = 0U; i < inputs->count; i++)
+    {
+        /* results not emitted due to --fail-fast */
+        report_free(&job.results[i].out);
+        report_free(&job.results[i].err);
+    }
+    for (size_t i = 0U; i < job.spare_out.count; i++)
+    {
+        report_free(&job.spare_out.reports[i]);
+    }
+    for (size_t i = 0U; i < job.spare_err.count; i++)
+    {
+        report_free(&job.spare_err.reports[i]);
+    }
+    free(job.spare_out.reports);
+    free(job.spare_err.reports);
+
+    pthread_cond_destroy(&job.cond);
+    pthread_mutex_destroy(&job.lock);
+    for (unsigned int i = 0U; i < jobs; i++)
+    {
+        if ((pool != NULL) && (cfg->stats != NULL))
+        {
+            cfg->stats[i] = job.workers[i].stats;
+        }
+        worker_free(&job.workers[i]);
+    }
+    free(job.workers);
+    free(job.results);
+
+    return (pool != NULL);
+}
+
+static void
+out_of_memory(void)
+{
+    fprintf(stderr, "Error: Memory allocation failed!\n");
+    exit(RETURN_ERROR_UNSPECIFIC);
+}
+
+/*
+ * Validates the members of archives, named ARCHIVE/MEMBER, one archive after
+ * the other. Each is unpacked by a thread of its own while its members are
+ * validated with the policy of the archive. Members are not cached, they have
+ * no size or time of modification to be found by.
+ */
+static void
+validate_archives(const file_list_t* archives, size_t slot, const char* exts,
+                  const config_t* cfg, totals_t* totals)
+{
+    worker_t w;
+    if (!worker_init(&w, cfg))
+    {
+        out_of_memory();
+    }
+    if (cfg->stats != NULL)
+    {
+        w.stats = cfg->stats[0]; /* goes on from the files */
+    }
+
+    char* name = NULL;
+    size_t name_size = 0U;
+    bool stopped = false;
+    file_result_t res;
+    report_init(&res.out, output_stream(cfg));
+    report_init(&res.err, NULL);
+    for (size_t i = 0U; (i < archives->count) && !stopped; i++)
+    {
+        const char* path = archives->paths[i];
+        const policy_tables_t* policy = input_policy(cfg, &w, slot + i);
+        archive_t archive;
+        const char* member;
+        if (!archive_start(&archive, path, exts, w.buf, CHUNK_SIZE))
+        {
+            res.errors = 0U;
+            res.result = RETURN_ERROR_INPUT;
+            report_printf(&res.err, "Error: Failed to open file '%s'!\n", path);
+            stopped = cfg->fail_fast;
+            emit_result(&res, cfg, totals);
+            continue;
+        }
+
+        while (!stopped && archive_next(&archive, &member))
+        {
+            size_t path_len = strlen(path);
+            size_t member_len = strlen(member);
+            if ((path_len + member_len + 2U) > name_size)
+            {
+                name_size = path_len + member_len + 2U;
+                char* grown = realloc(name, name_size);
+                if (grown == NULL)
+                {
+                    out_of_memory();
+                }
+                name = grown;
+            }
+            memcpy(name, path, path_len);
+            name[path_len] = '/';
+            memcpy(name + path_len + 1U, member, member_len + 1U);
+            if (member_len == 0U)
+            {
+                name[path_len] = '\0'; /* a single compressed file */
+            }
+
+            uint64_t start = stats_clock();
+            scan_t scan;
+            res.errors = 0U;
+            res.result = RETURN_VALID;
+            if (cfg->verbose)
+            {
+                report_printf(&res.out, "file %s:\n", name);
+            }
+            (void)validate_input(&archive.out, name, cfg, policy, &w, &res,
+                                 NULL, &scan);
+            format_file(&res.out, cfg->format, name, res.result, res.errors);
+            stats_count(&w.stats.files, 1U);
+            stats_lap(&w.stats.busy, &start);
+
+            stopped = (res.result != RETURN_VALID) && cfg->fail_fast;
+            emit_result(&res, cfg, totals);
+        }
+
+        archive_status_t status = archive_finish(&archive);
+        if (status != ARCHIVE_OK)
+        {
+            if (status == ARCHIVE_ERROR_UNSUPPORTED)
+            {
+                fprintf(stderr, "Error: Unsupported archive '%s'!\n", path);
+            }
             else
             {
-                return EOL_LF;
+                fprintf(stderr, "Error: Failed to read archive '%s'!\n", path);
             }
+            if (totals->result < RETURN_ERROR_INPUT)
+            {
+                totals->result = RETURN_ERROR_INPUT;
+            }
+            stopped = stopped || cfg->fail_fast;
+        }
+    }
+    report_free(&res.out);
+    report_free(&res.err);
+    free(name);
+
+    if (cfg->stats != NULL)
+    {
+        cfg->stats[0] = w.stats;
+    }
+    worker_free(&w);
+}
+
+/*
+ * Validates the changed files of a git repository from the object store, not
+ * the working tree. Results in the cache are found by object id, only the
+ * remaining objects are read, all through a single git cat-file process.
+ */
+static void
+validate_git(const git_changes_t* changes, const config_t* cfg,
+             totals_t* totals)
+{
+    size_t count = changes->paths.count;
+    cache_entry_t* entries = calloc((count > 0U) ? count : 1U,
+                                    sizeof(cache_entry_t));
+    bool* cached = calloc((count > 0U) ? count : 1U, sizeof(bool));
+    char** ids = calloc((count > 0U) ? count : 1U, sizeof(char*));
+    size_t id_count = 0U;
+    worker_t w;
+    if ((entries == NULL) || (cached == NULL) || (ids == NULL)
+        || !worker_init(&w, cfg))
+    {
+        out_of_memory();
+    }
+
+    for (size_t i = 0U; i < count; i++)
+    {
+        /* the cache has no details, reporting violations needs validation */
+        if (cfg->cache != NULL)
+        {
+            uint64_t fingerprint = input_policy(cfg, &w, i)->fingerprint;
+            cached[i] = (cache_lookup_object(cfg->cache, i,
+                                             changes->objects.paths[i],
+                                             fingerprint, &entries[i])
+                         == CACHE_HIT) && !cfg->details;
+            stats_count(&w.stats.cache_lookups, 1U);
+            stats_count(&w.stats.cache_hits, cached[i] ? 1U : 0U);
+        }
+        if (!cached[i])
+        {
+            ids[id_count++] = changes->objects.paths[i];
+        }
+    }
+
+    git_batch_t batch;
+    bool reading = (id_count > 0U)
+                   && git_batch_start(&batch, ids, id_count, w.buf, CHUNK_SIZE);
+    bool stopped = false;
+    file_result_t res;
+    report_init(&res.out, output_stream(cfg));
+    report_init(&res.err, NULL);
+    for (size_t i = 0U; (i < count) && !stopped; i++)
+    {
+        const char* name = changes->paths.paths[i];
+        const policy_tables_t* policy = input_policy(cfg, &w, i);
+        cache_entry_t* entry = &entries[i];
+        size_t size;
+        uint64_t start = stats_clock();
+        res.errors = 0U;
+        res.result = RETURN_VALID;
+
+        if (cached[i])
+        {
+            report_result(name, cfg, &res, (entry->size == 0U),
+                          entry->errors, entry->eol_error_line);
+            res.result = entry->result;
         }
-        else if (*p == '\r')
+        else if (!reading || !git_batch_next(&batch, &size))
         {
-            eol = EOL_CR;
+            report_printf(&res.err, "Error: Failed to read object of '%s'!\n",
+                          name);
+            res.result = RETURN_ERROR_INPUT;
         }
         else
         {
-            if (eol == EOL_CR)
+            scan_t scan;
+            if (cfg->verbose)
+            {
+                report_printf(&res.out, "file %s:\n", name);
+            }
+            (void)validate_input(&batch.out, name, cfg, policy, &w, &res, NULL,
+                                 &scan);
+            if ((cfg->cache != NULL) && (res.result != RETURN_ERROR_INPUT))
             {
-                break;
+                entry->size = size;
+                entry->errors = scan.errors;
+                entry->eol_error_line = scan.eol_error_line;
+                entry->result = res.result;
+                cache_store(cfg->cache, i, entry);
             }
         }
+        format_file(&res.out, cfg->format, name, res.result, res.errors);
+        stats_count(&w.stats.files, 1U);
+        stats_lap(&w.stats.busy, &start);
+
+        stopped = (res.result != RETURN_VALID) && cfg->fail_fast;
+        emit_result(&res, cfg, totals);
+    }
+    report_free(&res.out);
+    report_free(&res.err);
+    if (reading && !git_batch_finish(&batch))
+    {
+        fprintf(stderr, "Error: Failed to read objects from git!\n");
+        if (totals->result < RETURN_ERROR_INPUT)
+        {
+            totals->result = RETURN_ERROR_INPUT;
+        }
     }
 
-    return eol;
+    if (cfg->stats != NULL)
+    {
+        cfg->stats[0] = w.stats;
+    }
+    worker_free(&w);
+    free(ids);
+    free(cached);
+    free(entries);
 }
 
-static unsigned int
-validate_eol(const char* buf, eol_t eol)
+static void
+on_stop(int signal)
 {
-    unsigned int line = 1U;
-    char eol_chars[2];
-    char eol_invalid;
-    int eol_len;
+    (void)signal; /* only interrupts the wait */
+}
 
-    switch (eol)
-    {
-        case EOL_CR:
-            eol_chars[0] = '\r';
-            eol_invalid = '\n';
-            eol_len = 1;
-            break;
-        case EOL_LF:
-            eol_chars[0] = '\n';
-            eol_invalid = '\r';
-            eol_len = 1;
-            break;
-        case EOL_CRLF:
-            eol_chars[0] = '\r';
-            eol_chars[1] = '\n';
-            eol_invalid = '\n';
-            eol_len = 2;
-            break;
-        default: /* EOL_NA, no end-of-line indicator in string */
-            return 0U;
-    }
+/*
+ * Validates the files changed below a watched directory, batch by batch
+ * until SIGINT or SIGTERM. Each batch is a run of its own with the policies
+ * compiled so far and the cache, if any. Returns the result of the last one.
+ */
+static int
+validate_watch(watch_t* watch, const config_t* run, policies_t* policies,
+               const char* cache_dir, bool use_cvcrc, unsigned int jobs,
+               int result)
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigemptyset(&sa.sa_mask);
+    (void)sigaction(SIGINT, &sa, NULL);
+    (void)sigaction(SIGTERM, &sa, NULL);
 
-    const char* p = buf;
-    while (*p != '\0')
+    file_list_t changed;
+    file_list_init(&changed);
+    while (watch_wait(watch, &changed, WATCH_QUIET_MS))
     {
-        if (*p == eol_chars[0])
+        config_t cfg = *run;
+        cfg.multi = true;
+        cfg.policy_of = NULL;
+        cfg.cache = NULL;
+        cfg.prefetch = NULL;
+        cfg.stats = NULL;
+        cfg.segments = segments_per_worker(cfg.details, jobs, changed.count);
+
+        size_t* policy_of = NULL;
+        if (use_cvcrc)
         {
-            if (eol_len == 1)
+            if ((policy_of = calloc(changed.count, sizeof(size_t))) == NULL)
             {
-                line++;
-                p++;
+                out_of_memory();
             }
-            else /* len == 2 */
+            for (size_t i = 0U; i < changed.count; i++)
             {
-                if (*(p + 1) == eol_chars[1])
+                if (!policies_resolve(policies, changed.paths[i],
+                                      &policy_of[i]))
                 {
-                    line++;
-                    p += eol_len;
-                }
-                else
-                {
-                    return line;
+                    policy_of[i] = 0U; /* reported, the defaults apply */
                 }
             }
+            cfg.policy_of = policy_of;
         }
-        else if (*p == eol_invalid)
+        if ((cache_dir != NULL)
+            && ((cfg.cache = cache_open(cache_dir, changed.count)) == NULL))
         {
-            return line;
+            fprintf(stderr, "Error: Failed to open cache '%s'!\n", cache_dir);
         }
-        else
+
+        totals_t totals = {.result = RETURN_VALID, .errors = 0UL, .files = 0UL};
+        report_t out;
+        report_init(&out, stdout);
+        unsigned int threads = (jobs < changed.count)
+                               ? jobs : (unsigned int)changed.count;
+        if ((threads <= 1U)
+            || !validate_parallel(&changed, &cfg, threads, &totals))
         {
-            p++;
+            validate_sequential(&changed, &cfg, &totals);
         }
-    }
-
-    return 0U;
-}
+        if (!cfg.quiet && (cfg.format == FORMAT_TEXT))
+        {
+            printf("%lu total\n", totals.errors);
+        }
+        format_end(&out, cfg.format, totals.files, totals.errors,
+                   totals.result);
+        report_flush(&out, stdout);
+        report_free(&out);
+        fflush(stdout);
+        result = totals.result;
 
-static inline bool
-is_eol(const char* p, eol_t eol)
-{
-    switch (eol)
-    {
-        case EOL_CR:
-            if (*p == '\r')
-            {
-                return true;
-            }
-            break;
-        case EOL_LF:
-            if (*p == '\n')
-            {
-                return true;
-            }
-            break;
-        case EOL_CRLF:
-            if ((*p == '\r') && (*(p + 1) == '\n'))
-            {
-                return true;
-            }
-            break;
-        default:
-            return false;
+        if ((cfg.cache != NULL) && !cache_close(cfg.cache))
+        {
+            fprintf(stderr, "Error: Failed to write cache '%s'!\n", cache_dir);
+        }
+        free(policy_of);
+        file_list_free(&changed);
     }
+    file_list_free(&changed);
 
-    return false;
-}
-
-static void
-show_usage(void)
-{
-    printf("Usage: "PROGRAM_NAME" [OPTION]...\n\n");
-    cag_option_print(options, CAG_ARRAY_SIZE(options), stdout);
-}
-
-static void
-show_help(void)
-{
-    show_usage();
-    printf("\nCharacter Set Validator for C/C++ Source Code\n\n\
-"PROGRAM_NAME" reads from standard output if no file given.\n\
-"PROGRAM_NAME" determines EOL indicator if no eol specified (EOL NA).\n\
-"PROGRAM_NAME" checks for consistent EOL prior validation.\n\n\
-Exit codes:\n");
-    printf("%d = input passed validation\n", RETURN_VALID);
-    printf("%d = input failed validation \n", RETURN_INVALID);
-    printf("%d = EOL indicator mismatch\n", RETURN_ERROR_EOL);
-    printf("%d = unspecific error\n", RETURN_ERROR_UNSPECIFIC);
-    printf("%d = input error, e.g., file could not be read\n", RETURN_ERROR_INPUT);
-    printf("%d = invalid option\n", RETURN_ERROR_OPTIONS);
+    return result;
 }
 
+/* Runs the server, does not return. */
 static void
-show_version(void)
+serve(const char* socket_path, const cvc_options_t* o)
 {
-    printf(PROGRAM_NAME" "VERSION"\n\n\
-Copyright (C) 2024 Julian Kraemer\n\
-MIT license <https://github.com/piscilus/cvc/blob/main/LICENSE>\n\n\
-Get latest version of "PROGRAM_NAME" from <https://github.com/piscilus/cvc>\n");
+    if (socket_path != NULL)
+    {
+        if (!serve_socket(socket_path, o))
+        {
+            fprintf(stderr, "Error: Failed to serve on socket '%s'!\n",
+                    socket_path);
+            exit(RETURN_ERROR_INPUT);
+        }
+    }
+    else if (!serve_stdio(o))
+    {
+        out_of_memory();
+    }
+    exit(RETURN_VALID);
 }
 
 int
@@ -299,25 +1475,46 @@ main(int argc, char** argv)
 
     eol_t eol = EOL_AUTO_NA;
     bool verbose = false;
-    bool valid_chars[MAX_VALID_CHAR] = {0};
+    bool first = false;
+    bool quiet = false;
+    bool fail_fast = false;
+    format_t format = FORMAT_TEXT;
+    bool fix = false;
+    bool escape = false;
+    bool show_stats = false;
+    bool stats_json = false;
+    bool valid_chars[CHAR_TABLE_SIZE];
+    policy_t base = {.forbid_count = 0U};
 
-    /* preset range of printable ASCII characters */
-    for (size_t i = 0x20U; i < MAX_VALID_CHAR; i++)
-    {
-        valid_chars[i] = true;
-    }
-    /* preset range of control characters */
-    valid_chars[CHAR_CODE_HT] = true;
+    /* the defaults are those of the library */
+    cvc_options_t defaults;
+    cvc_options_init(&defaults);
+    memcpy(valid_chars, defaults.allowed, sizeof(valid_chars));
     valid_chars[CHAR_CODE_LF] = true;
-    valid_chars[CHAR_CODE_VT] = false;
-    valid_chars[CHAR_CODE_FF] = false;
     valid_chars[CHAR_CODE_CR] = true;
-    valid_chars[CHAR_CODE_DOLLAR] = false;
-    valid_chars[CHAR_CODE_AT] = false;
-    valid_chars[CHAR_CODE_BACKTICK] = false;
 
     cag_option_context context;
-    const char* file = NULL;
+    file_list_t args;
+    const char* files_from = NULL;
+    const char* exts = NULL;
+    bool unpack = false;
+    int delim = '\n';
+    unsigned int jobs = 1U;
+    simd_backend_t backend = simd_detect();
+    bool use_mmap = true;
+    const char* cache_dir = NULL;
+    const char* git_rev = NULL;
+    bool staged = false;
+    bool serving = false;
+    const char* socket_path = NULL;
+    const char* watch_dir = NULL;
+    bool utf8 = false;
+    bool lexer = false;
+    bool use_cvcrc = true;
+    utf8_range_t ranges[UTF8_RANGES_MAX] = {{0xA0U, UTF8_MAX}};
+    unsigned int range_count = 1U;
+
+    file_list_init(&args);
 
     cag_option_prepare(&context, options, CAG_ARRAY_SIZE(options), argc, argv);
     while (cag_option_fetch(&context))
@@ -326,7 +1523,78 @@ main(int argc, char** argv)
         switch (identifier)
         {
             case ARG_ID_FILE:
-                file = cag_option_get_value(&context);
+            {
+                const char* file = cag_option_get_value(&context);
+                if ((file != NULL) && !file_list_add(&args, file))
+                {
+                    out_of_memory();
+                }
+                break;
+            }
+            case ARG_ID_FILES_FROM:
+                files_from = cag_option_get_value(&context);
+                break;
+            case ARG_ID_NULL:
+                delim = '\0';
+                break;
+            case ARG_ID_EXT:
+                exts = cag_option_get_value(&context);
+                break;
+            case ARG_ID_ARCHIVES:
+                unpack = true;
+                break;
+            case ARG_ID_GIT_DIFF:
+                git_rev = cag_option_get_value(&context);
+                if ((git_rev == NULL) || (git_rev[0] == '-'))
+                {
+                    fprintf(stderr, "Error: invalid revision!\n");
+                    show_usage();
+                    exit(RETURN_ERROR_OPTIONS);
+                }
+                break;
+            case ARG_ID_STAGED:
+                staged = true;
+                break;
+            case ARG_ID_WATCH:
+                watch_dir = cag_option_get_value(&context);
+                if ((watch_dir != NULL) && !file_list_add(&args, watch_dir))
+                {
+                    out_of_memory();
+                }
+                break;
+            case ARG_ID_JOBS:
+            {
+                const char* jobs_opt = cag_option_get_value(&context);
+                char* end;
+                unsigned long n;
+                if ((jobs_opt != NULL)
+                    && ((n = strtoul(jobs_opt, &end, 10)) <= 1024UL)
+                    && (end != jobs_opt) && (*end == '\0'))
+                {
+                    jobs = (n == 0UL) ? pool_cpu_count() : (unsigned int)n;
+                    break;
+                }
+                fprintf(stderr, "Error: invalid number of jobs!\n");
+                show_usage();
+                exit(RETURN_ERROR_OPTIONS);
+            }
+            case ARG_ID_BACKEND:
+            {
+                const char* name = cag_option_get_value(&context);
+                if ((name != NULL) && simd_backend_from_name(name, &backend)
+                    && simd_supported(backend))
+                {
+                    break;
+                }
+                fprintf(stderr, "Error: backend not supported!\n");
+                show_usage();
+                exit(RETURN_ERROR_OPTIONS);
+            }
+            case ARG_ID_NO_MMAP:
+                use_mmap = false;
+                break;
+            case ARG_ID_CACHE:
+                cache_dir = cag_option_get_value(&context);
                 break;
             case ARG_ID_FF:
                 valid_chars[CHAR_CODE_FF] = true;
@@ -342,9 +1610,114 @@ main(int argc, char** argv)
                 valid_chars[CHAR_CODE_AT] = true;
                 valid_chars[CHAR_CODE_BACKTICK] = true;
                 break;
+            case ARG_ID_UTF8:
+                utf8 = true;
+                break;
+            case ARG_ID_UNICODE:
+            {
+                const char* ranges_opt = cag_option_get_value(&context);
+                if ((ranges_opt != NULL)
+                    && utf8_ranges_parse(ranges_opt, ranges, UTF8_RANGES_MAX,
+                                         &range_count))
+                {
+                    utf8 = true;
+                    break;
+                }
+                fprintf(stderr, "Error: invalid Unicode ranges!\n");
+                show_usage();
+                exit(RETURN_ERROR_OPTIONS);
+            }
+            case ARG_ID_CONTEXT:
+                lexer = true;
+                break;
+            case ARG_ID_FORBID:
+            {
+                const char* seq = cag_option_get_value(&context);
+                if ((seq != NULL) && (*seq != '\0') && policy_forbid(&base, seq))
+                {
+                    break;
+                }
+                fprintf(stderr, "Error: invalid sequence!\n");
+                show_usage();
+                exit(RETURN_ERROR_OPTIONS);
+            }
+            case ARG_ID_TRIGRAPHS:
+            {
+                static const char* const trigraphs[] =
+                {
+                    "?\?=", "?\?/", "?\?'", "?\?(", "?\?)", "?\?!", "?\?<", "?\?>",
+                    "?\?-"
+                };
+                for (size_t i = 0U; i < CAG_ARRAY_SIZE(trigraphs); i++)
+                {
+                    if (!policy_forbid(&base, trigraphs[i]))
+                    {
+                        fprintf(stderr, "Error: too many sequences!\n");
+                        exit(RETURN_ERROR_OPTIONS);
+                    }
+                }
+                break;
+            }
+            case ARG_ID_NO_CVCRC:
+                use_cvcrc = false;
+                break;
             case ARG_ID_VERBOSE:
                 verbose = true;
                 break;
+            case ARG_ID_FIRST:
+                first = true;
+                break;
+            case ARG_ID_QUIET:
+                quiet = true;
+                break;
+            case ARG_ID_FAIL_FAST:
+                fail_fast = true;
+                break;
+            case ARG_ID_FIX:
+                fix = true;
+                break;
+            case ARG_ID_FIX_ESCAPE:
+                fix = true;
+                escape = true;
+                break;
+#if defined(CVC_STATS)
+            case ARG_ID_STATS:
+            {
+                const char* stats_opt = cag_option_get_value(&context);
+                if ((stats_opt != NULL) && (strcmp(stats_opt, "text") == 0))
+                {
+                    show_stats = true;
+                    break;
+                }
+                if ((stats_opt != NULL) && (strcmp(stats_opt, "json") == 0))
+                {
+                    show_stats = true;
+                    stats_json = true;
+                    break;
+                }
+                fprintf(stderr, "Error: statistics format not supported!\n");
+                show_usage();
+                exit(RETURN_ERROR_OPTIONS);
+            }
+#endif
+            case ARG_ID_FORMAT:
+            {
+                const char* format_opt = cag_option_get_value(&context);
+                if ((format_opt != NULL) && format_from_name(format_opt, &format))
+                {
+                    break;
+                }
+                fprintf(stderr, "Error: format not supported!\n");
+                show_usage();
+                exit(RETURN_ERROR_OPTIONS);
+            }
+            case ARG_ID_SERVE:
+                serving = true;
+                break;
+            case ARG_ID_SOCKET:
+                socket_path = cag_option_get_value(&context);
+                serving = (socket_path != NULL);
+                break;
             case ARG_ID_EOL:
             {
                 const char* eol_opt = cag_option_get_value(&context);
@@ -362,7 +1735,7 @@ main(int argc, char** argv)
                     }
                     else if (strcmp(eol_opt, "CR") == 0)
                     {
-                        eol = EOL_CRLF;
+                        eol = EOL_CR;
                         break;
                     }
                     else if (strcmp(eol_opt, "AUTO") == 0)
@@ -388,121 +1761,358 @@ main(int argc, char** argv)
         }
     }
 
-    FILE* in_stream;
-    if (file != NULL)
+    for (int i = cag_option_get_index(&context); i < argc; i++)
     {
-        if ((in_stream = fopen(file, "rb")) == NULL)
+        if (!file_list_add(&args, argv[i]))
         {
-            fprintf(stderr, "Error: Failed to open file '%s'!\n", file);
-            exit(RETURN_ERROR_INPUT);
+            out_of_memory();
         }
-        else
+    }
+
+    bool git = (git_rev != NULL) || staged;
+    if (serving)
+    {
+        if (git || (args.count > 0U) || (files_from != NULL))
         {
-            if (verbose)
-            {
-                printf("file %s:\n", file);
-            }
+            fprintf(stderr, "Error: files not allowed with --serve/--socket!\n");
+            show_usage();
+            exit(RETURN_ERROR_OPTIONS);
         }
+        /* requests are validated as with --no-cvcrc, by the options alone */
+        cvc_options_t o = defaults;
+        memcpy(o.allowed, valid_chars, sizeof(o.allowed));
+        switch (eol)
+        {
+            case EOL_LF:
+                o.eol = CVC_EOL_LF;
+                break;
+            case EOL_CRLF:
+                o.eol = CVC_EOL_CRLF;
+                break;
+            case EOL_CR:
+                o.eol = CVC_EOL_CR;
+                break;
+            default:
+                o.eol = CVC_EOL_AUTO;
+                break;
+        }
+        o.first = first || quiet;
+        o.utf8 = utf8;
+        for (unsigned int i = 0U; i < range_count; i++)
+        {
+            o.ranges[i].first = ranges[i].first;
+            o.ranges[i].last = ranges[i].last;
+        }
+        o.range_count = range_count;
+        o.context = lexer;
+        /* comments and literals may use all printable ASCII characters */
+        memcpy(o.extended, valid_chars, sizeof(o.extended));
+        for (unsigned int c = 0x20U; c < MAX_VALID_CHAR; c++)
+        {
+            o.extended[c] = true;
+        }
+        if (base.forbid_count > CVC_FORBID_MAX)
+        {
+            fprintf(stderr, "Error: too many sequences!\n");
+            show_usage();
+            exit(RETURN_ERROR_OPTIONS);
+        }
+        char sequences[CVC_FORBID_MAX][MATCH_PATTERN_MAX];
+        for (unsigned int i = 0U; i < base.forbid_count; i++)
+        {
+            o.forbid[i].bytes = sequences[i];
+            o.forbid[i].length = policy_sequence(&base, i, sequences[i]);
+        }
+        o.forbid_count = base.forbid_count;
+        serve(socket_path, &o);
     }
-    else
+    if (git && ((args.count > 0U) || (files_from != NULL)))
     {
-        in_stream = stdin;
+        fprintf(stderr, "Error: files not allowed with --git-diff/--staged!\n");
+        show_usage();
+        exit(RETURN_ERROR_OPTIONS);
+    }
+    if ((watch_dir != NULL) && (fix || unpack || (format == FORMAT_SARIF)))
+    {
+        fprintf(stderr,
+                "Error: --watch not allowed with --fix, --archives or SARIF!\n");
+        show_usage();
+        exit(RETURN_ERROR_OPTIONS);
+    }
+    if (fix && (git || ((args.count == 0U) && (files_from == NULL))))
+    {
+        fprintf(stderr, "Error: --fix needs files in the working tree!\n");
+        show_usage();
+        exit(RETURN_ERROR_OPTIONS);
     }
 
-    char* data = NULL;
-    size_t total_size = 0U;
-    size_t bytes_read;
-    char buf[CHUNK_SIZE + 1U];
-    while ((bytes_read = fread(buf, sizeof(char), CHUNK_SIZE, in_stream)) > 0U)
+    /* watched before the first run, so changes meanwhile are not missed */
+    watch_t* watch = NULL;
+    if ((watch_dir != NULL) && ((watch = watch_open(watch_dir, exts)) == NULL))
+    {
+        fprintf(stderr, "Error: Failed to watch directory '%s'!\n", watch_dir);
+        exit(RETURN_ERROR_INPUT);
+    }
+
+    int result = RETURN_VALID;
+    bool multi = (args.count > 1U) || (files_from != NULL) || git;
+    /* directories are searched for archives as well, members are filtered */
+    char* walk_exts = NULL;
+    if (unpack && (exts != NULL))
     {
-        buf[bytes_read] = '\0';
-        data = realloc(data, total_size + bytes_read + 1U);
-        if (data == NULL)
+        size_t len = strlen(exts);
+        if ((walk_exts = malloc(len + sizeof("," ARCHIVE_EXTS))) == NULL)
         {
-            fprintf(stderr, "Error: Memory allocation failed!\n");
-            if (file != NULL)
+            out_of_memory();
+        }
+        memcpy(walk_exts, exts, len);
+        memcpy(walk_exts + len, "," ARCHIVE_EXTS, sizeof("," ARCHIVE_EXTS));
+    }
+    file_list_t inputs;
+    file_list_init(&inputs);
+    for (size_t i = 0U; i < args.count; i++)
+    {
+        if (is_directory(args.paths[i]))
+        {
+            multi = true;
+            if (!file_list_walk(&inputs, args.paths[i],
+                                (walk_exts != NULL) ? walk_exts : exts))
             {
-                fclose(in_stream);
+                result = RETURN_ERROR_INPUT;
             }
-            exit(RETURN_ERROR_UNSPECIFIC);
         }
-        memcpy(data + total_size, buf, bytes_read);
-        total_size += bytes_read;
+        else if (!file_list_add(&inputs, args.paths[i]))
+        {
+            out_of_memory();
+        }
     }
+    file_list_free(&args);
 
-    if (file != NULL)
+    if (files_from != NULL)
     {
-        fclose(in_stream);
+        FILE* list = stdin;
+        if ((strcmp(files_from, "-") != 0)
+            && ((list = fopen(files_from, "rb")) == NULL))
+        {
+            fprintf(stderr, "Error: Failed to open file '%s'!\n", files_from);
+            exit(RETURN_ERROR_INPUT);
+        }
+        if (!file_list_read(&inputs, list, delim))
+        {
+            fprintf(stderr, "Error: Failed to read file list '%s'!\n",
+                    files_from);
+            result = RETURN_ERROR_INPUT;
+        }
+        if (list != stdin)
+        {
+            fclose(list);
+        }
     }
 
-    if (total_size > 0U)
-    {
-        data[total_size] = '\0';
-    }
-    else
+    free(walk_exts);
+
+    /* archives are validated after the files, member by member */
+    file_list_t archives;
+    file_list_init(&archives);
+    if (unpack && !git)
     {
-        if (verbose)
+        file_list_t files_only;
+        file_list_init(&files_only);
+        for (size_t i = 0U; i < inputs.count; i++)
         {
-            printf("Empty input/file.\n");
+            const char* path = inputs.paths[i];
+            bool archive = (strcmp(path, "-") != 0)
+                           && has_extension(path, ARCHIVE_EXTS);
+            if (!file_list_add(archive ? &archives : &files_only, path))
+            {
+                out_of_memory();
+            }
         }
-        exit(EXIT_SUCCESS);
+        file_list_free(&inputs);
+        inputs = files_only;
+        multi = multi || (archives.count > 0U);
+    }
+    if (fix && (archives.count > 0U))
+    {
+        fprintf(stderr, "Error: --fix cannot rewrite archives!\n");
+        show_usage();
+        exit(RETURN_ERROR_OPTIONS);
     }
 
-    /* If NA is given, the EOL shall be determined automatically */
-    eol_t e = eol;
-    if (eol == EOL_AUTO_NA)
+    git_changes_t changes;
+    git_changes_init(&changes);
+    if (git && !git_changes_read(&changes, staged ? NULL : git_rev, exts))
     {
-        e = determine_eol(data);
+        fprintf(stderr, "Error: Failed to get changed files from git!\n");
+        exit(RETURN_ERROR_INPUT);
     }
 
-    unsigned int result = validate_eol(data, e);
-    if (result != 0U)
+    /* compile the character options once, each worker gets a copy */
+    base.eol = eol;
+    base.utf8 = utf8;
+    base.context = lexer;
+    base.range_count = range_count;
+    memcpy(base.valid_chars, valid_chars, sizeof(base.valid_chars));
+    memcpy(base.ranges, ranges, sizeof(base.ranges));
+    policies_t* policies = policies_create(&base, first || quiet, backend);
+    if (policies == NULL)
     {
-        if (verbose)
-        {
-            fprintf(stderr,
-                    "Error: Unexpected end-of-line indicator in line %u!\n",
-                    result);
-        }
-        free(data);
-        exit(RETURN_ERROR_EOL);
+        out_of_memory();
     }
 
-    unsigned int line = 1U;
-    unsigned int last_line = 0U;
-    unsigned int errors = 0U;
-    for (char* p = data; *p != '\0'; p++)
+    /*
+     * Files are resolved up front, each distinct policy is compiled once.
+     * Archives follow the files, their members get the policy of the archive.
+     */
+    const file_list_t* files = git ? &changes.paths : &inputs;
+    size_t slots = files->count + archives.count;
+    size_t* policy_of = NULL;
+    if (use_cvcrc && (slots > 0U))
     {
-        if (is_eol(p, e))
+        if ((policy_of = calloc(slots, sizeof(size_t))) == NULL)
         {
-            if (e == EOL_CRLF)
-            {
-                p++; /* skip the second EOL character */
-            }
-            if (last_line == line)
-            {
-                putchar('\n');
-            }
-            line++;
+            out_of_memory();
         }
-        else if ((*p < 0) || (*p > 126) || (!valid_chars[(int)*p]))
+        for (size_t i = 0U; i < slots; i++)
         {
-            if (verbose)
+            const char* path = (i < files->count)
+                               ? files->paths[i]
+                               : archives.paths[i - files->count];
+            if ((strcmp(path, "-") != 0)
+                && !policies_resolve(policies, path, &policy_of[i]))
             {
-                if (line != last_line)
-                {
-                    printf("line %u:", line);
-                    last_line = line;
-                }
-                printf(" 0x%02X (%c)", (unsigned char)*p, *p);
+                exit(RETURN_ERROR_OPTIONS);
             }
-            errors++;
         }
+        if (policies_count(policies) == 1U)
+        {
+            free(policy_of);
+            policy_of = NULL;
+        }
+    }
+
+    cache_t* cache = NULL;
+    if ((cache_dir != NULL)
+        && ((cache = cache_open(cache_dir, git ? changes.paths.count
+                                                : inputs.count)) == NULL))
+    {
+        fprintf(stderr, "Error: Failed to open cache '%s'!\n", cache_dir);
+        exit(RETURN_ERROR_INPUT);
     }
 
-    free(data);
+    if (quiet)
+    {
+        format = FORMAT_TEXT;
+    }
+    /* with the cache, most files are not read at all */
+    prefetch_t* prefetch = NULL;
+    if (!git && (cache == NULL) && (inputs.count > 1U))
+    {
+        prefetch = prefetch_start(inputs.paths, inputs.count);
+    }
+    stats_t* thread_stats = NULL;
+    if (show_stats && ((thread_stats = calloc(jobs, sizeof(stats_t))) == NULL))
+    {
+        out_of_memory();
+    }
+    const config_t cfg =
+    {
+        .policy = policies_get(policies, 0U),
+        .policies = policies,
+        .policy_of = policy_of,
+        .verbose = verbose && !quiet && (format == FORMAT_TEXT),
+        .details = (verbose && !quiet) || (format != FORMAT_TEXT),
+        .format = format,
+        .multi = multi,
+        .first = first || quiet,
+        .quiet = quiet,
+        .fail_fast = fail_fast,
+        .fix = fix,
+        .escape = escape,
+        .mmap = use_mmap,
+        .segments = segments_per_worker((verbose && !quiet)
+                                        || (format != FORMAT_TEXT),
+                                        jobs, inputs.count),
+        .cache = cache,
+        .prefetch = prefetch,
+        .stats = thread_stats
+    };
 
-    printf("%u\n", errors);
+    totals_t totals = {.result = result, .errors = 0UL, .files = 0UL};
+    report_t out;
+    report_init(&out, stdout);
+    format_begin(&out, format, VERSION);
+    report_flush(&out, stdout);
+    unsigned int watch_jobs = jobs;
+    if (jobs > inputs.count)
+    {
+        jobs = (unsigned int)inputs.count;
+    }
+    uint64_t started = stats_clock();
+    unsigned int threads = 1U; /* that validated files */
+    if (git)
+    {
+        validate_git(&changes, &cfg, &totals);
+    }
+    else if ((inputs.count == 0U) && (archives.count > 0U))
+    {
+        /* only archives, standard input is not read */
+    }
+    else if ((jobs > 1U) && validate_parallel(&inputs, &cfg, jobs, &totals))
+    {
+        threads = jobs;
+    }
+    else
+    {
+        validate_sequential(&inputs, &cfg, &totals);
+    }
+    if ((archives.count > 0U)
+        && !(fail_fast && (totals.result != RETURN_VALID)))
+    {
+        validate_archives(&archives, inputs.count, exts, &cfg, &totals);
+    }
+    if (prefetch != NULL)
+    {
+        prefetch_stop(prefetch);
+    }
+    result = totals.result;
+    if (multi && !quiet && (format == FORMAT_TEXT))
+    {
+        printf("%lu total\n", totals.errors);
+    }
+    format_end(&out, format, totals.files, totals.errors, result);
+    report_flush(&out, stdout);
+    report_free(&out);
+    if (show_stats)
+    {
+        fflush(stdout);
+        stats_print(stderr, stats_json,
+                    simd_backend_name((cfg.policy->table.simd.skip != NULL)
+                                      ? backend : SIMD_NONE),
+                    thread_stats, threads, &totals.stats,
+                    stats_clock() - started);
+        free(thread_stats);
+    }
+    if ((cache != NULL) && !cache_close(cache))
+    {
+        fprintf(stderr, "Error: Failed to write cache '%s'!\n", cache_dir);
+        if (result < RETURN_ERROR_UNSPECIFIC)
+        {
+            result = RETURN_ERROR_UNSPECIFIC;
+        }
+    }
+    if (watch != NULL)
+    {
+        fflush(stdout);
+        result = validate_watch(watch, &cfg, policies, cache_dir, use_cvcrc,
+                                watch_jobs, result);
+        watch_close(watch);
+    }
+    policies_free(policies);
+    free(policy_of);
+    git_changes_free(&changes);
+    file_list_free(&inputs);
+    file_list_free(&archives);
 
-    return (errors == 0U) ? RETURN_VALID : RETURN_INVALID;
+    return result;
 }
@@ -0,0 +1,236 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#include "match.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MATCH_NONE  (0xFFFFU) /* no transition in the trie (yet) */
+
+struct match
+{
+    uint8_t cls[256];    /* class of each byte, 0 if in no pattern */
+    bool start[256];     /* whether a pattern starts with the byte */
+    unsigned int classes;
+    unsigned int states;
+    uint16_t* next;      /* states x classes */
+    uint16_t* output;    /* per state, longest pattern ending there + 1 */
+    simd_set_t first;    /* bytes that start a pattern are suspicious */
+    unsigned int count;
+    char* bytes;         /* all patterns, one after the other */
+    size_t* offsets;     /* of pattern i in bytes, count + 1 entries */
+};
+
+void
+match_free(match_t* m)
+{
+    if (m == NULL)
+    {
+        return;
+    }
+    free(m->next);
+    free(m->output);
+    free(m->bytes);
+    free(m->offsets);
+    free(m);
+}
+
+/* Completes the trie to the DFA, in breadth-first order of the states. */
+static bool
+build_dfa(match_t* m)
+{
+    unsigned int c_count = m->classes;
+    uint16_t* fail = malloc(m->states * sizeof(uint16_t));
+    uint16_t* queue = malloc(m->states * sizeof(uint16_t));
+    if ((fail == NULL) || (queue == NULL))
+    {
+        free(fail);
+        free(queue);
+        return false;
+    }
+
+    size_t head = 0U;
+    size_t tail = 0U;
+    for (unsigned int c = 0U; c < c_count; c++)
+    {
+        uint16_t child = m->next[c];
+        if (child == MATCH_NONE)
+        {
+            m->next[c] = MATCH_ROOT;
+        }
+        else
+        {
+            fail[child] = MATCH_ROOT;
+            queue[tail++] = child;
+        }
+    }
+    while (head < tail)
+    {
+        uint16_t state = queue[head++];
+        const uint16_t* fallback = &m->next[(size_t)fail[state] * c_count];
+        if (m->output[state] == 0U)
+        {
+            m->output[state] = m->output[fail[state]]; /* a suffix of it */
+        }
+        for (unsigned int c = 0U; c < c_count; c++)
+        {
+            uint16_t* to = &m->next[((size_t)state * c_count) + c];
+            if (*to == MATCH_NONE)
+            {
+                *to = fallback[c];
+            }
+            else
+            {
+                fail[*to] = fallback[c];
+                queue[tail++] = *to;
+            }
+        }
+    }
+    free(fail);
+    free(queue);
+
+    return true;
+}
+
+match_t*
+match_build(const char* const* patterns, const size_t* lengths,
+            unsigned int count, simd_backend_t backend)
+{
+    size_t total = 0U;
+    for (unsigned int i = 0U; i < count; i++)
+    {
+        total += lengths[i];
+    }
+    if ((total + 1U) >= MATCH_NONE)
+    {
+        return NULL;
+    }
+
+    match_t* m = calloc(1U, sizeof(match_t));
+    if (m == NULL)
+    {
+        return NULL;
+    }
+    m->count = count;
+    m->classes = 1U;
+    for (unsigned int i = 0U; i < count; i++)
+    {
+        for (size_t k = 0U; k < lengths[i]; k++)
+        {
+            unsigned char b = (unsigned char)patterns[i][k];
+            if (m->cls[b] == 0U)
+            {
+                m->cls[b] = (uint8_t)m->classes++;
+            }
+        }
+        if (lengths[i] > 0U)
+        {
+            m->start[(unsigned char)patterns[i][0]] = true;
+        }
+    }
+
+    size_t max_states = total + 1U;
+    m->next = malloc(max_states * m->classes * sizeof(uint16_t));
+    m->output = calloc(max_states, sizeof(uint16_t));
+    m->bytes = malloc((total > 0U) ? total : 1U);
+    m->offsets = malloc((count + 1U) * sizeof(size_t));
+    if ((m->next == NULL) || (m->output == NULL) || (m->bytes == NULL)
+        || (m->offsets == NULL))
+    {
+        match_free(m);
+        return NULL;
+    }
+    memset(m->next, 0xFF, max_states * m->classes * sizeof(uint16_t));
+
+    m->states = 1U;
+    size_t offset = 0U;
+    for (unsigned int i = 0U; i < count; i++)
+    {
+        uint16_t state = MATCH_ROOT;
+        for (size_t k = 0U; k < lengths[i]; k++)
+        {
+            uint16_t* to = &m->next[((size_t)state * m->classes)
+                                    + m->cls[(unsigned char)patterns[i][k]]];
+            if (*to == MATCH_NONE)
+            {
+                *to = (uint16_t)m->states++;
+            }
+            state = *to;
+        }
+        if ((state != MATCH_ROOT) && (m->output[state] == 0U))
+        {
+            m->output[state] = (uint16_t)(i + 1U); /* the first of duplicates */
+        }
+        memcpy(m->bytes + offset, patterns[i], lengths[i]);
+        m->offsets[i] = offset;
+        offset += lengths[i];
+    }
+    m->offsets[count] = offset;
+    if (!build_dfa(m))
+    {
+        match_free(m);
+        return NULL;
+    }
+
+    bool valid[256];
+    for (unsigned int b = 0U; b < 256U; b++)
+    {
+        valid[b] = !m->start[b];
+    }
+    simd_set_build(&m->first, valid, backend);
+
+    return m;
+}
+
+const char*
+match_next(const match_t* m, unsigned int* state, const char* p,
+           const char* end, unsigned int* pattern)
+{
+    unsigned int s = *state;
+
+    while (p < end)
+    {
+        if (s == MATCH_ROOT)
+        {
+            if (m->first.find != NULL)
+            {
+                p += m->first.find(&m->first, p, (size_t)(end - p));
+            }
+            while ((p < end) && !m->start[(unsigned char)*p])
+            {
+                p++;
+            }
+            if (p == end)
+            {
+                break;
+            }
+        }
+        s = m->next[((size_t)s * m->classes) + m->cls[(unsigned char)*p]];
+        if (m->output[s] != 0U)
+        {
+            *state = s;
+            *pattern = m->output[s] - 1U;
+            return p;
+        }
+        p++;
+    }
+    *state = s;
+
+    return end;
+}
+
+const char*
+match_pattern(const match_t* m, unsigned int pattern, size_t* length)
+{
+    *length = m->offsets[pattern + 1U] - m->offsets[pattern];
+
+    return m->bytes + m->offsets[pattern];
+}
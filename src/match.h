@@ -0,0 +1,52 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_MATCH_H
+#define CVC_MATCH_H
+
+#include "simd.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MATCH_PATTERN_MAX   (64U) /* bytes of a pattern */
+#define MATCH_ROOT          (0U)  /* state between matches */
+
+/*
+ * Multi-pattern matcher for forbidden byte sequences: an Aho-Corasick
+ * automaton compiled to a DFA over classes of bytes, the bytes that occur in
+ * no pattern sharing one class. The state is kept by the caller, so input can
+ * be fed in chunks and matches span them. At the root, bytes that start no
+ * pattern are passed by the SIMD kernel in whole blocks, then one by one.
+ * Patterns must not contain CR or LF, so the automaton is at its root behind
+ * every EOL indicator.
+ */
+typedef struct match match_t;
+
+/* Returns NULL if out of memory. */
+match_t*
+match_build(const char* const* patterns, const size_t* lengths,
+            unsigned int count, simd_backend_t backend);
+
+void
+match_free(match_t* m);
+
+/*
+ * Runs the automaton from *state over p up to end. Returns the position of
+ * the last byte of the first match, with *pattern set to the longest one
+ * that ends there, or end if there is none. To go on, pass the byte behind.
+ */
+const char*
+match_next(const match_t* m, unsigned int* state, const char* p,
+           const char* end, unsigned int* pattern);
+
+const char*
+match_pattern(const match_t* m, unsigned int pattern, size_t* length);
+
+#endif /* CVC_MATCH_H */
@@ -0,0 +1,867 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "policy.h"
+
+#include "cache.h"
+#include "files.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DIRS_INITIAL_CAPACITY   (64U) /* power of two */
+
+typedef struct
+{
+    size_t section; /* 0 at the top, else index into sections + 1 */
+    char* key;
+    char* value;
+} rule_t;
+
+/* A parsed policy file. */
+typedef struct
+{
+    rule_t* rules;
+    size_t count;
+    char** sections; /* extensions as given to has_extension() */
+    size_t section_count;
+    bool root;       /* directories above are not looked at */
+} rc_t;
+
+typedef struct
+{
+    char* ext; /* "" for files without one */
+    size_t index;
+} memo_t;
+
+typedef struct
+{
+    char* path;    /* as it prefixes the paths of its files, "" for ./ */
+    uint64_t hash;
+    bool present;  /* it has a policy file */
+    bool failed;   /* which could not be read */
+    rc_t rc;
+    memo_t* memo;  /* policies of its files by extension */
+    size_t memo_count;
+} dir_t;
+
+struct policies
+{
+    policy_t base;
+    bool first;
+    simd_backend_t backend;
+    policy_tables_t** tables;
+    uint64_t* keys;    /* fingerprints of the policies the tables are of */
+    size_t count;
+    dir_t** dirs;      /* open addressing, at most half full */
+    size_t dir_capacity;
+    size_t dir_count;
+};
+
+static int
+hex_digit(char c)
+{
+    if ((c >= '0') && (c <= '9'))
+    {
+        return c - '0';
+    }
+    if ((c >= 'A') && (c <= 'F'))
+    {
+        return c - 'A' + 10;
+    }
+    if ((c >= 'a') && (c <= 'f'))
+    {
+        return c - 'a' + 10;
+    }
+
+    return -1;
+}
+
+/* Decodes seq as given to policy_forbid() into buf of MATCH_PATTERN_MAX. */
+static bool
+decode(const char* seq, char* buf, size_t* len)
+{
+    size_t n = 0U;
+
+    for (const char* c = seq; *c != '\0'; c++)
+    {
+        char b = *c;
+        if (b == '\\')
+        {
+            int hi = (c[1] == 'x') ? hex_digit(c[2]) : -1;
+            int lo = (hi >= 0) ? hex_digit(c[3]) : -1;
+            if (c[1] == '\\')
+            {
+                c++;
+            }
+            else if (lo >= 0)
+            {
+                b = (char)((hi << 4) | lo);
+                c += 3;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        if ((n == MATCH_PATTERN_MAX) || (b == '\r') || (b == '\n'))
+        {
+            return false;
+        }
+        buf[n++] = b;
+    }
+    *len = n;
+
+    return true;
+}
+
+bool
+policy_forbid(policy_t* p, const char* seq)
+{
+    char buf[MATCH_PATTERN_MAX];
+    size_t len;
+
+    if (*seq == '\0')
+    {
+        p->forbid_count = 0U;
+        return true;
+    }
+    if (!decode(seq, buf, &len) || (p->forbid_count == POLICY_FORBID_MAX))
+    {
+        return false;
+    }
+    p->forbid[p->forbid_count++] = seq;
+
+    return true;
+}
+
+size_t
+policy_sequence(const policy_t* p, unsigned int i, char* buf)
+{
+    size_t len;
+
+    (void)decode(p->forbid[i], buf, &len); /* checked by policy_forbid() */
+
+    return len;
+}
+
+/* Builds the matcher of the forbidden sequences, if there are any. */
+static bool
+compile_forbid(policy_tables_t* t, const policy_t* p, simd_backend_t backend,
+               cache_hash_t* h)
+{
+    char bytes[POLICY_FORBID_MAX][MATCH_PATTERN_MAX];
+    const char* patterns[POLICY_FORBID_MAX];
+    size_t lengths[POLICY_FORBID_MAX];
+
+    t->match = NULL;
+    if (p->forbid_count == 0U)
+    {
+        return true;
+    }
+    for (unsigned int i = 0U; i < p->forbid_count; i++)
+    {
+        lengths[i] = policy_sequence(p, i, bytes[i]);
+        patterns[i] = bytes[i];
+        const uint64_t len = lengths[i];
+        cache_hash_update(h, &len, sizeof(len));
+        cache_hash_update(h, bytes[i], lengths[i]);
+    }
+    t->match = match_build(patterns, lengths, p->forbid_count, backend);
+
+    return (t->match != NULL);
+}
+
+void
+policy_tables_free(policy_tables_t* t)
+{
+    match_free(t->match);
+    t->match = NULL;
+}
+
+bool
+policy_compile(policy_tables_t* t, const policy_t* p, bool first,
+               simd_backend_t backend)
+{
+    char_table_build(&t->table, p->valid_chars, backend);
+    if (p->utf8)
+    {
+        char_table_set_utf8(&t->table, p->ranges, p->range_count);
+    }
+    t->context = p->context;
+    t->eol = p->eol;
+    if (p->context)
+    {
+        /* comments and literals may use all printable ASCII characters */
+        bool extended_chars[CHAR_TABLE_SIZE];
+        memcpy(extended_chars, p->valid_chars, sizeof(extended_chars));
+        for (unsigned int c = 0x20U; c < MAX_VALID_CHAR; c++)
+        {
+            extended_chars[c] = true;
+        }
+        lex_table_build(&t->lex, p->valid_chars, extended_chars, p->utf8,
+                        p->ranges, p->range_count, backend);
+    }
+
+    /*
+     * Cached results depend on the character classes, EOL and --first, and
+     * on the ranges in UTF-8 mode, the classes of comments and literals and
+     * the forbidden sequences.
+     */
+    uint8_t classes[CHAR_TABLE_SIZE + 2U];
+    memcpy(classes, t->table.cls, CHAR_TABLE_SIZE);
+    classes[CHAR_TABLE_SIZE] = (uint8_t)p->eol;
+    classes[CHAR_TABLE_SIZE + 1U] = (uint8_t)first;
+    cache_hash_t h;
+    cache_hash_init(&h);
+    cache_hash_update(&h, classes, sizeof(classes));
+    if (p->context)
+    {
+        cache_hash_update(&h, t->lex.contexts[LEX_CONTEXT_COMMENT].cls,
+                          CHAR_TABLE_SIZE);
+    }
+    for (unsigned int i = 0U; i < t->table.range_count; i++)
+    {
+        const uint32_t range[2] = {t->table.ranges[i].first,
+                                   t->table.ranges[i].last};
+        cache_hash_update(&h, range, sizeof(range));
+    }
+    bool ok = compile_forbid(t, p, backend, &h);
+    t->fingerprint = cache_hash_final(&h);
+
+    return ok;
+}
+
+/* Identifies a policy by what it sets, before it is compiled. */
+static uint64_t
+policy_key(const policy_t* p)
+{
+    const uint8_t flags[3] = {(uint8_t)p->eol, (uint8_t)p->utf8,
+                              (uint8_t)p->context};
+    cache_hash_t h;
+    cache_hash_init(&h);
+    cache_hash_update(&h, p->valid_chars, sizeof(p->valid_chars));
+    cache_hash_update(&h, flags, sizeof(flags));
+    for (unsigned int i = 0U; p->utf8 && (i < p->range_count); i++)
+    {
+        const uint32_t range[2] = {p->ranges[i].first, p->ranges[i].last};
+        cache_hash_update(&h, range, sizeof(range));
+    }
+    for (unsigned int i = 0U; i < p->forbid_count; i++)
+    {
+        cache_hash_update(&h, p->forbid[i], strlen(p->forbid[i]) + 1U);
+    }
+
+    return cache_hash_final(&h);
+}
+
+static bool
+parse_bool(const char* value, bool* b)
+{
+    if (strcmp(value, "true") == 0)
+    {
+        *b = true;
+        return true;
+    }
+    if (strcmp(value, "false") == 0)
+    {
+        *b = false;
+        return true;
+    }
+
+    return false;
+}
+
+/* Bytes in hex as code points, e.g. "0C,24,40,60" or "80-FF". */
+static bool
+parse_bytes(const char* value, bool* valid_chars, bool valid)
+{
+    utf8_range_t ranges[UTF8_RANGES_MAX];
+    unsigned int count;
+    if (!utf8_ranges_parse(value, ranges, UTF8_RANGES_MAX, &count))
+    {
+        return false;
+    }
+    for (unsigned int i = 0U; i < count; i++)
+    {
+        if (ranges[i].last >= CHAR_TABLE_SIZE)
+        {
+            return false;
+        }
+    }
+    for (unsigned int i = 0U; i < count; i++)
+    {
+        for (uint32_t c = ranges[i].first; c <= ranges[i].last; c++)
+        {
+            valid_chars[c] = valid;
+        }
+    }
+    /* end-of-line indicators are checked on their own */
+    valid_chars['\n'] = true;
+    valid_chars['\r'] = true;
+
+    return true;
+}
+
+/* Applies key = value of a policy file to p. */
+static bool
+apply_rule(policy_t* p, const char* key, const char* value)
+{
+    if (strcmp(key, "allow") == 0)
+    {
+        return parse_bytes(value, p->valid_chars, true);
+    }
+    if (strcmp(key, "deny") == 0)
+    {
+        return parse_bytes(value, p->valid_chars, false);
+    }
+    if (strcmp(key, "utf8") == 0)
+    {
+        return parse_bool(value, &p->utf8);
+    }
+    if (strcmp(key, "unicode") == 0)
+    {
+        /* as --unicode, which implies --utf8 */
+        p->utf8 = true;
+        return utf8_ranges_parse(value, p->ranges, UTF8_RANGES_MAX,
+                                 &p->range_count);
+    }
+    if (strcmp(key, "context") == 0)
+    {
+        return parse_bool(value, &p->context);
+    }
+    if (strcmp(key, "forbid") == 0)
+    {
+        return policy_forbid(p, value);
+    }
+    if (strcmp(key, "eol") == 0)
+    {
+        static const struct
+        {
+            const char* name;
+            eol_t eol;
+        } eols[] =
+        {
+            {"LF", EOL_LF}, {"CRLF", EOL_CRLF}, {"CR", EOL_CR},
+            {"AUTO", EOL_AUTO_NA}
+        };
+        for (size_t i = 0U; i < (sizeof(eols) / sizeof(eols[0])); i++)
+        {
+            if (strcmp(value, eols[i].name) == 0)
+            {
+                p->eol = eols[i].eol;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static char*
+trim(char* s)
+{
+    while ((*s == ' ') || (*s == '\t'))
+    {
+        s++;
+    }
+    size_t len = strlen(s);
+    while ((len > 0U) && ((s[len - 1U] == ' ') || (s[len - 1U] == '\t')
+                          || (s[len - 1U] == '\r') || (s[len - 1U] == '\n')))
+    {
+        s[--len] = '\0';
+    }
+
+    return s;
+}
+
+static void
+rc_free(rc_t* rc)
+{
+    for (size_t i = 0U; i < rc->count; i++)
+    {
+        free(rc->rules[i].key);
+        free(rc->rules[i].value);
+    }
+    for (size_t i = 0U; i < rc->section_count; i++)
+    {
+        free(rc->sections[i]);
+    }
+    free(rc->rules);
+    free(rc->sections);
+}
+
+static bool
+rc_add_rule(rc_t* rc, const char* key, const char* value)
+{
+    rule_t* rules = realloc(rc->rules, (rc->count + 1U) * sizeof(rule_t));
+    if (rules == NULL)
+    {
+        return false;
+    }
+    rc->rules = rules;
+    rule_t* r = &rc->rules[rc->count];
+    r->section = rc->section_count;
+    r->key = strdup(key);
+    r->value = strdup(value);
+    if ((r->key == NULL) || (r->value == NULL))
+    {
+        free(r->key);
+        free(r->value);
+        return false;
+    }
+    rc->count++;
+
+    return true;
+}
+
+/* A section header such as "[c, h]", spaces are dropped. */
+static bool
+rc_add_section(rc_t* rc, const char* header)
+{
+    char** sections = realloc(rc->sections,
+                              (rc->section_count + 1U) * sizeof(char*));
+    if (sections == NULL)
+    {
+        return false;
+    }
+    rc->sections = sections;
+    char* exts = malloc(strlen(header) + 1U);
+    if (exts == NULL)
+    {
+        return false;
+    }
+    size_t len = 0U;
+    for (const char* c = header; *c != '\0'; c++)
+    {
+        if ((*c != ' ') && (*c != '\t'))
+        {
+            exts[len++] = *c;
+        }
+    }
+    exts[len] = '\0';
+    rc->sections[rc->section_count++] = exts;
+
+    return true;
+}
+
+/*
+ * Parses all lines of stream into rc, each rule checked against a scratch
+ * policy. Sets *line to the first malformed one, 0 if out of memory.
+ */
+static bool
+rc_parse(rc_t* rc, FILE* stream, const policy_t* base, unsigned int* line)
+{
+    policy_t scratch = *base;
+    char* buf = NULL;
+    size_t size = 0U;
+    bool valid = true;
+    bool ok = true;
+    unsigned int n = 0U;
+
+    while (valid && ok && (getline(&buf, &size, stream) != -1))
+    {
+        char* s = trim(buf);
+        size_t len = strlen(s);
+        char* eq = strchr(s, '=');
+        n++;
+        if ((*s == '\0') || (*s == '#') || (*s == ';'))
+        {
+            continue;
+        }
+        if ((s[0] == '[') && (s[len - 1U] == ']'))
+        {
+            s[len - 1U] = '\0';
+            char* header = trim(s + 1);
+            valid = (*header != '\0');
+            ok = !valid || rc_add_section(rc, header);
+        }
+        else if (eq == NULL)
+        {
+            valid = false;
+        }
+        else
+        {
+            *eq = '\0';
+            char* key = trim(s);
+            char* value = trim(eq + 1);
+            if (strcmp(key, "root") == 0)
+            {
+                /* only meaningful for the file as a whole */
+                valid = (rc->section_count == 0U) && parse_bool(value, &rc->root);
+            }
+            else
+            {
+                valid = apply_rule(&scratch, key, value);
+                ok = !valid || rc_add_rule(rc, key, value);
+            }
+        }
+    }
+    free(buf);
+    *line = valid ? 0U : n;
+
+    return valid && ok && !ferror(stream);
+}
+
+/* Reads the policy file of d, if it has one. */
+static bool
+dir_load(dir_t* d, const policy_t* base)
+{
+    size_t len = strlen(d->path);
+    char* path = malloc(len + sizeof("/" POLICY_FILE_NAME));
+    if (path == NULL)
+    {
+        fprintf(stderr, "Error: Memory allocation failed!\n");
+        return false;
+    }
+    if (len == 0U)
+    {
+        strcpy(path, POLICY_FILE_NAME);
+    }
+    else
+    {
+        strcpy(path, d->path);
+        strcpy(path + len, (d->path[len - 1U] == '/') ? POLICY_FILE_NAME
+                                                      : ("/" POLICY_FILE_NAME));
+    }
+
+    FILE* stream = fopen(path, "rb");
+    if (stream == NULL)
+    {
+        bool missing = (errno == ENOENT) || (errno == ENOTDIR);
+        if (!missing)
+        {
+            d->failed = true;
+            fprintf(stderr, "Error: Failed to read policy file '%s'!\n", path);
+        }
+        free(path);
+        return missing;
+    }
+
+    unsigned int line;
+    bool ok = rc_parse(&d->rc, stream, base, &line);
+    fclose(stream);
+    if (!ok && (line > 0U))
+    {
+        fprintf(stderr, "Error: Invalid line %u in policy file '%s'!\n", line,
+                path);
+    }
+    else if (!ok)
+    {
+        fprintf(stderr, "Error: Failed to read policy file '%s'!\n", path);
+    }
+    d->present = ok;
+    d->failed = !ok;
+    free(path);
+
+    return ok;
+}
+
+static void
+dir_free(dir_t* d)
+{
+    rc_free(&d->rc);
+    for (size_t i = 0U; i < d->memo_count; i++)
+    {
+        free(d->memo[i].ext);
+    }
+    free(d->memo);
+    free(d->path);
+    free(d);
+}
+
+static bool
+dirs_grow(policies_t* ps)
+{
+    size_t capacity = (ps->dir_capacity == 0U) ? DIRS_INITIAL_CAPACITY
+                                               : (ps->dir_capacity * 2U);
+    dir_t** dirs = calloc(capacity, sizeof(dir_t*));
+    if (dirs == NULL)
+    {
+        return false;
+    }
+    for (size_t i = 0U; i < ps->dir_capacity; i++)
+    {
+        dir_t* d = ps->dirs[i];
+        if (d != NULL)
+        {
+            size_t slot = (size_t)d->hash & (capacity - 1U);
+            while (dirs[slot] != NULL)
+            {
+                slot = (slot + 1U) & (capacity - 1U);
+            }
+            dirs[slot] = d;
+        }
+    }
+    free(ps->dirs);
+    ps->dirs = dirs;
+    ps->dir_capacity = capacity;
+
+    return true;
+}
+
+/* Finds the directory given by path[0..len-1], loading it on first use. */
+static dir_t*
+dir_get(policies_t* ps, const char* path, size_t len)
+{
+    if ((len == 1U) && (path[0] == '.'))
+    {
+        len = 0U; /* same as no directory at all */
+    }
+    uint64_t hash = cache_hash(path, len);
+    if ((2U * (ps->dir_count + 1U)) > ps->dir_capacity)
+    {
+        if (!dirs_grow(ps))
+        {
+            fprintf(stderr, "Error: Memory allocation failed!\n");
+            return NULL;
+        }
+    }
+
+    size_t mask = ps->dir_capacity - 1U;
+    size_t slot = (size_t)hash & mask;
+    for (dir_t* d = ps->dirs[slot]; d != NULL; d = ps->dirs[slot])
+    {
+        if ((d->hash == hash) && (strlen(d->path) == len)
+            && (memcmp(d->path, path, len) == 0))
+        {
+            return d->failed ? NULL : d;
+        }
+        slot = (slot + 1U) & mask;
+    }
+
+    dir_t* d = calloc(1U, sizeof(dir_t));
+    if ((d == NULL) || ((d->path = malloc(len + 1U)) == NULL))
+    {
+        free(d);
+        fprintf(stderr, "Error: Memory allocation failed!\n");
+        return NULL;
+    }
+    memcpy(d->path, path, len);
+    d->path[len] = '\0';
+    d->hash = hash;
+    ps->dirs[slot] = d;
+    ps->dir_count++;
+    if (!dir_load(d, &ps->base))
+    {
+        return NULL;
+    }
+
+    return d;
+}
+
+/* Length of the parent of the directory path[0..len-1], false if none. */
+static bool
+dir_parent(const char* path, size_t len, size_t* parent)
+{
+    if ((len == 0U) || ((len == 1U) && (path[0] == '/')))
+    {
+        return false;
+    }
+    size_t last = len;
+    while ((last > 0U) && (path[last - 1U] != '/'))
+    {
+        last--;
+    }
+    /* lexically, the parent of ".." is not known */
+    if (((len - last) == 2U) && (path[last] == '.') && (path[last + 1U] == '.'))
+    {
+        return false;
+    }
+    *parent = (last == 1U) ? 1U : ((last > 0U) ? (last - 1U) : 0U);
+
+    return true;
+}
+
+/*
+ * Applies the policy files of the directory path[0..len-1] and the ones
+ * above it to p, the outermost first, with the sections of name.
+ */
+static bool
+apply_dirs(policies_t* ps, const char* path, size_t len, const char* name,
+           policy_t* p)
+{
+    dir_t* d = dir_get(ps, path, len);
+    if (d == NULL)
+    {
+        return false;
+    }
+    size_t parent;
+    if (!(d->present && d->rc.root) && dir_parent(path, len, &parent)
+        && !apply_dirs(ps, path, parent, name, p))
+    {
+        return false;
+    }
+
+    for (size_t i = 0U; d->present && (i < d->rc.count); i++)
+    {
+        const rule_t* r = &d->rc.rules[i];
+        if ((r->section == 0U)
+            || has_extension(name, d->rc.sections[r->section - 1U]))
+        {
+            (void)apply_rule(p, r->key, r->value); /* checked when read */
+        }
+    }
+
+    return true;
+}
+
+/* Finds or compiles the tables of p. */
+static bool
+policies_add(policies_t* ps, const policy_t* p, size_t* index)
+{
+    uint64_t key = policy_key(p);
+    for (size_t i = 0U; i < ps->count; i++)
+    {
+        if (ps->keys[i] == key)
+        {
+            *index = i;
+            return true;
+        }
+    }
+
+    policy_tables_t** tables = realloc(ps->tables, (ps->count + 1U)
+                                                   * sizeof(policy_tables_t*));
+    if (tables != NULL)
+    {
+        ps->tables = tables;
+    }
+    uint64_t* keys = realloc(ps->keys, (ps->count + 1U) * sizeof(uint64_t));
+    if (keys != NULL)
+    {
+        ps->keys = keys;
+    }
+    policy_tables_t* t = malloc(sizeof(policy_tables_t));
+    if ((tables == NULL) || (keys == NULL) || (t == NULL))
+    {
+        free(t);
+        return false;
+    }
+    if (!policy_compile(t, p, ps->first, ps->backend))
+    {
+        policy_tables_free(t);
+        free(t);
+        return false;
+    }
+    ps->tables[ps->count] = t;
+    ps->keys[ps->count] = key;
+    *index = ps->count++;
+
+    return true;
+}
+
+policies_t*
+policies_create(const policy_t* base, bool first, simd_backend_t backend)
+{
+    policies_t* ps = calloc(1U, sizeof(policies_t));
+    if (ps == NULL)
+    {
+        return NULL;
+    }
+    ps->base = *base;
+    ps->first = first;
+    ps->backend = backend;
+
+    size_t index;
+    if (!policies_add(ps, base, &index))
+    {
+        policies_free(ps);
+        return NULL;
+    }
+
+    return ps;
+}
+
+bool
+policies_resolve(policies_t* ps, const char* path, size_t* index)
+{
+    const char* slash = strrchr(path, '/');
+    const char* name = (slash != NULL) ? (slash + 1) : path;
+    size_t len = (slash == NULL) ? 0U
+                                 : ((slash == path) ? 1U : (size_t)(slash - path));
+    const char* dot = strrchr(name, '.');
+    const char* ext = ((dot == NULL) || (dot == name)) ? "" : (dot + 1);
+
+    dir_t* d = dir_get(ps, path, len);
+    if (d == NULL)
+    {
+        return false;
+    }
+    for (size_t i = 0U; i < d->memo_count; i++)
+    {
+        if (strcmp(d->memo[i].ext, ext) == 0)
+        {
+            *index = d->memo[i].index;
+            return true;
+        }
+    }
+
+    policy_t p = ps->base;
+    if (!apply_dirs(ps, path, len, name, &p))
+    {
+        return false;
+    }
+    memo_t* memo = realloc(d->memo, (d->memo_count + 1U) * sizeof(memo_t));
+    if (memo != NULL)
+    {
+        d->memo = memo;
+    }
+    char* copy = strdup(ext);
+    if ((memo == NULL) || (copy == NULL) || !policies_add(ps, &p, index))
+    {
+        free(copy);
+        fprintf(stderr, "Error: Memory allocation failed!\n");
+        return false;
+    }
+    d->memo[d->memo_count].ext = copy;
+    d->memo[d->memo_count++].index = *index;
+
+    return true;
+}
+
+size_t
+policies_count(const policies_t* ps)
+{
+    return ps->count;
+}
+
+const policy_tables_t*
+policies_get(const policies_t* ps, size_t index)
+{
+    return ps->tables[index];
+}
+
+void
+policies_free(policies_t* ps)
+{
+    if (ps == NULL)
+    {
+        return;
+    }
+    for (size_t i = 0U; i < ps->dir_capacity; i++)
+    {
+        if (ps->dirs[i] != NULL)
+        {
+            dir_free(ps->dirs[i]);
+        }
+    }
+    for (size_t i = 0U; i < ps->count; i++)
+    {
+        policy_tables_free(ps->tables[i]);
+        free(ps->tables[i]);
+    }
+    free(ps->dirs);
+    free(ps->tables);
+    free(ps->keys);
+    free(ps);
+}
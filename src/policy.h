@@ -0,0 +1,101 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_POLICY_H
+#define CVC_POLICY_H
+
+#include "eol.h"
+#include "lex.h"
+#include "match.h"
+#include "scan.h"
+#include "simd.h"
+#include "utf8.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define POLICY_FILE_NAME  ".cvcrc"
+#define POLICY_FORBID_MAX (64U) /* forbidden sequences of a policy */
+
+/* What files are validated against, as set by the options. */
+typedef struct
+{
+    bool valid_chars[CHAR_TABLE_SIZE];
+    eol_t eol;
+    bool utf8;
+    bool context;  /* comments and literals are told from code */
+    unsigned int range_count;
+    utf8_range_t ranges[UTF8_RANGES_MAX];
+    unsigned int forbid_count;
+    const char* forbid[POLICY_FORBID_MAX]; /* see policy_forbid() */
+} policy_t;
+
+/* A policy compiled for scanning, with the tables of scan and lex. */
+typedef struct
+{
+    char_table_t table;
+    lex_table_t lex;      /* only built with context */
+    bool context;
+    match_t* match;       /* NULL without forbidden sequences */
+    eol_t eol;
+    uint64_t fingerprint; /* of what results depend on, --first included */
+} policy_tables_t;
+
+/*
+ * Adds the forbidden sequence seq, in which \xHH stands for a byte and \\ for
+ * a backslash, up to MATCH_PATTERN_MAX bytes. An empty one removes all added
+ * before. The string has to outlive p. Returns false if seq is malformed,
+ * contains CR or LF, or there are too many.
+ */
+bool
+policy_forbid(policy_t* p, const char* seq);
+
+/* Decodes forbidden sequence i of p into buf of MATCH_PATTERN_MAX bytes. */
+size_t
+policy_sequence(const policy_t* p, unsigned int i, char* buf);
+
+/* Returns false if out of memory. */
+bool
+policy_compile(policy_tables_t* t, const policy_t* p, bool first,
+               simd_backend_t backend);
+
+void
+policy_tables_free(policy_tables_t* t);
+
+/*
+ * Policies of the files of a run. The policy of a file is the base one,
+ * refined by the POLICY_FILE_NAME files of the directories in its path, the
+ * outermost first, up to one with "root = true". Each file is read once and
+ * each distinct policy compiled once, found by the fingerprint of what it
+ * sets. Not thread-safe: files are resolved before validation starts.
+ */
+typedef struct policies policies_t;
+
+/* Returns NULL if out of memory. The base policy has index 0. */
+policies_t*
+policies_create(const policy_t* base, bool first, simd_backend_t backend);
+
+/*
+ * Sets *index to the policy of the file at path. Returns false if a policy
+ * file on the way could not be read or is malformed, reported on stderr.
+ */
+bool
+policies_resolve(policies_t* ps, const char* path, size_t* index);
+
+size_t
+policies_count(const policies_t* ps);
+
+const policy_tables_t*
+policies_get(const policies_t* ps, size_t index);
+
+void
+policies_free(policies_t* ps);
+
+#endif /* CVC_POLICY_H */
@@ -0,0 +1,207 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Queue of worker w holds the tasks w, w + n, w + 2n, ... for n workers, so
+ * only the range [head, tail) of that sequence needs to be stored.
+ */
+typedef struct
+{
+    pthread_mutex_t lock;
+    size_t head;
+    size_t tail;
+} deque_t;
+
+typedef struct
+{
+    pool_t* pool;
+    unsigned int id;
+} worker_arg_t;
+
+struct pool
+{
+    unsigned int workers;
+    pool_task_t fn;
+    void* arg;
+    deque_t* deques;
+    pthread_t* threads;
+    bool* started;
+    worker_arg_t* args;
+};
+
+static bool
+pop_front(pool_t* pool, unsigned int w, size_t* task)
+{
+    deque_t* d = &pool->deques[w];
+    bool found = false;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->head < d->tail)
+    {
+        *task = w + (d->head++ * pool->workers);
+        found = true;
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    return found;
+}
+
+static bool
+steal_back(pool_t* pool, unsigned int w, size_t* task)
+{
+    for (unsigned int i = 1U; i < pool->workers; i++)
+    {
+        unsigned int victim = (w + i) % pool->workers;
+        deque_t* d = &pool->deques[victim];
+        bool found = false;
+
+        pthread_mutex_lock(&d->lock);
+        if (d->head < d->tail)
+        {
+            *task = victim + (--d->tail * pool->workers);
+            found = true;
+        }
+        pthread_mutex_unlock(&d->lock);
+
+        if (found)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void*
+worker_main(void* arg)
+{
+    const worker_arg_t* wa = arg;
+    pool_t* pool = wa->pool;
+    size_t task;
+
+    while (pop_front(pool, wa->id, &task) || steal_back(pool, wa->id, &task))
+    {
+        pool->fn(task, wa->id, pool->arg);
+    }
+
+    return NULL;
+}
+
+static void
+pool_free(pool_t* pool)
+{
+    if (pool->deques != NULL)
+    {
+        for (unsigned int i = 0U; i < pool->workers; i++)
+        {
+            pthread_mutex_destroy(&pool->deques[i].lock);
+        }
+    }
+    free(pool->deques);
+    free(pool->threads);
+    free(pool->started);
+    free(pool->args);
+    free(pool);
+}
+
+pool_t*
+pool_start(unsigned int workers, size_t tasks, pool_task_t fn, void* arg)
+{
+    if (workers == 0U)
+    {
+        return NULL;
+    }
+
+    pool_t* pool = calloc(1U, sizeof(pool_t));
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->deques = calloc(workers, sizeof(deque_t));
+    pool->threads = calloc(workers, sizeof(pthread_t));
+    pool->started = calloc(workers, sizeof(bool));
+    pool->args = calloc(workers, sizeof(worker_arg_t));
+    if ((pool->deques == NULL) || (pool->threads == NULL)
+        || (pool->started == NULL) || (pool->args == NULL))
+    {
+        pool_free(pool);
+        return NULL;
+    }
+
+    pool->workers = workers;
+    for (unsigned int i = 0U; i < workers; i++)
+    {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].head = 0U;
+        pool->deques[i].tail = (i < tasks) ? ((tasks - i + workers - 1U) / workers)
+                                           : 0U;
+        pool->args[i].pool = pool;
+        pool->args[i].id = i;
+    }
+
+    bool any = false;
+    for (unsigned int i = 0U; i < workers; i++)
+    {
+        pool->started[i] = (pthread_create(&pool->threads[i], NULL,
+                                           worker_main, &pool->args[i]) == 0);
+        any = any || pool->started[i];
+    }
+    if (!any)
+    {
+        pool_free(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+void
+pool_cancel(pool_t* pool)
+{
+    for (unsigned int i = 0U; i < pool->workers; i++)
+    {
+        deque_t* d = &pool->deques[i];
+
+        pthread_mutex_lock(&d->lock);
+        d->head = d->tail;
+        pthread_mutex_unlock(&d->lock);
+    }
+}
+
+void
+pool_join(pool_t* pool)
+{
+    for (unsigned int i = 0U; i < pool->workers; i++)
+    {
+        if (pool->started[i])
+        {
+            pthread_join(pool->threads[i], NULL);
+        }
+    }
+    pool_free(pool);
+}
+
+unsigned int
+pool_cpu_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (n > 0) ? (unsigned int)n : 1U;
+}
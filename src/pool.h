@@ -0,0 +1,44 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_POOL_H
+#define CVC_POOL_H
+
+#include <stddef.h>
+
+/*
+ * Fixed set of worker threads processing the tasks 0..n-1. Each worker owns
+ * a queue of tasks dealt out in input order and steals from the back of other
+ * queues once its own queue is drained, so tasks are started roughly in order
+ * while uneven task sizes are still balanced.
+ */
+typedef struct pool pool_t;
+
+typedef void (*pool_task_t)(size_t task, unsigned int worker, void* arg);
+
+/*
+ * Worker ids passed to fn are 0..workers-1. Returns NULL if not a single
+ * worker thread could be started, tasks of workers that failed to start are
+ * taken over by the others.
+ */
+pool_t*
+pool_start(unsigned int workers, size_t tasks, pool_task_t fn, void* arg);
+
+/* Drops all tasks not started yet, running ones are completed. */
+void
+pool_cancel(pool_t* pool);
+
+/* Waits until all tasks are done and releases the pool. */
+void
+pool_join(pool_t* pool);
+
+unsigned int
+pool_cpu_count(void);
+
+#endif /* CVC_POOL_H */
@@ -0,0 +1,631 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#if defined(__linux__)
+#define _DEFAULT_SOURCE /* syscall() */
+#endif
+
+#include "prefetch.h"
+#include "pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__GNUC__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define PREFETCH_IO_URING
+#endif
+#endif
+
+#if defined(PREFETCH_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#define PREFETCH_THREADS    (8U) /* without io_uring */
+
+/*
+ * Once all buffers are taken, reading resumes when this many are free again,
+ * rather than with each one, which would switch threads for every file.
+ */
+#define PREFETCH_BATCH      (PREFETCH_DEPTH / 4U)
+
+enum
+{
+    ENTRY_IDLE,    /* not read yet */
+    ENTRY_READING,
+    ENTRY_READY,   /* read ahead, in buf */
+    ENTRY_IN_USE,  /* buf is taken by prefetch_get() */
+    ENTRY_DONE     /* released, or to be read as usual */
+};
+
+typedef struct
+{
+    const char* path;
+    char* buf;
+    size_t len;
+    int fd;
+    int state;
+} entry_t;
+
+#if defined(PREFETCH_IO_URING)
+/*
+ * Submission and completion queue shared with the kernel. Every file in
+ * flight has a single request at a time, open, read or close, and files are
+ * only started while fewer than PREFETCH_DEPTH requests are in flight, so
+ * neither queue can overflow.
+ */
+typedef struct
+{
+    int fd;
+    void* map;
+    size_t map_len;
+    struct io_uring_sqe* sqes;
+    size_t sqes_len;
+    unsigned int* sq_tail;
+    const unsigned int* sq_mask;
+    unsigned int* cq_head;
+    const unsigned int* cq_tail;
+    const unsigned int* cq_mask;
+    const struct io_uring_cqe* cqes;
+    unsigned int queued;  /* requests not submitted yet */
+    unsigned int pending; /* requests not completed yet */
+    bool failed;          /* the kernel rejected a submission */
+} ring_t;
+
+enum
+{
+    RING_OP_OPEN,
+    RING_OP_READ,
+    RING_OP_CLOSE
+};
+
+#define RING_OP_BITS    (2U) /* of the user data, the entry in the others */
+#endif
+
+struct prefetch
+{
+    entry_t* entries;
+    size_t count;
+    size_t next; /* entries before are started or done */
+    char* memory;
+    char* buffers[PREFETCH_DEPTH]; /* free ones */
+    unsigned int free_count;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t ready; /* an entry is read */
+    pthread_cond_t room;  /* PREFETCH_BATCH buffers are free or reading stops */
+    pool_t* pool;
+#if defined(PREFETCH_IO_URING)
+    ring_t ring;
+    bool ring_open;
+#endif
+};
+
+/*
+ * Starts the next file due with a free buffer, called with the lock held.
+ * Returns false if there is no free buffer or no file left, more tells if
+ * files are left.
+ */
+static bool
+claim(prefetch_t* p, size_t* i, bool* more)
+{
+    while ((p->next < p->count) && (p->entries[p->next].state != ENTRY_IDLE))
+    {
+        p->next++; /* taken to be read as usual */
+    }
+    *more = !p->stop && (p->next < p->count);
+    if (!*more || (p->free_count == 0U))
+    {
+        return false;
+    }
+
+    entry_t* e = &p->entries[p->next];
+    e->buf = p->buffers[--p->free_count];
+    e->len = 0U;
+    e->state = ENTRY_READING;
+    *i = p->next++;
+
+    return true;
+}
+
+/* Returns the buffer of e, called with the lock held. */
+static void
+give_back(prefetch_t* p, entry_t* e)
+{
+    p->buffers[p->free_count++] = e->buf;
+    e->buf = NULL;
+    e->state = ENTRY_DONE;
+    if (p->free_count == PREFETCH_BATCH)
+    {
+        pthread_cond_broadcast(&p->room);
+    }
+}
+
+/* Ends reading entry i, it is ready if ok or else left to the caller. */
+static void
+finish(prefetch_t* p, size_t i, bool ok)
+{
+    entry_t* e = &p->entries[i];
+
+    pthread_mutex_lock(&p->lock);
+    if (ok)
+    {
+        e->state = ENTRY_READY;
+    }
+    else
+    {
+        give_back(p, e);
+    }
+    pthread_cond_broadcast(&p->ready);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* Reads fd to the end, returns false on errors or if it does not fit. */
+static bool
+read_whole(int fd, char* buf, size_t* len)
+{
+    for (;;)
+    {
+        ssize_t n = read(fd, buf + *len, PREFETCH_SIZE - *len);
+        if ((n < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return (n == 0);
+        }
+        *len += (size_t)n;
+        if (*len == PREFETCH_SIZE)
+        {
+            return false; /* too large to be read ahead */
+        }
+    }
+}
+
+/*
+ * Blocking reads, there is a task per file, but each reads the next file due,
+ * so files are read in order no matter which worker takes which task.
+ */
+static void
+fetch_task(size_t task, unsigned int worker, void* arg)
+{
+    prefetch_t* p = arg;
+    size_t i;
+    bool more;
+    bool claimed;
+
+    (void)task;
+    (void)worker;
+    pthread_mutex_lock(&p->lock);
+    while (!(claimed = claim(p, &i, &more)) && more)
+    {
+        while (!p->stop && (p->free_count < PREFETCH_BATCH))
+        {
+            pthread_cond_wait(&p->room, &p->lock);
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+    if (!claimed)
+    {
+        return;
+    }
+
+    entry_t* e = &p->entries[i];
+    int fd = open(e->path, O_RDONLY);
+    bool ok = (fd >= 0) && read_whole(fd, e->buf, &e->len);
+    if (fd >= 0)
+    {
+        (void)close(fd);
+    }
+    finish(p, i, ok);
+}
+
+#if defined(PREFETCH_IO_URING)
+/* Tells if the kernel knows all requests used, which came in Linux 5.6. */
+static bool
+ring_supported(int fd)
+{
+    static const unsigned char ops[] =
+    {
+        IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE
+    };
+    size_t size = sizeof(struct io_uring_probe)
+                  + (256U * sizeof(struct io_uring_probe_op));
+    struct io_uring_probe* probe = calloc(1U, size);
+    bool ok = (probe != NULL)
+              && (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE,
+                          probe, 256) == 0);
+
+    for (size_t k = 0U; ok && (k < sizeof(ops)); k++)
+    {
+        ok = (ops[k] < probe->ops_len)
+             && ((probe->ops[ops[k]].flags & IO_URING_OP_SUPPORTED) != 0U);
+    }
+    free(probe);
+
+    return ok;
+}
+
+static bool
+ring_init(ring_t* r)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    r->fd = (int)syscall(__NR_io_uring_setup, PREFETCH_DEPTH, &params);
+    if (r->fd < 0)
+    {
+        return false; /* e.g. not permitted in a container */
+    }
+    if (((params.features & IORING_FEAT_SINGLE_MMAP) == 0U)
+        || !ring_supported(r->fd))
+    {
+        (void)close(r->fd);
+        return false;
+    }
+
+    size_t sq_len = params.sq_off.array
+                    + (params.sq_entries * sizeof(unsigned int));
+    size_t cq_len = params.cq_off.cqes
+                    + (params.cq_entries * sizeof(struct io_uring_cqe));
+    r->map_len = (sq_len > cq_len) ? sq_len : cq_len;
+    r->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd,
+                  IORING_OFF_SQ_RING);
+    void* sqes = (r->map != MAP_FAILED)
+                 ? mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        r->fd, IORING_OFF_SQES)
+                 : MAP_FAILED;
+    if (sqes == MAP_FAILED)
+    {
+        if (r->map != MAP_FAILED)
+        {
+            (void)munmap(r->map, r->map_len);
+        }
+        (void)close(r->fd);
+        return false;
+    }
+
+    char* base = r->map;
+    unsigned int* array = (unsigned int*)(base + params.sq_off.array);
+    for (unsigned int k = 0U; k < params.sq_entries; k++)
+    {
+        array[k] = k; /* submission k uses sqes[k] */
+    }
+    r->sqes = sqes;
+    r->sq_tail = (unsigned int*)(base + params.sq_off.tail);
+    r->sq_mask = (const unsigned int*)(base + params.sq_off.ring_mask);
+    r->cq_head = (unsigned int*)(base + params.cq_off.head);
+    r->cq_tail = (const unsigned int*)(base + params.cq_off.tail);
+    r->cq_mask = (const unsigned int*)(base + params.cq_off.ring_mask);
+    r->cqes = (const struct io_uring_cqe*)(base + params.cq_off.cqes);
+    r->queued = 0U;
+    r->pending = 0U;
+    r->failed = false;
+
+    return true;
+}
+
+static void
+ring_free(ring_t* r)
+{
+    (void)munmap(r->sqes, r->sqes_len);
+    (void)munmap(r->map, r->map_len);
+    (void)close(r->fd);
+}
+
+static void
+ring_queue(ring_t* r, unsigned char opcode, int fd, const void* addr,
+           unsigned int len, uint64_t offset, size_t i, unsigned int op)
+{
+    unsigned int tail = *r->sq_tail; /* only written here */
+    struct io_uring_sqe* sqe = &r->sqes[tail & *r->sq_mask];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)addr;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = ((uint64_t)i << RING_OP_BITS) | op;
+    if (opcode == IORING_OP_OPENAT)
+    {
+        sqe->open_flags = O_RDONLY;
+    }
+    __atomic_store_n(r->sq_tail, tail + 1U, __ATOMIC_RELEASE);
+    r->queued++;
+    r->pending++;
+}
+
+static void
+ring_read(ring_t* r, const entry_t* e, size_t i)
+{
+    ring_queue(r, IORING_OP_READ, e->fd, e->buf + e->len,
+               (unsigned int)(PREFETCH_SIZE - e->len), e->len, i, RING_OP_READ);
+}
+
+/* Submits the queued requests and waits for a completion. */
+static bool
+ring_enter(ring_t* r)
+{
+    for (;;)
+    {
+        long n = syscall(__NR_io_uring_enter, r->fd, r->queued, 1U,
+                         IORING_ENTER_GETEVENTS, NULL, 0);
+        if (n >= 0)
+        {
+            r->queued -= (unsigned int)n;
+            return true;
+        }
+        if ((errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY))
+        {
+            return false;
+        }
+    }
+}
+
+/* Continues the file of a completed request with its next one. */
+static void
+ring_complete(prefetch_t* p, uint64_t user_data, int res)
+{
+    ring_t* r = &p->ring;
+    size_t i = (size_t)(user_data >> RING_OP_BITS);
+    entry_t* e = &p->entries[i];
+
+    switch (user_data & ((1U << RING_OP_BITS) - 1U))
+    {
+        case RING_OP_OPEN:
+            if (res < 0)
+            {
+                finish(p, i, false); /* the error is reported when read again */
+                break;
+            }
+            e->fd = res;
+            ring_read(r, e, i);
+            break;
+        case RING_OP_READ:
+            if (res > 0)
+            {
+                e->len += (size_t)res;
+                if (e->len < PREFETCH_SIZE)
+                {
+                    ring_read(r, e, i); /* up to the end of file */
+                    break;
+                }
+            }
+            ring_queue(r, IORING_OP_CLOSE, e->fd, NULL, 0U, 0U, i,
+                       RING_OP_CLOSE);
+            finish(p, i, (res == 0));
+            break;
+        default:
+            break; /* closed */
+    }
+}
+
+static void
+ring_reap(prefetch_t* p)
+{
+    ring_t* r = &p->ring;
+    unsigned int head = *r->cq_head;
+    unsigned int tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++)
+    {
+        const struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+        r->pending--;
+        ring_complete(p, cqe->user_data, cqe->res);
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* The single task of the io_uring backend, it starts and completes all. */
+static void
+ring_task(size_t task, unsigned int worker, void* arg)
+{
+    prefetch_t* p = arg;
+    ring_t* r = &p->ring;
+    bool more = true;
+
+    (void)task;
+    (void)worker;
+    while (more || (r->pending > 0U))
+    {
+        size_t i;
+        pthread_mutex_lock(&p->lock);
+        for (;;)
+        {
+            while ((r->pending < PREFETCH_DEPTH) && claim(p, &i, &more))
+            {
+                ring_queue(r, IORING_OP_OPENAT, AT_FDCWD, p->entries[i].path,
+                           0U, 0U, i, RING_OP_OPEN);
+            }
+            if (!more || (r->pending > 0U))
+            {
+                break;
+            }
+            while (!p->stop && (p->free_count < PREFETCH_BATCH))
+            {
+                pthread_cond_wait(&p->room, &p->lock);
+            }
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        if (r->pending == 0U)
+        {
+            break;
+        }
+        if (!ring_enter(r))
+        {
+            break;
+        }
+        ring_reap(p);
+    }
+    if (r->pending == 0U)
+    {
+        return;
+    }
+
+    /*
+     * The kernel may still write to the buffers of requests in flight, they
+     * are given up and not released.
+     */
+    pthread_mutex_lock(&p->lock);
+    r->failed = true;
+    for (size_t k = 0U; k < p->count; k++)
+    {
+        if (p->entries[k].state == ENTRY_READING)
+        {
+            p->entries[k].state = ENTRY_DONE;
+        }
+    }
+    pthread_cond_broadcast(&p->ready);
+    pthread_mutex_unlock(&p->lock);
+}
+#endif
+
+static void
+prefetch_free(prefetch_t* p)
+{
+#if defined(PREFETCH_IO_URING)
+    if (p->ring_open)
+    {
+        if (p->ring.failed)
+        {
+            p->memory = NULL;
+        }
+        ring_free(&p->ring);
+    }
+#endif
+    pthread_cond_destroy(&p->room);
+    pthread_cond_destroy(&p->ready);
+    pthread_mutex_destroy(&p->lock);
+    free(p->memory);
+    free(p->entries);
+    free(p);
+}
+
+prefetch_t*
+prefetch_start(char* const* paths, size_t count)
+{
+    prefetch_t* p = calloc(1U, sizeof(prefetch_t));
+    if (p == NULL)
+    {
+        return NULL;
+    }
+    p->entries = calloc((count > 0U) ? count : 1U, sizeof(entry_t));
+    long page = sysconf(_SC_PAGESIZE);
+    void* memory;
+    if (posix_memalign(&memory, (page > 0) ? (size_t)page : 4096U,
+                       PREFETCH_DEPTH * (size_t)PREFETCH_SIZE) == 0)
+    {
+        p->memory = memory; /* a slab of page-aligned buffers */
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->ready, NULL);
+    pthread_cond_init(&p->room, NULL);
+    if ((p->entries == NULL) || (p->memory == NULL))
+    {
+        prefetch_free(p);
+        return NULL;
+    }
+
+    p->count = count;
+    for (size_t i = 0U; i < count; i++)
+    {
+        p->entries[i].path = paths[i];
+        p->entries[i].fd = -1;
+        p->entries[i].state = ENTRY_IDLE;
+    }
+    for (unsigned int k = 0U; k < PREFETCH_DEPTH; k++)
+    {
+        p->buffers[k] = p->memory + (k * (size_t)PREFETCH_SIZE);
+    }
+    p->free_count = PREFETCH_DEPTH;
+
+#if defined(PREFETCH_IO_URING)
+    p->ring_open = ring_init(&p->ring);
+    if (p->ring_open)
+    {
+        p->pool = pool_start(1U, 1U, ring_task, p);
+        if (p->pool == NULL)
+        {
+            ring_free(&p->ring);
+            p->ring_open = false;
+        }
+    }
+#endif
+    if (p->pool == NULL)
+    {
+        unsigned int threads = (count < PREFETCH_THREADS) ? (unsigned int)count
+                                                          : PREFETCH_THREADS;
+        p->pool = pool_start(threads, count, fetch_task, p);
+    }
+    if (p->pool == NULL)
+    {
+        prefetch_free(p);
+        return NULL;
+    }
+
+    return p;
+}
+
+bool
+prefetch_get(prefetch_t* p, size_t i, const char** data, size_t* len)
+{
+    entry_t* e = &p->entries[i];
+
+    pthread_mutex_lock(&p->lock);
+    if (e->state == ENTRY_IDLE)
+    {
+        e->state = ENTRY_DONE; /* not to be read ahead any more */
+    }
+    while (e->state == ENTRY_READING)
+    {
+        pthread_cond_wait(&p->ready, &p->lock);
+    }
+    bool ready = (e->state == ENTRY_READY);
+    if (ready)
+    {
+        e->state = ENTRY_IN_USE;
+        *data = e->buf;
+        *len = e->len;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return ready;
+}
+
+void
+prefetch_release(prefetch_t* p, size_t i)
+{
+    pthread_mutex_lock(&p->lock);
+    give_back(p, &p->entries[i]);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void
+prefetch_stop(prefetch_t* p)
+{
+    pthread_mutex_lock(&p->lock);
+    p->stop = true;
+    pthread_cond_broadcast(&p->room);
+    pthread_mutex_unlock(&p->lock);
+
+    pool_cancel(p->pool);
+    pool_join(p->pool);
+    prefetch_free(p);
+}
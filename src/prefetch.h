@@ -0,0 +1,54 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_PREFETCH_H
+#define CVC_PREFETCH_H
+
+#include "reader.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Reads small files ahead of validation, in input order and many at once, so
+ * that the time of open() and read() overlaps with validation and the device
+ * sees a queue of requests. On Linux, the requests are submitted through
+ * io_uring, elsewhere or if the kernel lacks it, a pool of threads issues
+ * them. Files are read whole into buffers of PREFETCH_SIZE bytes, larger ones
+ * are left to the reader, which maps them.
+ */
+typedef struct prefetch prefetch_t;
+
+#define PREFETCH_SIZE   READER_MMAP_THRESHOLD
+#define PREFETCH_DEPTH  (64U) /* files read ahead at most */
+
+/*
+ * Starts reading the files at paths[0..count-1], which have to stay valid
+ * until prefetch_stop(). Returns NULL if it could not be started.
+ */
+prefetch_t*
+prefetch_start(char* const* paths, size_t count);
+
+/*
+ * Provides the content of file i, waiting if it is being read. Returns false
+ * if the file is not read ahead: not yet started, too large or failed, it is
+ * to be read as usual then. Each file can be taken once.
+ */
+bool
+prefetch_get(prefetch_t* p, size_t i, const char** data, size_t* len);
+
+/* Returns the buffer of file i, taken by prefetch_get(), for reading ahead. */
+void
+prefetch_release(prefetch_t* p, size_t i);
+
+/* Completes the requests in flight and releases p. */
+void
+prefetch_stop(prefetch_t* p);
+
+#endif /* CVC_PREFETCH_H */
@@ -0,0 +1,255 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void
+try_map(reader_t* r)
+{
+    struct stat st;
+
+    if ((fstat(r->fd, &st) != 0) || !S_ISREG(st.st_mode)
+        || (st.st_size < (off_t)READER_MMAP_THRESHOLD)
+        || ((uintmax_t)st.st_size > (uintmax_t)SIZE_MAX))
+    {
+        return;
+    }
+
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, r->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        return; /* e.g. special file systems, read() still works */
+    }
+    (void)posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+    r->map = map;
+    r->map_len = (size_t)st.st_size;
+    r->mapped = true;
+}
+
+bool
+reader_open(reader_t* r, const char* path, char* buf, size_t buf_size,
+            bool use_mmap)
+{
+    r->buf = buf;
+    r->buf_size = buf_size;
+    r->pos = 0U;
+    r->len = 0U;
+    r->remaining = SIZE_MAX;
+    r->map = NULL;
+    r->map_len = 0U;
+    r->mapped = false;
+    r->framed = false;
+    r->eof = false;
+    r->error = false;
+
+    if (path == NULL)
+    {
+        r->fd = STDIN_FILENO;
+        return true;
+    }
+
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0)
+    {
+        return false;
+    }
+    if (use_mmap)
+    {
+        try_map(r);
+    }
+
+    return true;
+}
+
+void
+reader_open_memory(reader_t* r, const char* data, size_t len)
+{
+    reader_attach(r, -1, NULL, 0U);
+    r->map = (len > 0U) ? data : NULL;
+    r->map_len = len;
+    r->eof = (len == 0U);
+}
+
+/* Refills the buffer, returns false at the end of input or on errors. */
+static bool
+fill(reader_t* r)
+{
+    ssize_t n;
+    do
+    {
+        n = read(r->fd, r->buf, r->buf_size);
+    } while ((n < 0) && (errno == EINTR));
+
+    if (n <= 0)
+    {
+        r->eof = (n == 0);
+        r->error = (n < 0);
+        return false;
+    }
+    r->pos = 0U;
+    r->len = (size_t)n;
+
+    return true;
+}
+
+bool
+reader_next(reader_t* r, const char** data, size_t* len)
+{
+    if (r->eof || r->error)
+    {
+        return false;
+    }
+
+    if (r->map != NULL)
+    {
+        *data = r->map;
+        *len = r->map_len;
+        r->eof = true;
+        return true;
+    }
+
+    if ((r->remaining == 0U) && r->framed)
+    {
+        uint32_t frame = 0U;
+        r->framed = reader_read(r, &frame, sizeof(frame)) && (frame != 0U);
+        r->remaining = frame;
+    }
+    if (r->remaining == 0U)
+    {
+        r->eof = true;
+        return false;
+    }
+    if ((r->pos == r->len) && !fill(r))
+    {
+        return false;
+    }
+    size_t n = r->len - r->pos;
+    if (n > r->remaining)
+    {
+        n = r->remaining; /* the rest belongs to the next input */
+    }
+    if (r->remaining != SIZE_MAX)
+    {
+        r->remaining -= n;
+    }
+    *data = r->buf + r->pos;
+    *len = n;
+    r->pos += n;
+
+    return true;
+}
+
+void
+reader_attach(reader_t* r, int fd, char* buf, size_t buf_size)
+{
+    r->fd = fd;
+    r->buf = buf;
+    r->buf_size = buf_size;
+    r->pos = 0U;
+    r->len = 0U;
+    r->remaining = SIZE_MAX;
+    r->map = NULL;
+    r->map_len = 0U;
+    r->mapped = false;
+    r->framed = false;
+    r->eof = false;
+    r->error = false;
+}
+
+bool
+reader_line(reader_t* r, char* line, size_t size)
+{
+    size_t n = 0U;
+
+    for (;;)
+    {
+        if ((r->pos == r->len) && !fill(r))
+        {
+            return false;
+        }
+        char c = r->buf[r->pos++];
+        if (c == '\n')
+        {
+            line[n] = '\0';
+            return true;
+        }
+        if ((n + 1U) >= size)
+        {
+            return false;
+        }
+        line[n++] = c;
+    }
+}
+
+bool
+reader_read(reader_t* r, void* dst, size_t len)
+{
+    char* q = dst;
+
+    while (len > 0U)
+    {
+        if ((r->pos == r->len) && !fill(r))
+        {
+            return false;
+        }
+        size_t n = r->len - r->pos;
+        if (n > len)
+        {
+            n = len;
+        }
+        memcpy(q, r->buf + r->pos, n);
+        r->pos += n;
+        q += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+void
+reader_limit(reader_t* r, size_t len)
+{
+    r->remaining = len;
+    r->framed = false;
+    r->eof = false;
+}
+
+void
+reader_frames(reader_t* r)
+{
+    r->remaining = 0U;
+    r->framed = true;
+    r->eof = false;
+}
+
+void
+reader_close(reader_t* r)
+{
+    if (r->mapped)
+    {
+        (void)munmap((void*)r->map, r->map_len);
+        r->mapped = false;
+    }
+    r->map = NULL;
+    if ((r->fd >= 0) && (r->fd != STDIN_FILENO))
+    {
+        (void)close(r->fd);
+    }
+    r->fd = -1;
+}
@@ -0,0 +1,96 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_READER_H
+#define CVC_READER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Input of one file. Regular files of at least READER_MMAP_THRESHOLD bytes
+ * are mapped into memory and handed out as a single block without copying.
+ * Smaller files, pipes and standard input are read chunk-wise into the
+ * buffer supplied by the caller, or held in memory already. A stream of
+ * several inputs, as written by git cat-file, is split by reader_limit(), or
+ * by reader_frames() if their sizes are not known up front.
+ */
+typedef struct
+{
+    int fd;
+    char* buf;
+    size_t buf_size;
+    size_t pos;       /* buffered bytes not handed out yet, pos to len */
+    size_t len;
+    size_t remaining; /* of the current input, SIZE_MAX if not limited */
+    const char* map;
+    size_t map_len;
+    bool mapped;      /* map is to be unmapped */
+    bool framed;      /* remaining is of a frame, see reader_frames() */
+    bool eof;
+    bool error;
+} reader_t;
+
+#define READER_MMAP_THRESHOLD   (64U * 1024U)
+
+/*
+ * A path of NULL means standard input, use_mmap false forces read() also for
+ * large regular files. Returns false if the input cannot be opened.
+ */
+bool
+reader_open(reader_t* r, const char* path, char* buf, size_t buf_size,
+            bool use_mmap);
+
+/*
+ * Hands out the len bytes at data, which stay owned by the caller, as one
+ * block.
+ */
+void
+reader_open_memory(reader_t* r, const char* data, size_t len);
+
+/*
+ * Provides the next block of input. Returns false at the end of input or on
+ * a read error, which is flagged in r->error.
+ */
+bool
+reader_next(reader_t* r, const char** data, size_t* len);
+
+/* Reads from fd, which is closed by reader_close(), as a stream of inputs. */
+void
+reader_attach(reader_t* r, int fd, char* buf, size_t buf_size);
+
+/*
+ * Reads a line of at most size - 1 characters into line, without the LF.
+ * Returns false at the end of input, on read errors or for longer lines.
+ */
+bool
+reader_line(reader_t* r, char* line, size_t size);
+
+/* Copies the next len bytes of the stream to dst, false if it ends before. */
+bool
+reader_read(reader_t* r, void* dst, size_t len);
+
+/*
+ * Limits the input to the next len bytes: reader_next() reports the end of
+ * input after them, the stream continues with reader_limit() again.
+ */
+void
+reader_limit(reader_t* r, size_t len);
+
+/*
+ * Limits the input to the frames that follow, each its length as uint32_t
+ * in host byte order and as many bytes, up to an empty one.
+ */
+void
+reader_frames(reader_t* r);
+
+void
+reader_close(reader_t* r);
+
+#endif /* CVC_READER_H */
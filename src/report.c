@@ -0,0 +1,169 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#include "report.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPORT_INITIAL_CAPACITY (256U)
+#define REPORT_FLUSH_SIZE       (1024U * 1024U)
+
+void
+report_init(report_t* r, FILE* stream)
+{
+    r->data = NULL;
+    r->len = 0U;
+    r->capacity = 0U;
+    r->stream = stream;
+    r->oom = false;
+}
+
+void
+report_free(report_t* r)
+{
+    free(r->data);
+    report_init(r, r->stream);
+}
+
+static bool
+grow(report_t* r, size_t n)
+{
+    if ((r->stream != NULL) && (r->len > 0U))
+    {
+        report_flush(r, r->stream);
+        if (n <= r->capacity)
+        {
+            return true;
+        }
+    }
+
+    size_t capacity = (r->capacity == 0U) ? REPORT_INITIAL_CAPACITY
+                                          : r->capacity;
+    while (capacity < (r->len + n))
+    {
+        capacity *= 2U;
+    }
+    if ((r->stream != NULL) && (capacity < REPORT_FLUSH_SIZE))
+    {
+        capacity = REPORT_FLUSH_SIZE;
+    }
+    char* data = realloc(r->data, capacity);
+    if (data == NULL)
+    {
+        r->oom = true;
+        return false;
+    }
+    r->data = data;
+    r->capacity = capacity;
+
+    return true;
+}
+
+static inline bool
+reserve(report_t* r, size_t n)
+{
+    return ((r->len + n) <= r->capacity) || grow(r, n);
+}
+
+char*
+report_reserve(report_t* r, size_t n)
+{
+    return reserve(r, n) ? (r->data + r->len) : NULL;
+}
+
+void
+report_commit(report_t* r, const char* end)
+{
+    r->len = (size_t)(end - r->data);
+}
+
+char*
+report_format_uint(char* q, unsigned long value)
+{
+    char digits[REPORT_UINT_MAX_LEN];
+    size_t n = 0U;
+
+    do
+    {
+        digits[n++] = (char)('0' + (value % 10U));
+        value /= 10U;
+    } while (value != 0U);
+    while (n > 0U)
+    {
+        *q++ = digits[--n];
+    }
+
+    return q;
+}
+
+char*
+report_format_hex(char* q, unsigned char value)
+{
+    static const char hex[] = "0123456789ABCDEF";
+
+    *q++ = hex[value >> 4];
+    *q++ = hex[value & 0x0FU];
+
+    return q;
+}
+
+void
+report_write(report_t* r, const char* s, size_t len)
+{
+    if (reserve(r, len))
+    {
+        memcpy(r->data + r->len, s, len);
+        r->len += len;
+    }
+}
+
+void
+report_printf(report_t* r, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(NULL, 0U, format, args);
+    va_end(args);
+    if ((n < 0) || !reserve(r, (size_t)n + 1U))
+    {
+        return;
+    }
+    va_start(args, format);
+    (void)vsnprintf(r->data + r->len, (size_t)n + 1U, format, args);
+    va_end(args);
+    r->len += (size_t)n;
+}
+
+void
+report_putc(report_t* r, char c)
+{
+    if (reserve(r, 1U))
+    {
+        r->data[r->len++] = c;
+    }
+}
+
+void
+report_flush(report_t* r, FILE* stream)
+{
+    if (r->len > 0U)
+    {
+        (void)fwrite(r->data, sizeof(char), r->len, stream);
+        r->len = 0U;
+    }
+}
+
+void
+report_reset(report_t* r)
+{
+    r->len = 0U;
+    r->oom = false;
+}
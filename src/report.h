@@ -0,0 +1,77 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_REPORT_H
+#define CVC_REPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Output buffer of one file. With a stream attached, the buffer is written
+ * out whenever it fills up; without, everything is kept until report_flush()
+ * so results of files validated in parallel can be emitted in input order.
+ */
+typedef struct
+{
+    char* data;
+    size_t len;
+    size_t capacity;
+    FILE* stream;
+    bool oom; /* output was lost due to failed allocation */
+} report_t;
+
+void
+report_init(report_t* r, FILE* stream);
+
+void
+report_free(report_t* r);
+
+/*
+ * Makes room for at least n more bytes and returns where to write them, or
+ * NULL if that is not possible. The bytes written are taken over by
+ * report_commit() with the position after the last one.
+ */
+char*
+report_reserve(report_t* r, size_t n);
+
+void
+report_commit(report_t* r, const char* end);
+
+/* Formatting without stdio, each returns the position after the output. */
+#define REPORT_UINT_MAX_LEN (20U)
+
+char*
+report_format_uint(char* q, unsigned long value);
+
+char*
+report_format_hex(char* q, unsigned char value);
+
+void
+report_write(report_t* r, const char* s, size_t len);
+
+void
+report_printf(report_t* r, const char* format, ...);
+
+void
+report_putc(report_t* r, char c);
+
+/* Writes the buffered output to stream and clears the buffer. */
+void
+report_flush(report_t* r, FILE* stream);
+
+/*
+ * Drops the buffered output and the oom flag, the memory is kept, so a report
+ * reused for the next file does not allocate again.
+ */
+void
+report_reset(report_t* r);
+
+#endif /* CVC_REPORT_H */
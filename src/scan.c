@@ -0,0 +1,1052 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#include "scan.h"
+#include "lex.h"
+#include "stats.h"
+
+#include <string.h>
+
+/*
+ * EOL indicators found in the input, a CR is followed by the next byte as far
+ * as the EOL is not locked to CR or LF already, which tells CRLF from CR.
+ */
+typedef enum
+{
+    EOL_SYMBOL_LF,
+    EOL_SYMBOL_CR,
+    EOL_SYMBOL_CRLF,
+    EOL_SYMBOLS
+} eol_symbol_t;
+
+#define EOL_MISMATCH    (0xFFU)
+
+/*
+ * Transitions of the EOL state, which is the expected or detected EOL: the
+ * first indicator locks it, a different one later on is a mismatch.
+ */
+static const uint8_t eol_transition[4][EOL_SYMBOLS] =
+{
+    [EOL_AUTO_NA] = {EOL_LF, EOL_CR, EOL_CRLF},
+    [EOL_CR]      = {EOL_MISMATCH, EOL_CR, EOL_MISMATCH},
+    [EOL_LF]      = {EOL_LF, EOL_MISMATCH, EOL_MISMATCH},
+    [EOL_CRLF]    = {EOL_MISMATCH, EOL_MISMATCH, EOL_CRLF}
+};
+
+static const uint8_t eol_symbol_len[EOL_SYMBOLS] = {1U, 1U, 2U};
+
+#define SCAN_KERNEL_MATCHER (1U)
+#define SCAN_KERNEL_LEXER   (2U)
+#define SCAN_KERNEL_VERBOSE (4U)
+
+#if defined(__GNUC__)
+#define SCAN_INLINE static inline __attribute__((always_inline))
+#else
+#define SCAN_INLINE static inline
+#endif
+
+/* Picks the kernel of scan_chunk() for the flags set so far. */
+static void
+select_kernel(scan_t* s)
+{
+    s->kernel = ((s->out != NULL) ? SCAN_KERNEL_VERBOSE : 0U)
+                | ((s->lex != NULL) ? SCAN_KERNEL_LEXER : 0U)
+                | ((s->match != NULL) ? SCAN_KERNEL_MATCHER : 0U);
+}
+
+void
+char_table_build(char_table_t* t, const bool* valid_chars,
+                 simd_backend_t backend)
+{
+    for (unsigned int c = 0U; c < CHAR_TABLE_SIZE; c++)
+    {
+        if (valid_chars[c])
+        {
+            t->cls[c] = CHAR_CLASS_VALID;
+        }
+        else if ((c < 0x20U) || (c == 0x7FU))
+        {
+            t->cls[c] = CHAR_CLASS_CONTROL;
+        }
+        else
+        {
+            t->cls[c] = CHAR_CLASS_INVALID;
+        }
+    }
+    t->cls['\r'] = CHAR_CLASS_CR;
+    t->cls['\n'] = CHAR_CLASS_LF;
+    t->range_count = 0U;
+
+    simd_set_build(&t->simd, valid_chars, backend);
+}
+
+void
+char_table_set_utf8(char_table_t* t, const utf8_range_t* ranges,
+                    unsigned int count)
+{
+    bool valid[CHAR_TABLE_SIZE];
+
+    for (unsigned int c = 0U; c < CHAR_TABLE_SIZE; c++)
+    {
+        if (c > 0x7FU)
+        {
+            t->cls[c] = CHAR_CLASS_UTF8;
+        }
+        valid[c] = (t->cls[c] == CHAR_CLASS_VALID);
+    }
+    t->range_count = (count < UTF8_RANGES_MAX) ? count : UTF8_RANGES_MAX;
+    memcpy(t->ranges, ranges, t->range_count * sizeof(utf8_range_t));
+
+    /* blocks with multibyte characters are left to the decoder */
+    simd_set_build(&t->simd, valid, t->simd.backend);
+}
+
+void
+scan_init(scan_t* s, const char_table_t* table, eol_t eol, report_t* out,
+          bool first)
+{
+    s->table = table;
+    s->cls = table->cls;
+    s->simd = (table->simd.skip != NULL) ? &table->simd : NULL;
+    s->out = out;
+    s->callback = NULL;
+    s->user = NULL;
+    s->first = first;
+    s->eol = eol;
+    s->cr_pending = false;
+    s->line = 1U;
+    s->last_line = 0U;
+    s->errors = 0U;
+    s->eol_error_line = 0U;
+    s->eol_error_offset = 0U;
+    s->eol_error_column = 0U;
+    s->eol_error_char_column = 0U;
+    s->line_start = 0U;
+    s->line_extra = 0U;
+    s->offset = 0U;
+    s->utf8_state = UTF8_ACCEPT;
+    s->utf8_cp = 0U;
+    s->utf8_len = 0U;
+    s->utf8_offset = 0U;
+    s->lex = NULL;
+    s->lex_state = LEX_CODE;
+    s->raw_len = 0U;
+    s->raw_match = 0U;
+    s->tail_len = 0U;
+    s->simd_bytes = 0U;
+    s->match = NULL;
+    s->match_state = MATCH_ROOT;
+    select_kernel(s);
+}
+
+void
+scan_set_callback(scan_t* s, scan_callback_t callback, void* user)
+{
+    s->callback = callback;
+    s->user = user;
+}
+
+void
+scan_set_matcher(scan_t* s, const match_t* match)
+{
+    s->match = match;
+    s->match_state = MATCH_ROOT;
+    select_kernel(s);
+}
+
+void
+scan_seek(scan_t* s, uint64_t offset, eol_t eol)
+{
+    s->match_state = MATCH_ROOT; /* behind an EOL */
+    s->eol = eol;
+    s->offset = offset;
+    s->line_start = offset;
+    s->line_extra = 0U;
+}
+
+static inline void
+lex_enter(scan_t* s, unsigned int state)
+{
+    const lex_table_t* t = s->lex;
+
+    s->lex_state = state;
+    s->table = &t->contexts[lex_context[state]];
+    s->cls = t->cls[state];
+    s->simd = (t->simd[state].skip != NULL) ? &t->simd[state] : NULL;
+}
+
+void
+scan_set_lexer(scan_t* s, const lex_table_t* lex)
+{
+    s->lex = lex;
+    lex_enter(s, LEX_CODE);
+    select_kernel(s);
+}
+
+/* Line comments and literals end at an EOL, unless escaped by a backslash. */
+static void
+lex_eol(scan_t* s)
+{
+    switch (s->lex_state)
+    {
+        case LEX_SLASH:
+        case LEX_LINE_COMMENT:
+        case LEX_STRING: /* not terminated */
+        case LEX_CHAR:
+        case LEX_RAW_DELIMITER:
+            lex_enter(s, LEX_CODE);
+            break;
+        case LEX_LINE_COMMENT_ESCAPE:
+            lex_enter(s, LEX_LINE_COMMENT);
+            break;
+        case LEX_BLOCK_COMMENT_STAR:
+            lex_enter(s, LEX_BLOCK_COMMENT);
+            break;
+        case LEX_STRING_ESCAPE:
+            lex_enter(s, LEX_STRING);
+            break;
+        case LEX_CHAR_ESCAPE:
+            lex_enter(s, LEX_CHAR);
+            break;
+        case LEX_RAW_CLOSE:
+            lex_enter(s, LEX_RAW);
+            break;
+        default:
+            break;
+    }
+}
+
+/* Column in bytes of the byte at offset of the current line. */
+static inline unsigned int
+column(const scan_t* s, uint64_t offset)
+{
+    return (unsigned int)(offset - s->line_start) + 1U;
+}
+
+/* Moves on to the line that starts at offset start. */
+static inline void
+next_line(scan_t* s, uint64_t start)
+{
+    if ((s->out != NULL) && (s->last_line == s->line))
+    {
+        report_putc(s->out, '\n');
+    }
+    s->line++;
+    s->line_start = start;
+    s->line_extra = 0U;
+    if (s->lex != NULL)
+    {
+        lex_eol(s);
+    }
+}
+
+static inline bool
+is_digit(char c)
+{
+    return (c >= '0') && (c <= '9');
+}
+
+static inline bool
+is_identifier(char c)
+{
+    return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z'))
+           || is_digit(c) || (c == '_');
+}
+
+/*
+ * Copies up to SCAN_LOOKBEHIND bytes in front of p to before, from the chunk
+ * and those kept from the previous ones. Returns their number.
+ */
+static size_t
+lookbehind(const scan_t* s, const char* buf, const char* p, char* before)
+{
+    size_t in_chunk = (size_t)(p - buf);
+    size_t from_chunk = (in_chunk < SCAN_LOOKBEHIND) ? in_chunk
+                                                     : SCAN_LOOKBEHIND;
+    size_t from_tail = SCAN_LOOKBEHIND - from_chunk;
+    if (from_tail > s->tail_len)
+    {
+        from_tail = s->tail_len;
+    }
+
+    memcpy(before, s->tail + (s->tail_len - from_tail), from_tail);
+    memcpy(before + from_tail, p - from_chunk, from_chunk);
+
+    return from_tail + from_chunk;
+}
+
+static void
+keep_tail(scan_t* s, const char* buf, size_t len)
+{
+    if (len >= SCAN_LOOKBEHIND)
+    {
+        memcpy(s->tail, buf + (len - SCAN_LOOKBEHIND), SCAN_LOOKBEHIND);
+        s->tail_len = SCAN_LOOKBEHIND;
+        return;
+    }
+
+    size_t keep = SCAN_LOOKBEHIND - len;
+    if (keep > s->tail_len)
+    {
+        keep = s->tail_len;
+    }
+    memmove(s->tail, s->tail + (s->tail_len - keep), keep);
+    memcpy(s->tail + keep, buf, len);
+    s->tail_len = (unsigned int)(keep + len);
+}
+
+/* A quote in code that belongs to a number like 1'000 (C++14). */
+static bool
+digit_separator(const scan_t* s, const char* buf, const char* p)
+{
+    char before[SCAN_LOOKBEHIND];
+    size_t n = lookbehind(s, buf, p, before);
+    size_t i = n;
+    while ((i > 0U)
+           && (is_identifier(before[i - 1U]) || (before[i - 1U] == '\'')
+               || (before[i - 1U] == '.')))
+    {
+        i--;
+    }
+
+    return (i < n) && (is_digit(before[i])
+                       || ((before[i] == '.') && ((i + 1U) < n)
+                           && is_digit(before[i + 1U])));
+}
+
+/* A double quote in code that starts a raw string, like R"x( or u8R"(. */
+static bool
+raw_prefix(const scan_t* s, const char* buf, const char* p)
+{
+    static const char* const prefixes[] = {"R", "LR", "uR", "UR", "u8R"};
+    char before[SCAN_LOOKBEHIND];
+    size_t n = lookbehind(s, buf, p, before);
+    size_t i = n;
+    while ((i > 0U) && is_identifier(before[i - 1U]))
+    {
+        i--;
+    }
+
+    for (size_t k = 0U; k < (sizeof(prefixes) / sizeof(prefixes[0])); k++)
+    {
+        size_t len = strlen(prefixes[k]);
+        if (((n - i) == len) && (memcmp(&before[i], prefixes[k], len) == 0))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Moves the lexer on by the byte at p, which may change the state, and
+ * returns its class in the context it belongs to. A byte that ends a state
+ * waiting for the next one is looked at again in the state it leads to.
+ */
+static uint8_t
+lex(scan_t* s, const char* buf, const char* p)
+{
+    char c = *p;
+
+    for (;;)
+    {
+        unsigned int state = s->lex_state;
+        unsigned int next = state;
+        switch (state)
+        {
+            case LEX_CODE:
+                if (c == '/')
+                {
+                    next = LEX_SLASH;
+                }
+                else if (c == '"')
+                {
+                    next = raw_prefix(s, buf, p) ? LEX_RAW_DELIMITER
+                                                 : LEX_STRING;
+                    s->raw_len = 0U;
+                }
+                else if ((c == '\'') && !digit_separator(s, buf, p))
+                {
+                    next = LEX_CHAR;
+                }
+                break;
+            case LEX_SLASH:
+                if (c == '/')
+                {
+                    next = LEX_LINE_COMMENT;
+                }
+                else if (c == '*')
+                {
+                    next = LEX_BLOCK_COMMENT;
+                }
+                else
+                {
+                    lex_enter(s, LEX_CODE);
+                    continue;
+                }
+                break;
+            case LEX_LINE_COMMENT:
+                next = (c == '\\') ? LEX_LINE_COMMENT_ESCAPE : state;
+                break;
+            case LEX_LINE_COMMENT_ESCAPE:
+                lex_enter(s, LEX_LINE_COMMENT);
+                continue;
+            case LEX_BLOCK_COMMENT:
+                next = (c == '*') ? LEX_BLOCK_COMMENT_STAR : state;
+                break;
+            case LEX_BLOCK_COMMENT_STAR:
+                if (c == '/')
+                {
+                    next = LEX_CODE;
+                }
+                else if (c != '*')
+                {
+                    next = LEX_BLOCK_COMMENT;
+                }
+                break;
+            case LEX_STRING:
+                if (c == '"')
+                {
+                    next = LEX_CODE;
+                }
+                else if (c == '\\')
+                {
+                    next = LEX_STRING_ESCAPE;
+                }
+                break;
+            case LEX_CHAR:
+                if (c == '\'')
+                {
+                    next = LEX_CODE;
+                }
+                else if (c == '\\')
+                {
+                    next = LEX_CHAR_ESCAPE;
+                }
+                break;
+            case LEX_STRING_ESCAPE:
+                next = LEX_STRING;
+                break;
+            case LEX_CHAR_ESCAPE:
+                next = LEX_CHAR;
+                break;
+            case LEX_RAW_DELIMITER:
+                if (c == '(')
+                {
+                    next = LEX_RAW;
+                }
+                else if ((s->raw_len == SCAN_RAW_DELIMITER_MAX) || (c == ' ')
+                         || (c == ')') || (c == '\\')
+                         || ((unsigned char)c < 0x21U)
+                         || ((unsigned char)c > 0x7EU))
+                {
+                    /* not a raw string after all */
+                    lex_enter(s, LEX_STRING);
+                    continue;
+                }
+                else
+                {
+                    s->raw_delimiter[s->raw_len++] = c;
+                }
+                break;
+            case LEX_RAW:
+                if (c == ')')
+                {
+                    next = LEX_RAW_CLOSE;
+                    s->raw_match = 0U;
+                }
+                break;
+            case LEX_RAW_CLOSE:
+                if ((s->raw_match < s->raw_len)
+                    && (c == s->raw_delimiter[s->raw_match]))
+                {
+                    s->raw_match++;
+                }
+                else if ((s->raw_match == s->raw_len) && (c == '"'))
+                {
+                    next = LEX_CODE;
+                }
+                else if (c == ')')
+                {
+                    s->raw_match = 0U;
+                }
+                else
+                {
+                    next = LEX_RAW;
+                }
+                break;
+            default:
+                break;
+        }
+
+        uint8_t cls = s->table->cls[(unsigned char)c];
+        if (next != state)
+        {
+            lex_enter(s, next);
+        }
+        return cls;
+    }
+}
+
+/*
+ * Starts the output of a violation of up to len bytes, "line N:" for a
+ * line's first.
+ */
+static char*
+report_start(scan_t* s, size_t len)
+{
+    char* q = report_reserve(s->out, REPORT_UINT_MAX_LEN + 8U + len);
+    if ((q != NULL) && (s->line != s->last_line))
+    {
+        memcpy(q, "line ", 5U);
+        q = report_format_uint(q + 5, s->line);
+        *q++ = ':';
+        s->last_line = s->line;
+    }
+
+    return q;
+}
+
+/* Appends " 0xXX (c)", preceded by "line N:" for the first one of a line. */
+static void
+report_char(scan_t* s, unsigned char c, uint8_t cls)
+{
+    char* q = report_start(s, 24U);
+    if (q == NULL)
+    {
+        return;
+    }
+
+    memcpy(q, " 0x", 3U);
+    q = report_format_hex(q + 3, c);
+    if (cls != CHAR_CLASS_CONTROL) /* control characters would garble it */
+    {
+        *q++ = ' ';
+        *q++ = '(';
+        *q++ = (char)c;
+        *q++ = ')';
+    }
+    report_commit(s->out, q);
+}
+
+/*
+ * Appends " U+XXXX" for a character that is not permitted, never the
+ * character itself, or the bytes " 0xXX 0xXX" of an ill-formed sequence.
+ */
+static void
+report_utf8(scan_t* s, uint32_t cp)
+{
+    char* q = report_start(s, 24U);
+    if (q == NULL)
+    {
+        return;
+    }
+
+    if (cp == UTF8_MALFORMED)
+    {
+        for (unsigned int i = 0U; i < s->utf8_len; i++)
+        {
+            memcpy(q, " 0x", 3U);
+            q = report_format_hex(q + 3, s->utf8_seq[i]);
+        }
+    }
+    else
+    {
+        memcpy(q, " U+", 3U);
+        q += 3;
+        if (cp > 0xFFFFFU)
+        {
+            q = report_format_hex(q, (unsigned char)(cp >> 16));
+        }
+        else if (cp > 0xFFFFU)
+        {
+            *q++ = "0123456789ABCDEF"[cp >> 16];
+        }
+        q = report_format_hex(q, (unsigned char)(cp >> 8));
+        q = report_format_hex(q, (unsigned char)cp);
+    }
+    report_commit(s->out, q);
+}
+
+/* Appends " 0xXXXX.. (chars)", the latter if all are printable ASCII. */
+static void
+report_sequence(scan_t* s, const char* seq, size_t len)
+{
+    char* q = report_start(s, (3U * len) + 6U);
+    if (q == NULL)
+    {
+        return;
+    }
+
+    bool printable = true;
+    memcpy(q, " 0x", 3U);
+    q += 3;
+    for (size_t i = 0U; i < len; i++)
+    {
+        unsigned char c = (unsigned char)seq[i];
+        q = report_format_hex(q, c);
+        printable = printable && (c >= 0x20U) && (c <= 0x7EU);
+    }
+    if (printable)
+    {
+        *q++ = ' ';
+        *q++ = '(';
+        memcpy(q, seq, len);
+        q += len;
+        *q++ = ')';
+    }
+    report_commit(s->out, q);
+}
+
+static inline unsigned int
+continuations(const unsigned char* p, size_t len)
+{
+    unsigned int n = 0U;
+    for (size_t i = 0U; i < len; i++)
+    {
+        n += ((p[i] & 0xC0U) == 0x80U) ? 1U : 0U;
+    }
+
+    return n;
+}
+
+/*
+ * Counts the forbidden sequence of pattern that ends at offset last, false if
+ * to stop then. It lies on the current line, as it holds no EOL indicator.
+ * Characters are scanned up to p, the bytes from behind the sequence to p are
+ * in the chunk.
+ */
+static bool
+sequence_found(scan_t* s, uint64_t last, const char* behind, const char* p,
+               unsigned int pattern)
+{
+    size_t len;
+    const char* seq = match_pattern(s->match, pattern, &len);
+    uint64_t offset = last + 1U - len;
+
+    if (s->out != NULL)
+    {
+        report_sequence(s, seq, len);
+    }
+    if (s->callback != NULL)
+    {
+        /*
+         * line_extra counts the characters complete up to p, those from the
+         * sequence on are taken back, an open one is not counted yet.
+         */
+        unsigned int extra = 0U;
+        if (s->table->cls[0x80] == CHAR_CLASS_UTF8)
+        {
+            extra = continuations((const unsigned char*)seq, len)
+                    + continuations((const unsigned char*)behind,
+                                    (size_t)(p - behind));
+            if (s->utf8_len != 0U)
+            {
+                size_t from = (s->utf8_offset < offset)
+                              ? (size_t)(offset - s->utf8_offset) : 0U;
+                if (from < s->utf8_len)
+                {
+                    extra -= continuations(&s->utf8_seq[from],
+                                           s->utf8_len - from);
+                }
+            }
+        }
+        const scan_violation_t v =
+        {
+            .kind = SCAN_VIOLATION_SEQUENCE,
+            .offset = offset,
+            .line = s->line,
+            .column = column(s, offset),
+            .char_column = column(s, offset) + extra - s->line_extra,
+            .length = (unsigned int)len,
+            .c = (unsigned char)seq[0],
+            .code_point = (unsigned char)seq[0],
+            .sequence = seq
+        };
+        s->callback(s->user, &v);
+    }
+    s->errors++;
+
+    return !s->first;
+}
+
+/* Counts the current UTF-8 character as invalid, false if to stop then. */
+static bool
+utf8_invalid(scan_t* s, uint32_t cp)
+{
+    if (s->out != NULL)
+    {
+        report_utf8(s, cp);
+    }
+    if (s->callback != NULL)
+    {
+        const scan_violation_t v =
+        {
+            .kind = SCAN_VIOLATION_CHAR,
+            .offset = s->utf8_offset,
+            .line = s->line,
+            .column = column(s, s->utf8_offset),
+            .char_column = column(s, s->utf8_offset) - s->line_extra,
+            .length = s->utf8_len,
+            .c = s->utf8_seq[0],
+            .code_point = cp
+        };
+        s->callback(s->user, &v);
+    }
+    s->errors++;
+
+    return !s->first;
+}
+
+/*
+ * Feeds the bytes from p to the decoder until the current character is
+ * complete or found ill-formed, returns the position of the next byte to
+ * scan. A byte that breaks a sequence is left to be scanned on its own, the
+ * sequence up to it counts as one invalid character. Sets *stop if scanning
+ * has to stop. Returns end with the character still open.
+ */
+static const char*
+utf8_feed(scan_t* s, const char* p, const char* end, bool* stop)
+{
+    for (; p < end; p++)
+    {
+        unsigned char b = (unsigned char)*p;
+        unsigned int state = utf8_step(s->utf8_state, &s->utf8_cp, b);
+        if (state == UTF8_REJECT)
+        {
+            if (s->utf8_len == 0U) /* not a lead byte */
+            {
+                s->utf8_seq[s->utf8_len++] = b;
+                p++;
+            }
+            s->utf8_state = UTF8_ACCEPT;
+            *stop = !utf8_invalid(s, UTF8_MALFORMED);
+            s->line_extra += s->utf8_len - 1U;
+            s->utf8_len = 0U;
+            return p;
+        }
+
+        s->utf8_seq[s->utf8_len++] = b;
+        s->utf8_state = state;
+        if (state == UTF8_ACCEPT)
+        {
+            uint32_t cp = s->utf8_cp;
+            if (!utf8_allowed(s->table->ranges, s->table->range_count, cp)
+                && !((cp == UTF8_BOM) && (s->utf8_offset == 0U)))
+            {
+                *stop = !utf8_invalid(s, cp);
+            }
+            s->line_extra += s->utf8_len - 1U;
+            s->utf8_len = 0U;
+            return p + 1;
+        }
+    }
+
+    return p;
+}
+
+static inline bool
+eol_mismatch(scan_t* s, uint64_t offset)
+{
+    s->eol_error_line = s->line;
+    s->eol_error_offset = offset;
+    s->eol_error_column = column(s, offset);
+    s->eol_error_char_column = column(s, offset) - s->line_extra;
+    return false;
+}
+
+/*
+ * Takes the EOL indicator at offset, which locks the EOL or ends the line.
+ * Returns false on a mismatch, which is reported at the first byte.
+ */
+static inline bool
+eol_step(scan_t* s, eol_symbol_t symbol, uint64_t offset)
+{
+    uint8_t next = eol_transition[s->eol][symbol];
+
+    if (next == EOL_MISMATCH)
+    {
+        return eol_mismatch(s, offset);
+    }
+    s->eol = (eol_t)next;
+    next_line(s, offset + eol_symbol_len[symbol]);
+
+    return true;
+}
+
+/* Whether a CR is only known with the next byte, CR or CRLF. */
+static inline bool
+eol_lookahead(eol_t eol)
+{
+    return (eol == EOL_AUTO_NA) || (eol == EOL_CRLF);
+}
+
+/*
+ * The body of scan_chunk(), inlined into a kernel per combination of the
+ * flags, which are constants there: verbose output, the lexer and forbidden
+ * sequences. Their branches in the loop over the bytes are gone then. Without
+ * fast_path, all bytes are scanned one by one, as by scan_chunk_generic().
+ */
+SCAN_INLINE bool
+scan_kernel(scan_t* s, const char* buf, size_t len, bool verbose, bool lexer,
+            bool matcher, bool fast_path)
+{
+    const char* p = buf;
+    const char* end = buf + len;
+    uint64_t base = s->offset;
+    s->offset += len;
+    bool stop = false;
+    const char* hit = end; /* last byte of the next forbidden sequence */
+    unsigned int pattern = 0U;
+    if (matcher)
+    {
+        hit = match_next(s->match, &s->match_state, buf, end, &pattern);
+    }
+
+    if (s->utf8_len != 0U) /* character started in the previous chunk */
+    {
+        p = utf8_feed(s, p, end, &stop);
+        if (stop)
+        {
+            return false;
+        }
+    }
+
+    if (s->cr_pending && (p < end))
+    {
+        s->cr_pending = false;
+        eol_symbol_t symbol = (*p == '\n') ? EOL_SYMBOL_CRLF : EOL_SYMBOL_CR;
+        if (!eol_step(s, symbol, base - 1U)) /* at the CR */
+        {
+            return false;
+        }
+        p += (symbol == EOL_SYMBOL_CRLF) ? 1 : 0;
+    }
+
+    const char* fast = p; /* next position worth a try of the fast path */
+    /* only the lexer switches tables, without it they are kept at hand */
+    const uint8_t* const classes = s->cls;
+    const simd_set_t* const set = s->simd;
+    for (; p < end; p++)
+    {
+        /* sequences are reported in order, behind their last byte */
+        while (matcher && (hit < p))
+        {
+            if (!sequence_found(s, base + (uint64_t)(hit - buf), hit + 1, p,
+                                pattern))
+            {
+                return false;
+            }
+            hit = match_next(s->match, &s->match_state, hit + 1, end, &pattern);
+        }
+
+        /*
+         * Clean blocks are skipped as a whole once the EOL is known, up to
+         * the next sequence. Not while a verbose line is still open, its
+         * terminator needs output.
+         */
+        const simd_set_t* simd = lexer ? s->simd : set;
+        if (fast_path && (simd != NULL) && (p >= fast)
+            && (s->eol != EOL_AUTO_NA)
+            && ((size_t)(hit - p) >= SIMD_BLOCK_SIZE)
+            && (!verbose || (s->last_line != s->line)))
+        {
+            unsigned int line = s->line;
+            size_t line_start = 0U;
+            uint64_t from = base + (uint64_t)(p - buf);
+            size_t skipped = simd->skip(simd, p, (size_t)(hit - p),
+                                      s->eol, &s->line, &line_start);
+            stats_count(&s->simd_bytes, skipped);
+            p += skipped;
+            fast = p + SIMD_BLOCK_SIZE; /* the block the kernel stopped at */
+            if (s->line != line)
+            {
+                /* no UTF-8 sequence in skipped blocks, a byte per character */
+                s->line_start = from + line_start;
+                s->line_extra = 0U;
+            }
+            if (p == end)
+            {
+                break;
+            }
+        }
+
+        uint8_t cls = (lexer ? s->cls : classes)[(unsigned char)*p];
+        if (lexer && (cls == CHAR_CLASS_LEX))
+        {
+            cls = lex(s, buf, p);
+        }
+        if (cls == CHAR_CLASS_VALID)
+        {
+            continue;
+        }
+
+        switch (cls)
+        {
+            case CHAR_CLASS_LF:
+                if (!eol_step(s, EOL_SYMBOL_LF, base + (uint64_t)(p - buf)))
+                {
+                    return false;
+                }
+                break;
+            case CHAR_CLASS_CR:
+            {
+                eol_symbol_t symbol = EOL_SYMBOL_CR;
+                if (eol_lookahead(s->eol))
+                {
+                    if ((p + 1) == end)
+                    {
+                        s->cr_pending = true;
+                        if (lexer)
+                        {
+                            keep_tail(s, buf, len);
+                        }
+                        return true;
+                    }
+                    if (*(p + 1) == '\n')
+                    {
+                        symbol = EOL_SYMBOL_CRLF;
+                    }
+                }
+                if (!eol_step(s, symbol, base + (uint64_t)(p - buf)))
+                {
+                    return false;
+                }
+                if (symbol == EOL_SYMBOL_CRLF)
+                {
+                    p++; /* skip the second EOL character */
+                }
+                break;
+            }
+            case CHAR_CLASS_UTF8:
+                s->utf8_offset = base + (uint64_t)(p - buf);
+                p = utf8_feed(s, p, end, &stop) - 1; /* consumed at least p */
+                if (stop)
+                {
+                    return false;
+                }
+                break;
+            default: /* CHAR_CLASS_INVALID, CHAR_CLASS_CONTROL */
+                if (verbose)
+                {
+                    report_char(s, (unsigned char)*p, cls);
+                }
+                if (s->callback != NULL)
+                {
+                    uint64_t offset = base + (uint64_t)(p - buf);
+                    const scan_violation_t v =
+                    {
+                        .kind = SCAN_VIOLATION_CHAR,
+                        .offset = offset,
+                        .line = s->line,
+                        .column = column(s, offset),
+                        .char_column = column(s, offset) - s->line_extra,
+                        .length = 1U,
+                        .c = (unsigned char)*p,
+                        .code_point = (unsigned char)*p
+                    };
+                    s->callback(s->user, &v);
+                }
+                s->errors++;
+                if (s->first)
+                {
+                    return false;
+                }
+                break;
+        }
+    }
+    while (matcher && (hit < end))
+    {
+        if (!sequence_found(s, base + (uint64_t)(hit - buf), hit + 1, p,
+                            pattern))
+        {
+            return false;
+        }
+        hit = match_next(s->match, &s->match_state, hit + 1, end, &pattern);
+    }
+    if (lexer)
+    {
+        keep_tail(s, buf, len);
+    }
+
+    return true;
+}
+
+#define SCAN_KERNEL(name, verbose, lexer, matcher, fast_path) \
+    static bool \
+    name(scan_t* s, const char* buf, size_t len) \
+    { \
+        return scan_kernel(s, buf, len, verbose, lexer, matcher, fast_path); \
+    }
+
+SCAN_KERNEL(scan_plain, false, false, false, true)
+SCAN_KERNEL(scan_plain_match, false, false, true, true)
+SCAN_KERNEL(scan_lex, false, true, false, true)
+SCAN_KERNEL(scan_lex_match, false, true, true, true)
+SCAN_KERNEL(scan_verbose, true, false, false, true)
+SCAN_KERNEL(scan_verbose_match, true, false, true, true)
+SCAN_KERNEL(scan_verbose_lex, true, true, false, true)
+SCAN_KERNEL(scan_verbose_lex_match, true, true, true, true)
+
+/* Indexed by SCAN_KERNEL_VERBOSE | SCAN_KERNEL_LEXER | SCAN_KERNEL_MATCHER. */
+static bool (*const scan_kernels[8])(scan_t*, const char*, size_t) =
+{
+    scan_plain, scan_plain_match, scan_lex, scan_lex_match,
+    scan_verbose, scan_verbose_match, scan_verbose_lex, scan_verbose_lex_match
+};
+
+bool
+scan_chunk_generic(scan_t* s, const char* buf, size_t len)
+{
+    if ((s->eol_error_line != 0U) || (s->first && (s->errors != 0U)))
+    {
+        return false;
+    }
+
+    return scan_kernel(s, buf, len, s->out != NULL, s->lex != NULL,
+                       s->match != NULL, false);
+}
+
+bool
+scan_chunk(scan_t* s, const char* buf, size_t len)
+{
+    if ((s->eol_error_line != 0U) || (s->first && (s->errors != 0U)))
+    {
+        return false;
+    }
+
+    return scan_kernels[s->kernel](s, buf, len);
+}
+
+void
+scan_finish(scan_t* s)
+{
+    /* once stopped, what is still open is moot like the rest of the input */
+    bool stopped = (s->eol_error_line != 0U) || (s->first && (s->errors != 0U));
+
+    if ((s->utf8_len != 0U) && !stopped) /* truncated at the end */
+    {
+        (void)utf8_invalid(s, UTF8_MALFORMED);
+    }
+    s->utf8_state = UTF8_ACCEPT;
+    s->utf8_len = 0U;
+    if (s->cr_pending && !stopped)
+    {
+        s->cr_pending = false;
+        (void)eol_step(s, EOL_SYMBOL_CR, s->offset - 1U);
+    }
+
+    /* terminate the last reported line if the input lacks a final EOL */
+    if ((s->out != NULL) && (s->last_line == s->line))
+    {
+        report_putc(s->out, '\n');
+        s->last_line = 0U;
+    }
+}
@@ -0,0 +1,194 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_SCAN_H
+#define CVC_SCAN_H
+
+#include "eol.h"
+#include "match.h"
+#include "report.h"
+#include "simd.h"
+#include "utf8.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_VALID_CHAR  (126 + 1)
+#define CHAR_TABLE_SIZE (256) /* one entry per byte value */
+#define SCAN_RAW_DELIMITER_MAX (16U) /* d-char-sequence of a raw string */
+#define SCAN_LOOKBEHIND        (16U) /* bytes kept from previous chunks */
+
+typedef enum
+{
+    CHAR_CLASS_VALID,
+    CHAR_CLASS_INVALID,  /* printable ASCII or above 0x7E */
+    CHAR_CLASS_CONTROL,  /* invalid control character, e.g. NUL */
+    CHAR_CLASS_CR,
+    CHAR_CLASS_LF,
+    CHAR_CLASS_UTF8,     /* above 0x7F in UTF-8 mode, decoded */
+    CHAR_CLASS_LEX       /* may change the lexical context, see lex.h */
+} char_class_t;
+
+/*
+ * Compiled form of the character options, built once and copied by each
+ * thread. cls holds a char_class_t per byte value. CR and LF are always
+ * classified as such, their validity is a matter of the EOL. In UTF-8 mode,
+ * characters above U+007F are checked against ranges instead.
+ */
+typedef struct
+{
+    uint8_t cls[CHAR_TABLE_SIZE];
+    simd_set_t simd;
+    unsigned int range_count;
+    utf8_range_t ranges[UTF8_RANGES_MAX];
+} char_table_t;
+
+typedef struct lex_table lex_table_t;
+
+typedef enum
+{
+    SCAN_VIOLATION_CHAR,
+    SCAN_VIOLATION_EOL,
+    SCAN_VIOLATION_SEQUENCE /* forbidden, see scan_set_matcher() */
+} scan_violation_kind_t;
+
+/*
+ * Location and contents of an invalid character, an EOL mismatch or a
+ * forbidden sequence. c is the (first) byte, code_point the decoded
+ * character, which is c without UTF-8 and UTF8_MALFORMED for an ill-formed
+ * sequence.
+ */
+typedef struct
+{
+    scan_violation_kind_t kind;
+    uint64_t offset;     /* in the input */
+    unsigned int line;   /* starting at 1 */
+    unsigned int column; /* in bytes, starting at 1 */
+    unsigned int char_column; /* in characters, code points with UTF-8 */
+    unsigned int length; /* bytes of the character */
+    unsigned char c;
+    uint32_t code_point;
+    const char* sequence; /* the length bytes of a forbidden sequence */
+} scan_violation_t;
+
+/* Called for each invalid character. */
+typedef void (*scan_callback_t)(void* user, const scan_violation_t* v);
+
+/*
+ * State of a single-pass validation. The input is fed in chunks of arbitrary
+ * size, EOL detection, EOL consistency and character validation are done in
+ * the same pass. A CR at the end of a chunk is kept pending until the first
+ * byte of the next chunk tells whether it starts a CRLF pair.
+ */
+typedef struct
+{
+    const char_table_t* table;   /* of the current lexical context */
+    const uint8_t* cls;          /* classes in the current lexer state */
+    const simd_set_t* simd;      /* fast path for clean blocks, or NULL */
+    report_t* out;               /* verbose output, NULL if disabled */
+    scan_callback_t callback;    /* per invalid character, or NULL */
+    void* user;                  /* passed to callback */
+    bool first;                  /* stop at the first invalid character */
+    eol_t eol;                   /* expected or detected EOL */
+    bool cr_pending;             /* CR seen, next byte decides CR or CRLF */
+    unsigned int line;
+    unsigned int last_line;      /* last line reported in verbose mode */
+    unsigned int errors;
+    unsigned int eol_error_line; /* 0 = no EOL mismatch (yet) */
+    uint64_t eol_error_offset;   /* of the mismatching EOL character */
+    unsigned int eol_error_column;
+    unsigned int eol_error_char_column;
+    uint64_t line_start;         /* offset of the first byte of the line */
+    unsigned int line_extra;     /* bytes of its characters beyond the first */
+    uint64_t offset;             /* bytes scanned before the current chunk */
+    unsigned int utf8_state;     /* of the decoder, UTF8_ACCEPT in between */
+    uint32_t utf8_cp;
+    unsigned int utf8_len;       /* bytes of the current character so far */
+    unsigned char utf8_seq[UTF8_SEQ_MAX];
+    uint64_t utf8_offset;        /* of the current character */
+    const lex_table_t* lex;      /* NULL if code is not told from comments */
+    unsigned int lex_state;
+    unsigned int raw_len;        /* raw string delimiter */
+    unsigned int raw_match;      /* bytes of it matched while closing */
+    char raw_delimiter[SCAN_RAW_DELIMITER_MAX];
+    unsigned int tail_len;
+    char tail[SCAN_LOOKBEHIND];  /* last bytes of the previous chunks */
+    uint64_t simd_bytes;         /* skipped by the fast path, for --stats */
+    const match_t* match;        /* forbidden sequences, or NULL */
+    unsigned int match_state;
+    unsigned int kernel;         /* specialized scan_chunk(), see scan.c */
+} scan_t;
+
+/* valid_chars has CHAR_TABLE_SIZE entries. */
+void
+char_table_build(char_table_t* t, const bool* valid_chars,
+                 simd_backend_t backend);
+
+/*
+ * Switches t to UTF-8 mode: bytes above 0x7F are decoded and the characters
+ * permitted if within one of the ranges, flagged ones never are. A byte order
+ * mark is accepted at the start of the input.
+ */
+void
+char_table_set_utf8(char_table_t* t, const utf8_range_t* ranges,
+                    unsigned int count);
+
+void
+scan_init(scan_t* s, const char_table_t* table, eol_t eol, report_t* out,
+          bool first);
+
+void
+scan_set_callback(scan_t* s, scan_callback_t callback, void* user);
+
+/*
+ * Validates comments, string and character literals with the tables of
+ * their context, see lex.h. The table given to scan_init() is not used then.
+ */
+void
+scan_set_lexer(scan_t* s, const lex_table_t* lex);
+
+/*
+ * Reports the sequences of match as well, each as one violation at its first
+ * byte, found in the same pass and across chunks.
+ */
+void
+scan_set_matcher(scan_t* s, const match_t* match);
+
+/*
+ * Continues the input at offset, the start of a line behind an EOL indicator
+ * that locked eol, as if all before it had been scanned. Lines and errors are
+ * counted from there on, which allows to scan parts of an input separately.
+ */
+void
+scan_seek(scan_t* s, uint64_t offset, eol_t eol);
+
+/*
+ * Returns false once an EOL mismatch was found or, if first is set, an
+ * invalid character. The remaining input is moot then.
+ */
+bool
+scan_chunk(scan_t* s, const char* buf, size_t len);
+
+/*
+ * As scan_chunk(), but with the flags tested as they go instead of a kernel
+ * specialized for them, and byte by byte without the fast path. Slow, it is
+ * the reference the kernels are tested against.
+ */
+bool
+scan_chunk_generic(scan_t* s, const char* buf, size_t len);
+
+/*
+ * Ends the input: a UTF-8 character still open is ill-formed, a pending CR
+ * ends the line. Neither counts once the scan has stopped.
+ */
+void
+scan_finish(scan_t* s);
+
+#endif /* CVC_SCAN_H */
@@ -0,0 +1,147 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#include "segment.h"
+#include "pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SEGMENT_MAX     (64U)
+
+typedef struct
+{
+    const char* data;
+    size_t bounds[SEGMENT_MAX + 1U]; /* segment i is bounds[i] to bounds[i + 1] */
+    scan_t scans[SEGMENT_MAX];
+} segments_t;
+
+static void
+segment_task(size_t task, unsigned int worker, void* arg)
+{
+    segments_t* job = arg;
+    size_t start = job->bounds[task];
+
+    (void)worker;
+    (void)scan_chunk(&job->scans[task], job->data + start,
+                     job->bounds[task + 1U] - start);
+}
+
+/*
+ * Splits at the first LF behind each of count equal parts. Returns the number
+ * of segments, parts without an LF are merged into the one before.
+ */
+static size_t
+split(segments_t* job, size_t len, size_t count)
+{
+    size_t n = 1U;
+
+    job->bounds[0] = 0U;
+    for (size_t k = 1U; k < count; k++)
+    {
+        size_t from = (len / count) * k;
+        if (from < job->bounds[n - 1U])
+        {
+            continue; /* the last segment reaches beyond */
+        }
+        const char* lf = memchr(job->data + from, '\n', len - from);
+        if ((lf == NULL) || ((size_t)(lf + 1 - job->data) == len))
+        {
+            break;
+        }
+        job->bounds[n++] = (size_t)(lf + 1 - job->data);
+    }
+    job->bounds[n] = len;
+
+    return n;
+}
+
+bool
+segment_scan(scan_t* s, const char* data, size_t len, unsigned int threads)
+{
+    size_t count = len / SEGMENT_MIN_SIZE;
+    if (count > threads)
+    {
+        count = threads;
+    }
+    if (count > SEGMENT_MAX)
+    {
+        count = SEGMENT_MAX;
+    }
+    if (count < 2U)
+    {
+        return false;
+    }
+
+    segments_t* job = malloc(sizeof(segments_t));
+    if (job == NULL)
+    {
+        return false;
+    }
+    job->data = data;
+    size_t n = split(job, len, count);
+
+    /*
+     * Behind an LF, the EOL is CRLF if a CR precedes it, or LF. Any other EOL
+     * locked before is a mismatch in a segment before, which ends the scan.
+     */
+    for (size_t i = 0U; i < n; i++)
+    {
+        size_t start = job->bounds[i];
+        job->scans[i] = *s;
+        if (i > 0U)
+        {
+            bool crlf = (start >= 2U) && (data[start - 2U] == '\r');
+            scan_seek(&job->scans[i], s->offset + start,
+                      crlf ? EOL_CRLF : EOL_LF);
+        }
+    }
+
+    pool_t* pool = (n > 1U) ? pool_start((unsigned int)n, n, segment_task, job)
+                            : NULL;
+    if (pool == NULL)
+    {
+        free(job);
+        return false;
+    }
+    pool_join(pool);
+
+    /* the first segment that stops the scan has the state to continue with */
+    unsigned int errors = 0U;
+    unsigned int lines = 0U; /* EOL indicators in the segments before */
+    uint64_t end = s->offset + len;
+    uint64_t simd_bytes = s->simd_bytes;
+    for (size_t i = 0U; i < n; i++)
+    {
+        simd_bytes += job->scans[i].simd_bytes - s->simd_bytes;
+    }
+    for (size_t i = 0U; i < n; i++)
+    {
+        const scan_t* seg = &job->scans[i];
+        errors += seg->errors;
+        if ((seg->eol_error_line != 0U) || (seg->first && (errors != 0U))
+            || (i == (n - 1U)))
+        {
+            *s = *seg;
+            break;
+        }
+        lines += seg->line - 1U;
+    }
+    s->errors = errors;
+    s->line += lines;
+    if (s->eol_error_line != 0U)
+    {
+        s->eol_error_line += lines;
+    }
+    s->offset = end;
+    s->simd_bytes = simd_bytes;
+    free(job);
+
+    return true;
+}
@@ -0,0 +1,32 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_SEGMENT_H
+#define CVC_SEGMENT_H
+
+#include "scan.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Inputs are only split into segments of at least this size. */
+#define SEGMENT_MIN_SIZE    (8U * 1024U * 1024U)
+
+/*
+ * Scans an input held in memory as a whole in up to threads segments at once,
+ * for s as set up by scan_init(), without output and lexer. Segments start
+ * behind an LF, so no EOL indicator or UTF-8 character crosses a boundary.
+ * Afterwards s is in the state a single scan_chunk() over the input would
+ * leave, scan_finish() is still to be called. Returns false, with s unchanged,
+ * if the input is not worth splitting or no thread could be started.
+ */
+bool
+segment_scan(scan_t* s, const char* data, size_t len, unsigned int threads);
+
+#endif /* CVC_SEGMENT_H */
@@ -0,0 +1,439 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "serve.h"
+#include "reader.h"
+#include "report.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVE_CHUNK_SIZE    (16U * 1024U)
+#define SERVE_PATH_MAX      (4096U)
+#define SERVE_BACKLOG       (16)
+#define SERVE_ERROR_INPUT   (4) /* exit codes of cvc */
+#define SERVE_ERROR_REQUEST (5)
+
+typedef struct
+{
+    int in;
+    int out;
+    bool socket;
+    cvc_t* ctx;
+    report_t lines; /* violations of the current request */
+    char* buf;
+} connection_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static bool
+read_full(int fd, void* buf, size_t len)
+{
+    char* p = buf;
+
+    while (len > 0U)
+    {
+        ssize_t n = read(fd, p, len);
+        if (n > 0)
+        {
+            p += n;
+            len -= (size_t)n;
+        }
+        else if ((n == 0) || (errno != EINTR))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+write_full(const connection_t* c, const void* buf, size_t len)
+{
+    const char* p = buf;
+
+    while (len > 0U)
+    {
+        /* a client gone away must not kill the server */
+        ssize_t n = c->socket ? send(c->out, p, len, MSG_NOSIGNAL)
+                              : write(c->out, p, len);
+        if (n > 0)
+        {
+            p += n;
+            len -= (size_t)n;
+        }
+        else if ((n == 0) || (errno != EINTR))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Discards the rest of a request, to stay in sync with the client. */
+static bool
+skip(connection_t* c, uint32_t len)
+{
+    while (len > 0U)
+    {
+        size_t n = (len < SERVE_CHUNK_SIZE) ? len : SERVE_CHUNK_SIZE;
+        if (!read_full(c->in, c->buf, n))
+        {
+            return false;
+        }
+        len -= (uint32_t)n;
+    }
+
+    return true;
+}
+
+static void
+on_violation(const cvc_violation_t* v, void* user)
+{
+    connection_t* c = user;
+    char* q = report_reserve(&c->lines, (3U * REPORT_UINT_MAX_LEN) + 16U);
+    if (q == NULL)
+    {
+        return;
+    }
+
+    switch (v->kind)
+    {
+        case CVC_VIOLATION_EOL:
+            memcpy(q, "eol ", 4U);
+            q += 4;
+            break;
+        case CVC_VIOLATION_SEQUENCE:
+            memcpy(q, "seq ", 4U);
+            q += 4;
+            break;
+        default:
+            memcpy(q, "char ", 5U);
+            q += 5;
+            break;
+    }
+    q = report_format_uint(q, v->line);
+    *q++ = ' ';
+    q = report_format_uint(q, (unsigned long)v->offset);
+    if (v->kind == CVC_VIOLATION_CHAR)
+    {
+        memcpy(q, " 0x", 3U);
+        q = report_format_hex(q + 3, v->byte);
+    }
+    else if (v->kind == CVC_VIOLATION_SEQUENCE)
+    {
+        *q++ = ' ';
+        q = report_format_uint(q, (unsigned long)v->length);
+    }
+    *q++ = '\n';
+    report_commit(&c->lines, q);
+}
+
+/* Sends the response "RESULT ERRORS", followed by the violations. */
+static bool
+respond(connection_t* c, int result, unsigned long errors)
+{
+    char head[4U + (2U * REPORT_UINT_MAX_LEN) + 2U];
+    char* q = report_format_uint(head + 4, (unsigned long)result);
+    *q++ = ' ';
+    q = report_format_uint(q, errors);
+    *q++ = '\n';
+
+    size_t lines = c->lines.oom ? 0U : c->lines.len;
+    uint32_t len = (uint32_t)((size_t)(q - head) - 4U + lines);
+    head[0] = (char)(len >> 24);
+    head[1] = (char)(len >> 16);
+    head[2] = (char)(len >> 8);
+    head[3] = (char)len;
+
+    bool ok = write_full(c, head, (size_t)(q - head))
+              && write_full(c, c->lines.data, lines);
+    c->lines.len = 0U;
+    c->lines.oom = false;
+
+    return ok;
+}
+
+static bool
+validate_buffer(connection_t* c, uint32_t len)
+{
+    bool feeding = true;
+
+    cvc_reset(c->ctx);
+    while (len > 0U)
+    {
+        size_t n = (len < SERVE_CHUNK_SIZE) ? len : SERVE_CHUNK_SIZE;
+        if (!read_full(c->in, c->buf, n))
+        {
+            return false;
+        }
+        len -= (uint32_t)n;
+        feeding = feeding && cvc_feed(c->ctx, c->buf, n);
+    }
+
+    cvc_summary_t summary;
+    (void)cvc_finish(c->ctx, &summary);
+
+    return respond(c, (int)summary.result, summary.errors);
+}
+
+static bool
+validate_path(connection_t* c, uint32_t len)
+{
+    char path[SERVE_PATH_MAX];
+
+    if ((len == 0U) || (len >= sizeof(path)))
+    {
+        return skip(c, len) && respond(c, SERVE_ERROR_REQUEST, 0U);
+    }
+    if (!read_full(c->in, path, len))
+    {
+        return false;
+    }
+    path[len] = '\0';
+
+    reader_t reader;
+    if (!reader_open(&reader, path, c->buf, SERVE_CHUNK_SIZE, true))
+    {
+        return respond(c, SERVE_ERROR_INPUT, 0U);
+    }
+    const char* data;
+    size_t n;
+    cvc_reset(c->ctx);
+    while (reader_next(&reader, &data, &n) && cvc_feed(c->ctx, data, n))
+    {
+    }
+    bool read_error = reader.error;
+    reader_close(&reader);
+
+    cvc_summary_t summary;
+    (void)cvc_finish(c->ctx, &summary);
+    if (read_error)
+    {
+        c->lines.len = 0U;
+        return respond(c, SERVE_ERROR_INPUT, 0U);
+    }
+
+    return respond(c, (int)summary.result, summary.errors);
+}
+
+/* Handles requests until the end of input or a broken connection. */
+static void
+serve(connection_t* c)
+{
+    for (;;)
+    {
+        unsigned char head[5];
+        if (!read_full(c->in, head, 4U))
+        {
+            return;
+        }
+        uint32_t len = ((uint32_t)head[0] << 24) | ((uint32_t)head[1] << 16)
+                       | ((uint32_t)head[2] << 8) | (uint32_t)head[3];
+        if (len == 0U)
+        {
+            if (!respond(c, SERVE_ERROR_REQUEST, 0U))
+            {
+                return;
+            }
+            continue;
+        }
+        if (!read_full(c->in, &head[4], 1U))
+        {
+            return;
+        }
+        len--;
+
+        bool ok;
+        switch (head[4])
+        {
+            case SERVE_REQUEST_BUFFER:
+                ok = validate_buffer(c, len);
+                break;
+            case SERVE_REQUEST_PATH:
+                ok = validate_path(c, len);
+                break;
+            default:
+                ok = skip(c, len) && respond(c, SERVE_ERROR_REQUEST, 0U);
+                break;
+        }
+        if (!ok)
+        {
+            return;
+        }
+    }
+}
+
+static bool
+connection_init(connection_t* c, int in, int out, bool socket,
+                const cvc_options_t* options)
+{
+    cvc_options_t o = *options;
+    o.callback = on_violation;
+    o.user = c;
+
+    c->in = in;
+    c->out = out;
+    c->socket = socket;
+    c->ctx = cvc_create(&o);
+    c->buf = malloc(SERVE_CHUNK_SIZE);
+    report_init(&c->lines, NULL);
+
+    return (c->ctx != NULL) && (c->buf != NULL);
+}
+
+static void
+connection_free(connection_t* c)
+{
+    cvc_destroy(c->ctx);
+    free(c->buf);
+    report_free(&c->lines);
+}
+
+bool
+serve_stdio(const cvc_options_t* options)
+{
+    connection_t c;
+    bool ok = connection_init(&c, STDIN_FILENO, STDOUT_FILENO, false, options);
+    if (ok)
+    {
+        serve(&c);
+    }
+    connection_free(&c);
+
+    return ok;
+}
+
+typedef struct
+{
+    int fd;
+    const cvc_options_t* options;
+} client_t;
+
+static void*
+serve_client(void* arg)
+{
+    client_t* client = arg;
+    connection_t c;
+
+    if (connection_init(&c, client->fd, client->fd, true, client->options))
+    {
+        serve(&c);
+    }
+    connection_free(&c);
+    (void)close(client->fd);
+    free(client);
+
+    return NULL;
+}
+
+static void
+on_stop(int signal)
+{
+    (void)signal;
+    stop_requested = 1;
+}
+
+bool
+serve_socket(const char* path, const cvc_options_t* options)
+{
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    /* a socket left behind by a previous server is replaced */
+    struct stat st;
+    if ((lstat(path, &st) == 0) && S_ISSOCK(st.st_mode))
+    {
+        (void)unlink(path);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if ((bind(fd, (const struct sockaddr*)&addr, sizeof(addr)) != 0)
+        || (listen(fd, SERVE_BACKLOG) != 0))
+    {
+        (void)close(fd);
+        return false;
+    }
+
+    /* no SA_RESTART: the signal interrupts accept() */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigemptyset(&sa.sa_mask);
+    (void)sigaction(SIGINT, &sa, NULL);
+    (void)sigaction(SIGTERM, &sa, NULL);
+    sigset_t stop_signals;
+    sigset_t old_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+
+    bool ok = true;
+    while (!stop_requested)
+    {
+        int client_fd = accept(fd, NULL, NULL);
+        if (client_fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            ok = false;
+            break;
+        }
+
+        client_t* client = malloc(sizeof(client_t));
+        pthread_t thread;
+        pthread_attr_t attr;
+        bool started = false;
+        if (client != NULL)
+        {
+            client->fd = client_fd;
+            client->options = options;
+            /* signals are left to this thread, clients run without them */
+            pthread_attr_init(&attr);
+            pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+            pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+            started = (pthread_create(&thread, &attr, serve_client, client) == 0);
+            pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+            pthread_attr_destroy(&attr);
+        }
+        if (!started)
+        {
+            free(client);
+            (void)close(client_fd);
+        }
+    }
+
+    (void)close(fd);
+    (void)unlink(path);
+
+    return ok;
+}
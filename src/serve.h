@@ -0,0 +1,40 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_SERVE_H
+#define CVC_SERVE_H
+
+#include "cvc.h"
+
+#include <stdbool.h>
+
+/*
+ * Server mode. Requests and responses are frames of a 4-byte length in
+ * network byte order followed by that many bytes. A request starts with its
+ * type, 'B' for a buffer to validate, which makes up the rest of the frame,
+ * or 'P' for the path of a file. The response is text: the line "RESULT
+ * ERRORS" with RESULT as the exit code of cvc, followed by one line per
+ * violation, "char LINE OFFSET 0xXX", "seq LINE OFFSET LENGTH" for a
+ * forbidden sequence or "eol LINE OFFSET".
+ */
+#define SERVE_REQUEST_BUFFER ('B')
+#define SERVE_REQUEST_PATH   ('P')
+
+/* Serves requests from standard input until its end. */
+bool
+serve_stdio(const cvc_options_t* options);
+
+/*
+ * Serves clients connecting to a Unix domain socket at path, each on its own
+ * thread, until SIGINT or SIGTERM. The socket is removed again.
+ */
+bool
+serve_socket(const char* path, const cvc_options_t* options);
+
+#endif /* CVC_SERVE_H */
@@ -0,0 +1,516 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#include "simd.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#define PRINTABLE_FIRST (0x20U)
+#define PRINTABLE_LAST  (0x7EU)
+
+static inline unsigned int
+popcount64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return (unsigned int)__builtin_popcountll(x);
+#else
+    unsigned int n = 0U;
+    for (; x != 0U; x &= x - 1U)
+    {
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* Index of the highest set bit, x must not be zero. */
+static inline unsigned int
+last_bit64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return 63U - (unsigned int)__builtin_clzll(x);
+#else
+    unsigned int i = 0U;
+    for (; (x >>= 1U) != 0U; i++)
+    {
+    }
+    return i;
+#endif
+}
+
+/*
+ * Decides on the block at offset i given the bitmasks of suspicious bytes, CR
+ * and LF, bit k standing for byte k. CR and LF themselves are never suspicious,
+ * only their use as EOL indicator is checked here. A CRLF pair must not cross
+ * the block. The line start is behind the last terminator, the LF of CRLF.
+ */
+static inline bool
+block_ok(uint64_t bad, uint64_t cr, uint64_t lf, eol_t eol, size_t i,
+         unsigned int* lines, size_t* line_start)
+{
+    uint64_t n;
+
+    switch (eol)
+    {
+        case EOL_LF:
+            bad |= cr;
+            n = lf;
+            break;
+        case EOL_CR:
+            bad |= lf;
+            n = cr;
+            break;
+        case EOL_CRLF:
+            bad |= ((cr << 1) ^ lf) | (cr >> 63);
+            n = lf;
+            break;
+        default:
+            return false;
+    }
+    if (bad != 0U)
+    {
+        return false;
+    }
+    if (n != 0U)
+    {
+        *lines += popcount64(n);
+        *line_start = i + last_bit64(n) + 1U;
+    }
+
+    return true;
+}
+
+#if defined(SIMD_X86)
+
+static size_t
+skip_sse2(const simd_set_t* set, const char* p, size_t len, eol_t eol,
+          unsigned int* lines, size_t* line_start)
+{
+    const __m128i first = _mm_set1_epi8((char)PRINTABLE_FIRST);
+    const __m128i last = _mm_set1_epi8((char)PRINTABLE_LAST);
+    const __m128i cr_v = _mm_set1_epi8('\r');
+    const __m128i lf_v = _mm_set1_epi8('\n');
+    __m128i accept[SIMD_LIST_SIZE];
+    __m128i reject[SIMD_LIST_SIZE];
+    for (unsigned int k = 0U; k < set->accept_count; k++)
+    {
+        accept[k] = _mm_set1_epi8((char)set->accept[k]);
+    }
+    for (unsigned int k = 0U; k < set->reject_count; k++)
+    {
+        reject[k] = _mm_set1_epi8((char)set->reject[k]);
+    }
+
+    size_t i = 0U;
+    for (; (i + SIMD_BLOCK_SIZE) <= len; i += SIMD_BLOCK_SIZE)
+    {
+        uint64_t bad = 0U;
+        uint64_t cr = 0U;
+        uint64_t lf = 0U;
+        for (unsigned int j = 0U; j < 4U; j++)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(const void*)(p + i + (16U * j)));
+            __m128i ok = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, first), v),
+                                       _mm_cmpeq_epi8(_mm_min_epu8(v, last), v));
+            for (unsigned int k = 0U; k < set->reject_count; k++)
+            {
+                ok = _mm_andnot_si128(_mm_cmpeq_epi8(v, reject[k]), ok);
+            }
+            for (unsigned int k = 0U; k < set->accept_count; k++)
+            {
+                ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, accept[k]));
+            }
+            unsigned int shift = 16U * j;
+            bad |= (uint64_t)(~(unsigned int)_mm_movemask_epi8(ok) & 0xFFFFU) << shift;
+            cr |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, cr_v)) << shift;
+            lf |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf_v)) << shift;
+        }
+        if (!block_ok(bad, cr, lf, eol, i, lines, line_start))
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t
+suspicious_avx2(__m256i v, __m256i lo_tbl, __m256i hi_tbl)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i lo = _mm256_shuffle_epi8(lo_tbl, _mm256_and_si256(v, nibble));
+    __m256i hi = _mm256_shuffle_epi8(hi_tbl,
+                                     _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    __m256i zero = _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi),
+                                     _mm256_setzero_si256());
+
+    return ~(uint32_t)_mm256_movemask_epi8(zero);
+}
+
+__attribute__((target("avx2")))
+static size_t
+skip_avx2(const simd_set_t* set, const char* p, size_t len, eol_t eol,
+          unsigned int* lines, size_t* line_start)
+{
+    const __m256i lo_tbl = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i*)(const void*)set->lo_nibble));
+    const __m256i hi_tbl = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i*)(const void*)set->hi_nibble));
+    const __m256i cr_v = _mm256_set1_epi8('\r');
+    const __m256i lf_v = _mm256_set1_epi8('\n');
+
+    size_t i = 0U;
+    for (; (i + SIMD_BLOCK_SIZE) <= len; i += SIMD_BLOCK_SIZE)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(const void*)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(const void*)(p + i + 32U));
+        uint64_t bad = (uint32_t)suspicious_avx2(a, lo_tbl, hi_tbl)
+                       | ((uint64_t)suspicious_avx2(b, lo_tbl, hi_tbl) << 32);
+        uint64_t cr = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, cr_v))
+                      | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, cr_v)) << 32);
+        uint64_t lf = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, lf_v))
+                      | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, lf_v)) << 32);
+        if (!block_ok(bad, cr, lf, eol, i, lines, line_start))
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t
+find_avx2(const simd_set_t* set, const char* p, size_t len)
+{
+    const __m256i lo_tbl = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i*)(const void*)set->lo_nibble));
+    const __m256i hi_tbl = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i*)(const void*)set->hi_nibble));
+
+    size_t i = 0U;
+    for (; (i + SIMD_BLOCK_SIZE) <= len; i += SIMD_BLOCK_SIZE)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(const void*)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(const void*)(p + i + 32U));
+        if ((suspicious_avx2(a, lo_tbl, hi_tbl)
+             | suspicious_avx2(b, lo_tbl, hi_tbl)) != 0U)
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+#endif /* SIMD_X86 */
+
+#if defined(SIMD_NEON)
+
+/* Bit i of the result is the top bit of byte i of the 64 bytes a..d. */
+static inline uint64_t
+movemask_neon(uint8x16_t a, uint8x16_t b, uint8x16_t c, uint8x16_t d)
+{
+    const uint8x16_t bits = {1, 2, 4, 8, 16, 32, 64, 128,
+                             1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t s0 = vpaddq_u8(vandq_u8(a, bits), vandq_u8(b, bits));
+    uint8x16_t s1 = vpaddq_u8(vandq_u8(c, bits), vandq_u8(d, bits));
+    s0 = vpaddq_u8(s0, s1);
+    s0 = vpaddq_u8(s0, s0);
+
+    return vgetq_lane_u64(vreinterpretq_u64_u8(s0), 0);
+}
+
+static inline uint8x16_t
+suspicious_neon(uint8x16_t v, uint8x16_t lo_tbl, uint8x16_t hi_tbl)
+{
+    uint8x16_t lo = vqtbl1q_u8(lo_tbl, vandq_u8(v, vdupq_n_u8(0x0F)));
+    uint8x16_t hi = vqtbl1q_u8(hi_tbl, vshrq_n_u8(v, 4));
+
+    return vtstq_u8(lo, hi);
+}
+
+static size_t
+skip_neon(const simd_set_t* set, const char* p, size_t len, eol_t eol,
+          unsigned int* lines, size_t* line_start)
+{
+    const uint8x16_t lo_tbl = vld1q_u8(set->lo_nibble);
+    const uint8x16_t hi_tbl = vld1q_u8(set->hi_nibble);
+    const uint8x16_t cr_v = vdupq_n_u8('\r');
+    const uint8x16_t lf_v = vdupq_n_u8('\n');
+
+    size_t i = 0U;
+    for (; (i + SIMD_BLOCK_SIZE) <= len; i += SIMD_BLOCK_SIZE)
+    {
+        const uint8_t* q = (const uint8_t*)p + i;
+        uint8x16_t v0 = vld1q_u8(q);
+        uint8x16_t v1 = vld1q_u8(q + 16U);
+        uint8x16_t v2 = vld1q_u8(q + 32U);
+        uint8x16_t v3 = vld1q_u8(q + 48U);
+        uint64_t bad = movemask_neon(suspicious_neon(v0, lo_tbl, hi_tbl),
+                                     suspicious_neon(v1, lo_tbl, hi_tbl),
+                                     suspicious_neon(v2, lo_tbl, hi_tbl),
+                                     suspicious_neon(v3, lo_tbl, hi_tbl));
+        uint64_t cr = movemask_neon(vceqq_u8(v0, cr_v), vceqq_u8(v1, cr_v),
+                                    vceqq_u8(v2, cr_v), vceqq_u8(v3, cr_v));
+        uint64_t lf = movemask_neon(vceqq_u8(v0, lf_v), vceqq_u8(v1, lf_v),
+                                    vceqq_u8(v2, lf_v), vceqq_u8(v3, lf_v));
+        if (!block_ok(bad, cr, lf, eol, i, lines, line_start))
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+static size_t
+find_neon(const simd_set_t* set, const char* p, size_t len)
+{
+    const uint8x16_t lo_tbl = vld1q_u8(set->lo_nibble);
+    const uint8x16_t hi_tbl = vld1q_u8(set->hi_nibble);
+
+    size_t i = 0U;
+    for (; (i + SIMD_BLOCK_SIZE) <= len; i += SIMD_BLOCK_SIZE)
+    {
+        const uint8_t* q = (const uint8_t*)p + i;
+        uint8x16_t bad = vorrq_u8(
+            vorrq_u8(suspicious_neon(vld1q_u8(q), lo_tbl, hi_tbl),
+                     suspicious_neon(vld1q_u8(q + 16U), lo_tbl, hi_tbl)),
+            vorrq_u8(suspicious_neon(vld1q_u8(q + 32U), lo_tbl, hi_tbl),
+                     suspicious_neon(vld1q_u8(q + 48U), lo_tbl, hi_tbl)));
+        if (vmaxvq_u8(bad) != 0U)
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+#endif /* SIMD_NEON */
+
+bool
+simd_supported(simd_backend_t backend)
+{
+    switch (backend)
+    {
+        case SIMD_NONE:
+            return true;
+#if defined(SIMD_X86)
+        case SIMD_SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case SIMD_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+#if defined(SIMD_NEON)
+        case SIMD_NEON:
+            return true; /* mandatory on AArch64 */
+#endif
+        default:
+            return false;
+    }
+}
+
+simd_backend_t
+simd_detect(void)
+{
+    static const simd_backend_t preferred[] = {SIMD_AVX2, SIMD_NEON, SIMD_SSE2};
+
+    for (size_t i = 0U; i < (sizeof(preferred) / sizeof(preferred[0])); i++)
+    {
+        if (simd_supported(preferred[i]))
+        {
+            return preferred[i];
+        }
+    }
+
+    return SIMD_NONE;
+}
+
+const char*
+simd_backend_name(simd_backend_t backend)
+{
+    switch (backend)
+    {
+        case SIMD_SSE2:
+            return "sse2";
+        case SIMD_AVX2:
+            return "avx2";
+        case SIMD_NEON:
+            return "neon";
+        default:
+            return "scalar";
+    }
+}
+
+bool
+simd_backend_from_name(const char* name, simd_backend_t* backend)
+{
+    static const simd_backend_t all[] = {SIMD_NONE, SIMD_SSE2, SIMD_AVX2,
+                                         SIMD_NEON};
+
+    for (size_t i = 0U; i < (sizeof(all) / sizeof(all[0])); i++)
+    {
+        if (strcmp(name, simd_backend_name(all[i])) == 0)
+        {
+            *backend = all[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Rows (high nibbles) with the same set of suspicious low nibbles share one
+ * of the 8 bits of the nibble tables. Should there be more than 8 distinct
+ * rows, the remaining ones are marked as entirely suspicious, which is safe
+ * as the caller has a closer look at every suspicious block anyway.
+ */
+static void
+build_nibble_tables(simd_set_t* set, const bool* valid)
+{
+    uint16_t rows[16];
+    uint16_t buckets[8];
+    unsigned int bucket_count = 0U;
+
+    memset(set->lo_nibble, 0, sizeof(set->lo_nibble));
+    memset(set->hi_nibble, 0, sizeof(set->hi_nibble));
+
+    for (unsigned int hi = 0U; hi < 16U; hi++)
+    {
+        rows[hi] = 0U;
+        for (unsigned int lo = 0U; lo < 16U; lo++)
+        {
+            if (!valid[(hi << 4) | lo])
+            {
+                rows[hi] |= (uint16_t)(1U << lo);
+            }
+        }
+    }
+
+    for (unsigned int hi = 0U; hi < 16U; hi++)
+    {
+        if (rows[hi] == 0U)
+        {
+            continue;
+        }
+        unsigned int b = 0U;
+        while ((b < bucket_count) && (buckets[b] != rows[hi]))
+        {
+            b++;
+        }
+        if (b == bucket_count)
+        {
+            if (bucket_count < 7U)
+            {
+                buckets[bucket_count++] = rows[hi];
+            }
+            else
+            {
+                b = 7U;
+                buckets[7] = 0xFFFFU;
+                bucket_count = 8U;
+            }
+        }
+        set->hi_nibble[hi] |= (uint8_t)(1U << b);
+    }
+
+    for (unsigned int b = 0U; b < bucket_count; b++)
+    {
+        for (unsigned int lo = 0U; lo < 16U; lo++)
+        {
+            if ((buckets[b] & (1U << lo)) != 0U)
+            {
+                set->lo_nibble[lo] |= (uint8_t)(1U << b);
+            }
+        }
+    }
+}
+
+/* Returns false if the exceptions do not fit into the lists. */
+static bool
+build_lists(simd_set_t* set, const bool* valid)
+{
+    set->accept_count = 0U;
+    set->reject_count = 0U;
+
+    for (unsigned int c = 0U; c < 256U; c++)
+    {
+        bool printable = (c >= PRINTABLE_FIRST) && (c <= PRINTABLE_LAST);
+        if (!printable && valid[c])
+        {
+            if (set->accept_count == SIMD_LIST_SIZE)
+            {
+                return false;
+            }
+            set->accept[set->accept_count++] = (uint8_t)c;
+        }
+        else if (printable && !valid[c])
+        {
+            if (set->reject_count == SIMD_LIST_SIZE)
+            {
+                return false;
+            }
+            set->reject[set->reject_count++] = (uint8_t)c;
+        }
+    }
+
+    return true;
+}
+
+void
+simd_set_build(simd_set_t* set, const bool* valid_chars, simd_backend_t backend)
+{
+    bool valid[256];
+
+    memcpy(valid, valid_chars, sizeof(valid));
+    valid['\r'] = true;
+    valid['\n'] = true;
+
+    build_nibble_tables(set, valid);
+    bool lists = build_lists(set, valid);
+
+    set->backend = backend;
+    set->skip = NULL;
+    set->find = NULL;
+    switch (backend)
+    {
+#if defined(SIMD_X86)
+        case SIMD_SSE2:
+            set->skip = lists ? skip_sse2 : NULL;
+            break;
+        case SIMD_AVX2:
+            set->skip = skip_avx2;
+            set->find = find_avx2;
+            break;
+#endif
+#if defined(SIMD_NEON)
+        case SIMD_NEON:
+            set->skip = skip_neon;
+            set->find = find_neon;
+            break;
+#endif
+        default:
+            (void)lists;
+            break;
+    }
+}
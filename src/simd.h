@@ -0,0 +1,86 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_SIMD_H
+#define CVC_SIMD_H
+
+#include "eol.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SIMD_BLOCK_SIZE (64U)
+#define SIMD_LIST_SIZE  (8U)
+
+typedef enum
+{
+    SIMD_NONE,
+    SIMD_SSE2,
+    SIMD_AVX2,
+    SIMD_NEON
+} simd_backend_t;
+
+typedef struct simd_set simd_set_t;
+
+/*
+ * Skips whole blocks of SIMD_BLOCK_SIZE bytes as long as they contain nothing
+ * but valid characters and correct EOL indicators of the given (locked) EOL.
+ * Returns the number of bytes skipped, the EOL indicators within are added to
+ * *lines and, if there are any, *line_start is set to the offset from p behind
+ * the last one. The first block that needs a closer look is left to the caller.
+ */
+typedef size_t (*simd_skip_t)(const simd_set_t* set, const char* p, size_t len,
+                              eol_t eol, unsigned int* lines,
+                              size_t* line_start);
+
+/*
+ * Skips whole blocks of SIMD_BLOCK_SIZE bytes without any suspicious byte,
+ * regardless of EOL. Returns the number of bytes skipped.
+ */
+typedef size_t (*simd_find_t)(const simd_set_t* set, const char* p, size_t len);
+
+/*
+ * Allowed set of bytes in the form the kernels need. For the nibble lookup
+ * (AVX2, NEON), byte b is suspicious if lo_nibble[b & 0xF] & hi_nibble[b >> 4]
+ * is not zero. SSE2 lacks a byte shuffle and checks for the printable range
+ * instead, plus lists of valid bytes outside and invalid bytes inside of it.
+ */
+struct simd_set
+{
+    uint8_t lo_nibble[16];
+    uint8_t hi_nibble[16];
+    uint8_t accept[SIMD_LIST_SIZE];
+    uint8_t reject[SIMD_LIST_SIZE];
+    unsigned int accept_count;
+    unsigned int reject_count;
+    simd_backend_t backend;
+    simd_skip_t skip; /* NULL if the backend cannot handle the set */
+    simd_find_t find; /* likewise, the nibble lookup only */
+};
+
+/* Best backend of the CPU we are running on. */
+simd_backend_t
+simd_detect(void);
+
+bool
+simd_supported(simd_backend_t backend);
+
+const char*
+simd_backend_name(simd_backend_t backend);
+
+/* Returns false for unknown names, "scalar" maps to SIMD_NONE. */
+bool
+simd_backend_from_name(const char* name, simd_backend_t* backend);
+
+/* valid_chars has one entry per byte value, CR and LF are always accepted. */
+void
+simd_set_build(simd_set_t* set, const bool* valid_chars, simd_backend_t backend);
+
+#endif /* CVC_SIMD_H */
@@ -0,0 +1,132 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "stats.h"
+
+#include <inttypes.h>
+#include <time.h>
+
+#if defined(CVC_STATS)
+uint64_t
+stats_clock(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000U) + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+static void
+merge(stats_t* to, const stats_t* from)
+{
+    to->files += from->files;
+    to->bytes += from->bytes;
+    to->mapped += from->mapped;
+    to->prefetched += from->prefetched;
+    to->cache_lookups += from->cache_lookups;
+    to->cache_hits += from->cache_hits;
+    to->simd_bytes += from->simd_bytes;
+    for (unsigned int i = 0U; i < STATS_STAGES; i++)
+    {
+        to->time[i] += from->time[i];
+    }
+    to->busy += from->busy;
+}
+
+static double
+ratio(uint64_t part, uint64_t whole)
+{
+    return (whole > 0U) ? ((double)part / (double)whole) : 0.0;
+}
+
+static double
+per_second(uint64_t n, uint64_t ns)
+{
+    return (ns > 0U) ? ((double)n * 1e9 / (double)ns) : 0.0;
+}
+
+static void
+print_json(FILE* stream, const char* backend, const stats_t* sum,
+           const stats_t* threads, unsigned int count, uint64_t wall)
+{
+    fprintf(stream, "{\"backend\":\"%s\",\"files\":%" PRIu64 ",\"mapped\":%"
+            PRIu64 ",\"prefetched\":%" PRIu64 ",\"cache_lookups\":%" PRIu64
+            ",\"cache_hits\":%" PRIu64 ",\"bytes\":%" PRIu64
+            ",\"simd_bytes\":%" PRIu64 ",\"wall_ns\":%" PRIu64
+            ",\"read_ns\":%" PRIu64 ",\"scan_ns\":%" PRIu64
+            ",\"output_ns\":%" PRIu64 ",\"bytes_per_second\":%.0f"
+            ",\"files_per_second\":%.0f,\"threads\":[",
+            backend, sum->files, sum->mapped, sum->prefetched,
+            sum->cache_lookups, sum->cache_hits, sum->bytes, sum->simd_bytes,
+            wall, sum->time[STATS_READ], sum->time[STATS_SCAN],
+            sum->time[STATS_OUTPUT], per_second(sum->bytes, wall),
+            per_second(sum->files, wall));
+    for (unsigned int i = 0U; i < count; i++)
+    {
+        fprintf(stream, "%s{\"files\":%" PRIu64 ",\"busy_ns\":%" PRIu64
+                ",\"utilization\":%.3f}", (i > 0U) ? "," : "",
+                threads[i].files, threads[i].busy,
+                ratio(threads[i].busy, wall));
+    }
+    fprintf(stream, "]}\n");
+}
+
+static void
+print_text(FILE* stream, const char* backend, const stats_t* sum,
+           const stats_t* threads, unsigned int count, uint64_t wall)
+{
+    fprintf(stream, "Statistics:\n");
+    fprintf(stream, "  backend  %s\n", backend);
+    fprintf(stream, "  files    %" PRIu64 ", %" PRIu64 " mapped, %" PRIu64
+            " read ahead\n", sum->files, sum->mapped, sum->prefetched);
+    if (sum->cache_lookups > 0U)
+    {
+        fprintf(stream, "  cache    %" PRIu64 " hits of %" PRIu64
+                " lookups (%.1f%%)\n", sum->cache_hits, sum->cache_lookups,
+                100.0 * ratio(sum->cache_hits, sum->cache_lookups));
+    }
+    fprintf(stream, "  bytes    %" PRIu64 ", %.1f%% passed by SIMD\n",
+            sum->bytes, 100.0 * ratio(sum->simd_bytes, sum->bytes));
+    fprintf(stream, "  wall     %.3f ms, %.1f MB/s, %.0f files/s\n",
+            (double)wall / 1e6, per_second(sum->bytes, wall) / 1e6,
+            per_second(sum->files, wall));
+    fprintf(stream, "  read     %.3f ms\n", (double)sum->time[STATS_READ] / 1e6);
+    fprintf(stream, "  scan     %.3f ms\n", (double)sum->time[STATS_SCAN] / 1e6);
+    fprintf(stream, "  output   %.3f ms\n",
+            (double)sum->time[STATS_OUTPUT] / 1e6);
+    for (unsigned int i = 0U; i < count; i++)
+    {
+        fprintf(stream, "  thread %u %.1f%% busy, %" PRIu64 " files\n", i,
+                100.0 * ratio(threads[i].busy, wall), threads[i].files);
+    }
+}
+
+void
+stats_print(FILE* stream, bool json, const char* backend,
+            const stats_t* threads, unsigned int count, const stats_t* output,
+            uint64_t wall)
+{
+    stats_t sum = *output;
+    for (unsigned int i = 0U; i < count; i++)
+    {
+        merge(&sum, &threads[i]);
+    }
+
+    if (json)
+    {
+        print_json(stream, backend, &sum, threads, count, wall);
+    }
+    else
+    {
+        print_text(stream, backend, &sum, threads, count, wall);
+    }
+}
@@ -0,0 +1,91 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_STATS_H
+#define CVC_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Counters and timers of the pipeline for --stats. They only exist in builds
+ * with CVC_STATS defined, otherwise the functions below do nothing and are
+ * compiled away, so a build without them has no overhead at all.
+ */
+typedef enum
+{
+    STATS_READ,   /* open, read and map, reading ahead included */
+    STATS_SCAN,   /* EOL and character validation in a single pass */
+    STATS_OUTPUT, /* reports written in input order */
+    STATS_STAGES
+} stats_stage_t;
+
+/* Of one thread, times in nanoseconds. */
+typedef struct
+{
+    uint64_t files;
+    uint64_t bytes;         /* validated, not taken from the cache */
+    uint64_t mapped;        /* files mapped into memory */
+    uint64_t prefetched;    /* files read ahead */
+    uint64_t cache_lookups;
+    uint64_t cache_hits;
+    uint64_t simd_bytes;    /* passed by the SIMD kernel as clean blocks */
+    uint64_t time[STATS_STAGES];
+    uint64_t busy;          /* time spent on files */
+} stats_t;
+
+#if defined(CVC_STATS)
+/* Monotonic time in nanoseconds. */
+uint64_t
+stats_clock(void);
+#else
+static inline uint64_t
+stats_clock(void)
+{
+    return 0U;
+}
+#endif
+
+static inline void
+stats_count(uint64_t* counter, uint64_t n)
+{
+#if defined(CVC_STATS)
+    *counter += n;
+#else
+    (void)counter;
+    (void)n;
+#endif
+}
+
+/* Adds the time since *start to *time and restarts *start from now. */
+static inline void
+stats_lap(uint64_t* time, uint64_t* start)
+{
+#if defined(CVC_STATS)
+    uint64_t now = stats_clock();
+    *time += now - *start;
+    *start = now;
+#else
+    (void)time;
+    (void)start;
+#endif
+}
+
+/*
+ * Writes the statistics of count threads validating files and of the thread
+ * writing the output, as text or a JSON object, for a run of wall nanoseconds
+ * with the given backend.
+ */
+void
+stats_print(FILE* stream, bool json, const char* backend,
+            const stats_t* threads, unsigned int count, const stats_t* output,
+            uint64_t wall);
+
+#endif /* CVC_STATS_H */
@@ -0,0 +1,200 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+/*
+ * Fuzz target of libcvc, built by make fuzz. The first two bytes of an input
+ * pick the options and the sizes of the chunks fed to cvc_feed(), the rest is
+ * validated. Fed in chunks, the input has to give the summary of cvc_validate()
+ * over it at once, with one violation per error and the EOL mismatch, each
+ * within the input; the target aborts otherwise. With CVC_LIBFUZZER, libFuzzer
+ * provides main(), else the target runs on each file given or on standard
+ * input, as AFL calls it.
+ */
+
+#include "cvc.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FUZZ_OPTION_UTF8    (0x01U)
+#define FUZZ_OPTION_CONTEXT (0x02U)
+#define FUZZ_OPTION_FIRST   (0x04U)
+#define FUZZ_OPTION_FORBID  (0x08U)
+#define FUZZ_OPTION_DOLLAR  (0x10U) /* permit $ */
+#define FUZZ_OPTION_EOL     (5U)    /* shift of the EOL mode, 2 bits */
+
+typedef struct
+{
+    size_t size;
+    unsigned long violations;
+    unsigned long eol_violations;
+} fuzz_state_t;
+
+static void
+on_violation(const cvc_violation_t* v, void* user)
+{
+    fuzz_state_t* state = user;
+
+    if ((v->line == 0U) || (v->offset >= state->size)
+        || (v->offset + v->length > state->size))
+    {
+        abort();
+    }
+    if (v->kind == CVC_VIOLATION_EOL)
+    {
+        state->eol_violations++;
+    }
+    else
+    {
+        state->violations++;
+    }
+}
+
+static void
+fuzz_options(cvc_options_t* options, unsigned char flags, fuzz_state_t* state)
+{
+    static const cvc_sequence_t forbid[] =
+    {
+        {"?\?/", 3U}, {"\xE2\x80\xAE", 3U}, {"/*", 2U}, {"\xC3", 1U}
+    };
+
+    cvc_options_init(options);
+    options->utf8 = ((flags & FUZZ_OPTION_UTF8) != 0U);
+    options->context = ((flags & FUZZ_OPTION_CONTEXT) != 0U);
+    options->first = ((flags & FUZZ_OPTION_FIRST) != 0U);
+    options->allowed['$'] = ((flags & FUZZ_OPTION_DOLLAR) != 0U);
+    options->eol = (cvc_eol_t)((flags >> FUZZ_OPTION_EOL) & 3U);
+    if ((flags & FUZZ_OPTION_FORBID) != 0U)
+    {
+        memcpy(options->forbid, forbid, sizeof(forbid));
+        options->forbid_count = sizeof(forbid) / sizeof(forbid[0]);
+    }
+    options->callback = on_violation;
+    options->user = state;
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+int
+LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (size < 2U)
+    {
+        return 0;
+    }
+    unsigned char flags = data[0];
+    unsigned int chunk = data[1];
+    data += 2;
+    size -= 2U;
+
+    fuzz_state_t state = {.size = size};
+    cvc_options_t options;
+    fuzz_options(&options, flags, &state);
+    cvc_t* ctx = cvc_create(&options);
+    if (ctx == NULL)
+    {
+        abort();
+    }
+
+    /* chunk sizes from 1 byte up, varied per chunk, split whatever spans */
+    cvc_summary_t fed;
+    for (size_t pos = 0U; pos < size;)
+    {
+        size_t len = (size_t)(chunk % 67U) + 1U;
+        len = (len < (size - pos)) ? len : (size - pos);
+        if (!cvc_feed(ctx, data + pos, len))
+        {
+            break;
+        }
+        pos += len;
+        chunk = (chunk * 33U) + 7U;
+    }
+    (void)cvc_finish(ctx, &fed);
+    if ((state.violations != fed.errors)
+        || (state.eol_violations != ((fed.eol_error_line != 0U) ? 1U : 0U)))
+    {
+        abort();
+    }
+
+    fuzz_state_t chunked = state;
+    state.violations = 0U;
+    state.eol_violations = 0U;
+    cvc_summary_t whole;
+    (void)cvc_validate(ctx, data, size, &whole);
+    if ((whole.result != fed.result) || (whole.errors != fed.errors)
+        || (whole.eol_error_line != fed.eol_error_line)
+        || (whole.eol != fed.eol)
+        || (state.violations != chunked.violations))
+    {
+        abort();
+    }
+    cvc_destroy(ctx);
+
+    return 0;
+}
+
+#if !defined(CVC_LIBFUZZER)
+static bool
+run_file(FILE* f)
+{
+    size_t size = 0U;
+    size_t capacity = 4096U;
+    uint8_t* data = malloc(capacity);
+    size_t n;
+    while ((data != NULL)
+           && ((n = fread(data + size, 1U, capacity - size, f)) > 0U))
+    {
+        size += n;
+        if (size == capacity)
+        {
+            uint8_t* more = realloc(data, capacity * 2U);
+            if (more == NULL)
+            {
+                free(data);
+                return false;
+            }
+            data = more;
+            capacity *= 2U;
+        }
+    }
+    bool ok = (data != NULL) && !ferror(f);
+    if (ok)
+    {
+        (void)LLVMFuzzerTestOneInput(data, size);
+    }
+    free(data);
+
+    return ok;
+}
+
+int
+main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        return run_file(stdin) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        FILE* f = fopen(argv[i], "rb");
+        if ((f == NULL) || !run_file(f))
+        {
+            fprintf(stderr, "Error: Failed to read '%s'!\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        fclose(f);
+    }
+
+    return EXIT_SUCCESS;
+}
+#endif
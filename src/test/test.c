@@ -0,0 +1,1183 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+/*
+ * Tests of the scanner, libcvc and the fix of files, run by make test. Each
+ * failed check is reported with its location, the exit code is 1 if any
+ * failed.
+ */
+
+#include "cache.h"
+#include "cvc.h"
+#include "files.h"
+#include "fix.h"
+#include "lex.h"
+#include "match.h"
+#include "reader.h"
+#include "report.h"
+#include "scan.h"
+#include "segment.h"
+#include "simd.h"
+#include "utf8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PROGRAM_NAME    "cvc-test"
+
+#define CHECK(cond)     check((cond), #cond, __FILE__, __LINE__)
+
+#define RANDOM_INPUTS   (200U)
+#define RANDOM_MAX_LEN  (3U * 4096U)
+#define LARGE_MAX_LEN   (3U * READER_MMAP_THRESHOLD) /* every 8th input */
+#define SEGMENTED_LEN   ((3U * SEGMENT_MIN_SIZE) + 4096U)
+#define SEGMENTS_MAX    (3U)
+#define VIOLATIONS_MAX  (512U)
+
+static unsigned int checks = 0U;
+static unsigned int failures = 0U;
+
+static bool
+check(bool ok, const char* what, const char* file, int line)
+{
+    checks++;
+    if (!ok)
+    {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        failures++;
+    }
+
+    return ok;
+}
+
+/* Permitted above U+007F with UTF-8, without U+202B to U+202F. */
+static const utf8_range_t test_ranges[] =
+{
+    {0xA0U, 0x202AU}, {0x2030U, UTF8_MAX}
+};
+
+/* Printable ASCII and HT, without $, @ and `, as cvc by default. */
+static void
+default_chars(bool* valid)
+{
+    for (unsigned int c = 0U; c < CHAR_TABLE_SIZE; c++)
+    {
+        valid[c] = ((c >= 0x20U) && (c < 0x7FU)) || (c == '\t')
+                   || (c == '\n') || (c == '\r');
+    }
+    valid['$'] = false;
+    valid['@'] = false;
+    valid['`'] = false;
+}
+
+/*
+ * With verbose output, the characters before an EOL mismatch are listed, the
+ * scan stops at the mismatch. cvc used to check the EOL in a pass of its own
+ * and listed none then.
+ */
+static void
+test_verbose_eol_mismatch(void)
+{
+    static const char input[] = "a$b\nc@\r\nd`\n";
+    static const char expected[] = "line 1: 0x24 ($)\nline 2: 0x40 (@)\n";
+    bool valid[CHAR_TABLE_SIZE];
+    char_table_t table;
+    report_t out;
+    scan_t s;
+
+    default_chars(valid);
+    char_table_build(&table, valid, SIMD_NONE);
+    report_init(&out, NULL);
+    scan_init(&s, &table, EOL_AUTO_NA, &out, false);
+    CHECK(!scan_chunk(&s, input, sizeof(input) - 1U));
+    scan_finish(&s);
+
+    CHECK(s.eol_error_line == 2U);
+    CHECK(s.eol_error_offset == 6U);
+    CHECK(s.errors == 2U);
+    CHECK((out.len == (sizeof(expected) - 1U))
+          && (memcmp(out.data, expected, out.len) == 0));
+    report_free(&out);
+}
+
+/*
+ * A forbidden sequence at the end stops a scan with first while a UTF-8
+ * character is still open, finishing must not count it on top.
+ */
+static void
+test_first_stop_finish(void)
+{
+    static const char input[] = "a\xC3";
+    static const char* const patterns[] = {"\xC3"};
+    static const size_t lengths[] = {1U};
+    static const utf8_range_t ranges[] = {{0xA0U, UTF8_MAX}};
+    bool valid[CHAR_TABLE_SIZE];
+    char_table_t table;
+    match_t* match = match_build(patterns, lengths, 1U, SIMD_NONE);
+    if (!CHECK(match != NULL))
+    {
+        return;
+    }
+
+    default_chars(valid);
+    char_table_build(&table, valid, SIMD_NONE);
+    char_table_set_utf8(&table, ranges, 1U);
+    for (unsigned int first = 0U; first < 2U; first++)
+    {
+        scan_t s;
+        scan_init(&s, &table, EOL_AUTO_NA, NULL, (first != 0U));
+        scan_set_matcher(&s, match);
+        CHECK(scan_chunk(&s, input, sizeof(input) - 1U) == (first == 0U));
+        scan_finish(&s);
+        CHECK(s.errors == ((first != 0U) ? 1U : 2U));
+    }
+    match_free(match);
+}
+
+typedef struct
+{
+    unsigned int count;
+    cvc_violation_t v[8];
+} violations_t;
+
+static void
+on_violation(const cvc_violation_t* v, void* user)
+{
+    violations_t* seen = user;
+    if (seen->count < (sizeof(seen->v) / sizeof(seen->v[0])))
+    {
+        seen->v[seen->count] = *v;
+    }
+    seen->count++;
+}
+
+/*
+ * Forbidden sequences passed to the library count once each, as kind
+ * sequence, next to the invalid characters in them.
+ */
+static void
+test_lib_forbid(void)
+{
+    static const char input[] = "a?\?/b\n$$\n";
+    violations_t seen = {.count = 0U};
+    cvc_options_t options;
+    cvc_summary_t summary;
+
+    cvc_options_init(&options);
+    options.forbid[0] = (cvc_sequence_t){.bytes = "?\?/", .length = 3U};
+    options.forbid[1] = (cvc_sequence_t){.bytes = "$$", .length = 2U};
+    options.forbid_count = 2U;
+    options.callback = on_violation;
+    options.user = &seen;
+    cvc_t* ctx = cvc_create(&options);
+    if (!CHECK(ctx != NULL))
+    {
+        return;
+    }
+    CHECK(cvc_validate(ctx, input, sizeof(input) - 1U, &summary)
+          == CVC_INVALID);
+    CHECK(summary.errors == 4U);
+    CHECK(seen.count == 4U);
+    CHECK((seen.v[0].kind == CVC_VIOLATION_SEQUENCE)
+          && (seen.v[0].offset == 1U) && (seen.v[0].line == 1U)
+          && (seen.v[0].length == 3U));
+    CHECK((seen.v[1].kind == CVC_VIOLATION_CHAR) && (seen.v[1].offset == 6U));
+    CHECK((seen.v[2].kind == CVC_VIOLATION_CHAR) && (seen.v[2].offset == 7U));
+    CHECK((seen.v[3].kind == CVC_VIOLATION_SEQUENCE)
+          && (seen.v[3].offset == 6U) && (seen.v[3].line == 2U)
+          && (seen.v[3].length == 2U));
+    cvc_destroy(ctx);
+
+    options.forbid[1] = (cvc_sequence_t){.bytes = "$\n", .length = 2U};
+    CHECK(cvc_create(&options) == NULL);
+    options.forbid[1] = (cvc_sequence_t){.bytes = "", .length = 0U};
+    CHECK(cvc_create(&options) == NULL);
+}
+
+/* As the CLI with --first, the library stops counting where it stopped. */
+static void
+test_lib_first_stop_finish(void)
+{
+    cvc_options_t options;
+    cvc_summary_t summary;
+
+    cvc_options_init(&options);
+    options.utf8 = true;
+    options.first = true;
+    options.forbid[0] = (cvc_sequence_t){.bytes = "\xC3", .length = 1U};
+    options.forbid_count = 1U;
+    cvc_t* ctx = cvc_create(&options);
+    if (!CHECK(ctx != NULL))
+    {
+        return;
+    }
+    CHECK(!cvc_feed(ctx, "a\xC3", 2U));
+    CHECK(cvc_finish(ctx, &summary) == CVC_INVALID);
+    CHECK(summary.errors == 1U);
+    cvc_destroy(ctx);
+}
+
+static void
+write_file(const char* path, const char* data)
+{
+    FILE* f = fopen(path, "wb");
+    if (CHECK(f != NULL))
+    {
+        CHECK(fputs(data, f) >= 0);
+        CHECK(fclose(f) == 0);
+    }
+}
+
+static bool
+file_is(const char* path, const char* data)
+{
+    char buf[64];
+    FILE* f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        return false;
+    }
+    size_t len = fread(buf, 1U, sizeof(buf), f);
+    fclose(f);
+
+    return (len == strlen(data)) && (memcmp(buf, data, len) == 0);
+}
+
+/*
+ * A fix through a symbolic link rewrites its target and keeps the link, a
+ * file with another hard link or a forbidden sequence is left alone.
+ */
+static void
+test_fix_file(void)
+{
+    static const char* const patterns[] = {"?\?/"};
+    static const size_t lengths[] = {3U};
+    char dir[] = "/tmp/" PROGRAM_NAME "-XXXXXX";
+    char file[sizeof(dir) + 8U];
+    char alias[sizeof(dir) + 8U];
+    char buf[4096];
+    bool valid[CHAR_TABLE_SIZE];
+    char_table_t table;
+    if (!CHECK(mkdtemp(dir) != NULL))
+    {
+        return;
+    }
+
+    default_chars(valid);
+    char_table_build(&table, valid, SIMD_NONE);
+    fix_options_t options =
+    {
+        .table = &table, .lex = NULL, .match = NULL, .eol = EOL_LF,
+        .escape = false
+    };
+    snprintf(file, sizeof(file), "%s/file", dir);
+    snprintf(alias, sizeof(alias), "%s/alias", dir);
+
+    write_file(file, "a$b\n");
+    CHECK(chmod(file, 0640) == 0);
+    CHECK(symlink("file", alias) == 0);
+    CHECK(fix_file(alias, &options, buf, sizeof(buf)) == FIX_DONE);
+    CHECK(file_is(file, "ab\n"));
+    struct stat st;
+    CHECK((stat(file, &st) == 0) && ((st.st_mode & 07777U) == 0640U));
+    CHECK(file_is(alias, "ab\n"));
+    char target[8];
+    CHECK(readlink(alias, target, sizeof(target)) == 4);
+    CHECK(unlink(alias) == 0);
+
+    write_file(file, "a@b\n");
+    CHECK(link(file, alias) == 0);
+    CHECK(fix_file(file, &options, buf, sizeof(buf)) == FIX_ERROR);
+    CHECK(file_is(file, "a@b\n"));
+    CHECK(unlink(alias) == 0);
+
+    match_t* match = match_build(patterns, lengths, 1U, SIMD_NONE);
+    if (CHECK(match != NULL))
+    {
+        options.match = match;
+        write_file(file, "a@b\r\n?\?/\r\n");
+        CHECK(fix_file(file, &options, buf, sizeof(buf)) == FIX_SEQUENCE);
+        CHECK(file_is(file, "a@b\r\n?\?/\r\n"));
+        write_file(file, "a@b\r\n??\r\n");
+        CHECK(fix_file(file, &options, buf, sizeof(buf)) == FIX_DONE);
+        CHECK(file_is(file, "ab\n??\n"));
+        match_free(match);
+    }
+
+    CHECK(unlink(file) == 0);
+    CHECK(rmdir(dir) == 0);
+}
+
+/* Hidden files and directories are not taken from a directory. */
+static void
+test_walk_hidden(void)
+{
+    static const char* const names[] = {"a.c", ".cvcrc", ".a.c.swp"};
+    char dir[] = "/tmp/" PROGRAM_NAME "-XXXXXX";
+    char path[sizeof(dir) + 32U];
+    if (!CHECK(mkdtemp(dir) != NULL))
+    {
+        return;
+    }
+
+    for (size_t i = 0U; i < (sizeof(names) / sizeof(names[0])); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        write_file(path, "a\n");
+    }
+    snprintf(path, sizeof(path), "%s/.git", dir);
+    CHECK(mkdir(path, 0700) == 0);
+    snprintf(path, sizeof(path), "%s/.git/b.c", dir);
+    write_file(path, "b\n");
+
+    file_list_t list;
+    file_list_init(&list);
+    CHECK(file_list_walk(&list, dir, NULL));
+    snprintf(path, sizeof(path), "%s/a.c", dir);
+    if (CHECK(list.count == 1U))
+    {
+        CHECK(strcmp(list.paths[0], path) == 0);
+    }
+    file_list_free(&list);
+
+    snprintf(path, sizeof(path), "%s/.git/b.c", dir);
+    CHECK(unlink(path) == 0);
+    snprintf(path, sizeof(path), "%s/.git", dir);
+    CHECK(rmdir(path) == 0);
+    for (size_t i = 0U; i < (sizeof(names) / sizeof(names[0])); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        CHECK(unlink(path) == 0);
+    }
+    CHECK(rmdir(dir) == 0);
+}
+
+/* Paths spelled with ".", ".." or empty components find the same entry. */
+static void
+test_cache_key(void)
+{
+    char dir[] = "/tmp/" PROGRAM_NAME "-XXXXXX";
+    char path[sizeof(dir) + 32U];
+    char cache_dir[sizeof(dir) + 16U];
+    if (!CHECK(mkdtemp(dir) != NULL))
+    {
+        return;
+    }
+
+    snprintf(cache_dir, sizeof(cache_dir), "%s/cache", dir);
+    snprintf(path, sizeof(path), "%s/sub", dir);
+    CHECK(mkdir(path, 0700) == 0);
+    snprintf(path, sizeof(path), "%s/a.c", dir);
+    write_file(path, "a\n");
+
+    cache_entry_t entry;
+    cache_t* c = cache_open(cache_dir, 1U);
+    if (CHECK(c != NULL))
+    {
+        CHECK(cache_lookup(c, 0U, path, 1U, &entry) == CACHE_MISS);
+        entry.hash = cache_hash("a\n", 2U);
+        entry.errors = 0U;
+        entry.eol_error_line = 0U;
+        entry.result = 0;
+        cache_store(c, 0U, &entry);
+        CHECK(cache_close(c));
+    }
+    static const char* const spellings[] =
+    {
+        "%s/./a.c", "%s//a.c", "%s/sub/../a.c", "%s/sub/.././/a.c"
+    };
+    c = cache_open(cache_dir, 1U);
+    if (CHECK(c != NULL))
+    {
+        for (size_t i = 0U; i < (sizeof(spellings) / sizeof(spellings[0])); i++)
+        {
+            snprintf(path, sizeof(path), spellings[i], dir);
+            /* just written, so verified by the hash instead of a hit */
+            CHECK(cache_lookup(c, 0U, path, 1U, &entry) != CACHE_MISS);
+            CHECK(entry.hash == cache_hash("a\n", 2U));
+        }
+        CHECK(cache_close(c));
+    }
+
+    snprintf(path, sizeof(path), "%s/a.c", dir);
+    CHECK(unlink(path) == 0);
+    snprintf(path, sizeof(path), "%s/sub", dir);
+    CHECK(rmdir(path) == 0);
+    snprintf(path, sizeof(path), "%s/index", cache_dir);
+    CHECK(unlink(path) == 0);
+    CHECK(rmdir(cache_dir) == 0);
+    CHECK(rmdir(dir) == 0);
+}
+
+static uint32_t
+random_next(uint64_t* seed)
+{
+    *seed = (*seed * 6364136223846793005U) + 1442695040888963407U;
+
+    return (uint32_t)(*seed >> 33);
+}
+
+/*
+ * Appends pieces of C-like text to buf up to about max bytes: long clean
+ * runs for the fast paths, comments and literals for the lexer, forbidden
+ * sequences, NUL and high bytes, and UTF-8 that is valid, invalid or cut.
+ * Lines end with one EOL indicator per input, rarely with another one.
+ */
+static size_t
+random_input(char* buf, size_t max, uint64_t* seed)
+{
+    static const char* const pieces[] =
+    {
+        "a", " ", "\t", "x = y;", "$", "@", "`", "/*", "*/", "//", "\"",
+        "'", "\\", "R\"d(", ")d\"", "?\?/", "?\?", "\xE2\x80\xAE", "\xC3\xA9",
+        "\xC3", "\xA9", "\xF0\x9F\x98\x80", "\xFF", "\xEF\xBB\xBF", "\x7F"
+    };
+    static const char* const eols[] = {"\n", "\r\n", "\r"};
+    const char* eol = eols[random_next(seed) % 3U];
+    size_t len = 0U;
+    size_t target = random_next(seed) % max;
+    while (len < target)
+    {
+        uint32_t r = random_next(seed);
+        const char* piece = pieces[(r >> 8)
+                                   % (sizeof(pieces) / sizeof(pieces[0]))];
+        if ((r % 8U) == 0U)
+        {
+            size_t run = (r >> 8) % (4U * SIMD_BLOCK_SIZE);
+            run = (run < (max - len)) ? run : (max - len);
+            memset(buf + len, 'a', run);
+            len += run;
+            continue;
+        }
+        else if ((r % 64U) == 1U)
+        {
+            buf[len++] = '\0';
+            continue;
+        }
+        else if ((r % 4U) == 2U)
+        {
+            piece = ((r % 1024U) == 2U) ? eols[(r >> 8) % 3U] : eol;
+        }
+        size_t n = strlen(piece);
+        if (n > (max - len))
+        {
+            break;
+        }
+        memcpy(buf + len, piece, n);
+        len += n;
+    }
+
+    return len;
+}
+
+typedef struct
+{
+    unsigned int count;
+    scan_violation_kind_t kind[VIOLATIONS_MAX];
+    uint64_t offset[VIOLATIONS_MAX];
+    unsigned int length[VIOLATIONS_MAX];
+    unsigned int column[VIOLATIONS_MAX];
+} offsets_t;
+
+static void
+on_scan_violation(void* user, const scan_violation_t* v)
+{
+    offsets_t* seen = user;
+    if (seen->count < VIOLATIONS_MAX)
+    {
+        seen->kind[seen->count] = v->kind;
+        seen->offset[seen->count] = v->offset;
+        seen->length[seen->count] = v->length;
+        seen->column[seen->count] = v->char_column;
+    }
+    seen->count++;
+}
+
+/* Outcome of a scan, to compare one way of scanning with another. */
+typedef struct
+{
+    bool ok;
+    unsigned int errors;
+    unsigned int line;
+    unsigned int eol_error_line;
+    uint64_t eol_error_offset;
+    offsets_t seen;
+    report_t out;
+} outcome_t;
+
+/* The columns of violations are only compared if columns is set. */
+static bool
+outcome_equal(const outcome_t* a, const outcome_t* b, bool columns)
+{
+    unsigned int n = (a->seen.count < VIOLATIONS_MAX)
+                     ? a->seen.count : VIOLATIONS_MAX;
+
+    return (a->ok == b->ok) && (a->errors == b->errors)
+           && (a->line == b->line) && (a->eol_error_line == b->eol_error_line)
+           && (a->eol_error_offset == b->eol_error_offset)
+           && (a->seen.count == b->seen.count)
+           && (memcmp(a->seen.kind, b->seen.kind, n * sizeof(a->seen.kind[0]))
+               == 0)
+           && (memcmp(a->seen.offset, b->seen.offset,
+                      n * sizeof(a->seen.offset[0])) == 0)
+           && (memcmp(a->seen.length, b->seen.length,
+                      n * sizeof(a->seen.length[0])) == 0)
+           && (!columns
+               || (memcmp(a->seen.column, b->seen.column,
+                          n * sizeof(a->seen.column[0])) == 0))
+           && (a->out.len == b->out.len)
+           && ((a->out.len == 0U)
+               || (memcmp(a->out.data, b->out.data, a->out.len) == 0));
+}
+
+/* Takes the counts of a finished scan. */
+static void
+outcome_take(outcome_t* o, const scan_t* s)
+{
+    o->errors = s->errors;
+    o->line = s->line;
+    o->eol_error_line = s->eol_error_line;
+    o->eol_error_offset = s->eol_error_offset;
+}
+
+/*
+ * Scans input in chunks of pseudo-random size from seed, with verbose output,
+ * the lexer and the matcher as the bits of kernel say, by the specialized
+ * kernel of scan_chunk() or by scan_chunk_generic().
+ */
+static void
+kernel_scan(outcome_t* o, const char* input, size_t len, unsigned int kernel,
+            bool generic, bool first, uint64_t seed, const char_table_t* table,
+            const lex_table_t* lex, const match_t* match)
+{
+    scan_t s;
+    memset(&o->seen, 0, sizeof(o->seen));
+    report_init(&o->out, NULL);
+    scan_init(&s, table, EOL_AUTO_NA, ((kernel & 4U) != 0U) ? &o->out : NULL,
+              first);
+    scan_set_callback(&s, on_scan_violation, &o->seen);
+    if ((kernel & 2U) != 0U)
+    {
+        scan_set_lexer(&s, lex);
+    }
+    if ((kernel & 1U) != 0U)
+    {
+        scan_set_matcher(&s, match);
+    }
+    CHECK(s.kernel == kernel);
+
+    o->ok = true;
+    for (size_t pos = 0U; pos < len;)
+    {
+        size_t piece = (random_next(&seed) % (3U * SIMD_BLOCK_SIZE)) + 1U;
+        piece = (piece < (len - pos)) ? piece : (len - pos);
+        o->ok = generic ? scan_chunk_generic(&s, input + pos, piece)
+                        : scan_chunk(&s, input + pos, piece);
+        pos += piece;
+    }
+    scan_finish(&s);
+    outcome_take(o, &s);
+}
+
+/*
+ * Each of the eight kernels, verbose output, the lexer and the matcher on or
+ * off, ends a scan as the generic one with the same flags, with the same
+ * violations at the same offsets.
+ */
+static void
+test_kernels(void)
+{
+    static const char* const patterns[] = {"?\?/", "\xE2\x80\xAE", "/*$"};
+    static const size_t lengths[] = {3U, 3U, 3U};
+    bool valid[CHAR_TABLE_SIZE];
+    bool extended[CHAR_TABLE_SIZE];
+    char_table_t table;
+    lex_table_t lex;
+    char* input = malloc(RANDOM_MAX_LEN);
+    match_t* match = match_build(patterns, lengths, 3U, simd_detect());
+    if (!CHECK((input != NULL) && (match != NULL)))
+    {
+        free(input);
+        match_free(match);
+        return;
+    }
+
+    default_chars(valid);
+    memcpy(extended, valid, sizeof(extended));
+    extended['$'] = true;
+    char_table_build(&table, valid, simd_detect());
+    char_table_set_utf8(&table, test_ranges, 2U);
+    lex_table_build(&lex, valid, extended, true, test_ranges, 2U,
+                    simd_detect());
+
+    uint64_t seed = 1U;
+    for (unsigned int i = 0U; i < RANDOM_INPUTS; i++)
+    {
+        size_t len = random_input(input, RANDOM_MAX_LEN, &seed);
+        uint64_t chunks = random_next(&seed);
+        bool first = ((i % 4U) == 3U);
+        for (unsigned int kernel = 0U; kernel < 8U; kernel++)
+        {
+            outcome_t specialized;
+            outcome_t generic;
+            kernel_scan(&specialized, input, len, kernel, false, first, chunks,
+                        &table, &lex, match);
+            kernel_scan(&generic, input, len, kernel, true, first, chunks,
+                        &table, &lex, match);
+            if (!CHECK(outcome_equal(&specialized, &generic, true)))
+            {
+                fprintf(stderr, "input %u, kernel %u\n", i, kernel);
+            }
+            report_free(&specialized.out);
+            report_free(&generic.out);
+        }
+    }
+    match_free(match);
+    free(input);
+}
+
+/*
+ * Reference of a scan for the differential test, written apart from the
+ * scanner: byte by byte, without its tables, EOL automaton, UTF-8 decoder and
+ * matcher. Well-formed UTF-8 is taken from the table in the Unicode standard,
+ * forbidden sequences are compared at each byte they may end at. The
+ * sequences must be made of whole characters.
+ */
+typedef struct
+{
+    const bool* valid;
+    bool utf8;
+    const utf8_range_t* ranges;
+    unsigned int range_count;
+    const char* const* patterns;
+    const size_t* lengths;
+    unsigned int pattern_count;
+    bool first;
+} reference_t;
+
+typedef struct
+{
+    const reference_t* r;
+    const unsigned char* in;
+    size_t len;
+    size_t ends;   /* bytes checked for the end of a sequence */
+    eol_t eol;
+    outcome_t* o;
+} reference_scan_t;
+
+/* Counts a violation, false if the scan stops with it. */
+static bool
+reference_violation(reference_scan_t* rs, scan_violation_kind_t kind,
+                    uint64_t offset, size_t length)
+{
+    offsets_t* seen = &rs->o->seen;
+    if (seen->count < VIOLATIONS_MAX)
+    {
+        seen->kind[seen->count] = kind;
+        seen->offset[seen->count] = offset;
+        seen->length[seen->count] = (unsigned int)length;
+    }
+    seen->count++;
+    rs->o->errors++;
+
+    return !rs->r->first;
+}
+
+/* Reports the sequences that end before to, the longest one per end. */
+static bool
+reference_sequences(reference_scan_t* rs, size_t to)
+{
+    for (; rs->ends < to; rs->ends++)
+    {
+        size_t longest = 0U;
+        for (unsigned int k = 0U; k < rs->r->pattern_count; k++)
+        {
+            size_t n = rs->r->lengths[k];
+            if ((n <= (rs->ends + 1U)) && (n > longest)
+                && (memcmp(rs->in + rs->ends + 1U - n, rs->r->patterns[k], n)
+                    == 0))
+            {
+                longest = n;
+            }
+        }
+        if ((longest != 0U)
+            && !reference_violation(rs, SCAN_VIOLATION_SEQUENCE,
+                                    rs->ends + 1U - longest, longest))
+        {
+            rs->ends++;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Takes an EOL indicator at offset, false on a mismatch. */
+static bool
+reference_eol(reference_scan_t* rs, eol_t eol, size_t offset)
+{
+    if ((rs->eol != EOL_AUTO_NA) && (rs->eol != eol))
+    {
+        rs->o->eol_error_line = rs->o->line;
+        rs->o->eol_error_offset = offset;
+        return false;
+    }
+    rs->eol = eol;
+    rs->o->line++;
+
+    return true;
+}
+
+typedef enum
+{
+    REFERENCE_UTF8_COMPLETE,
+    REFERENCE_UTF8_MALFORMED, /* the bytes before the offending one */
+    REFERENCE_UTF8_OPEN       /* cut off by the end of the input */
+} reference_utf8_t;
+
+/* Decodes the character at in[i], a byte above 0x7F, into *cp and *n bytes. */
+static reference_utf8_t
+reference_decode(const unsigned char* in, size_t len, size_t i, uint32_t* cp,
+                 size_t* n)
+{
+    unsigned char b = in[i];
+    unsigned char lo = 0x80U;
+    unsigned char hi = 0xBFU;
+    size_t need;
+
+    *n = 1U;
+    if ((b >= 0xC2U) && (b <= 0xDFU))
+    {
+        need = 2U;
+        *cp = b & 0x1FU;
+    }
+    else if ((b >= 0xE0U) && (b <= 0xEFU))
+    {
+        need = 3U;
+        *cp = b & 0x0FU;
+        lo = (b == 0xE0U) ? 0xA0U : 0x80U;
+        hi = (b == 0xEDU) ? 0x9FU : 0xBFU;
+    }
+    else if ((b >= 0xF0U) && (b <= 0xF4U))
+    {
+        need = 4U;
+        *cp = b & 0x07U;
+        lo = (b == 0xF0U) ? 0x90U : 0x80U;
+        hi = (b == 0xF4U) ? 0x8FU : 0xBFU;
+    }
+    else
+    {
+        return REFERENCE_UTF8_MALFORMED;
+    }
+    for (; *n < need; (*n)++)
+    {
+        if ((i + *n) == len)
+        {
+            return REFERENCE_UTF8_OPEN;
+        }
+        unsigned char c = in[i + *n];
+        if ((c < lo) || (c > hi))
+        {
+            return REFERENCE_UTF8_MALFORMED;
+        }
+        *cp = (*cp << 6) | (c & 0x3FU);
+        lo = 0x80U;
+        hi = 0xBFU;
+    }
+
+    return REFERENCE_UTF8_COMPLETE;
+}
+
+static bool
+reference_allowed(const reference_t* r, uint32_t cp, size_t offset)
+{
+    if ((cp == 0xFEFFU) && (offset == 0U))
+    {
+        return true; /* byte order mark */
+    }
+    for (unsigned int k = 0U; k < r->range_count; k++)
+    {
+        if ((cp >= r->ranges[k].first) && (cp <= r->ranges[k].last))
+        {
+            return !utf8_flagged(cp);
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Scans the input as a whole. ok is false if the scan stopped before its
+ * end, where an open character or a pending CR is taken.
+ */
+static void
+reference_scan(outcome_t* o, const reference_t* r, const char* input,
+               size_t len)
+{
+    reference_scan_t rs =
+    {
+        .r = r, .in = (const unsigned char*)input, .len = len, .ends = 0U,
+        .eol = EOL_AUTO_NA, .o = o
+    };
+    bool cr_pending = false;
+    size_t open = 0U; /* bytes of a character cut off at the end */
+    memset(o, 0, sizeof(*o));
+    report_init(&o->out, NULL);
+    o->line = 1U;
+    o->ok = false;
+
+    for (size_t i = 0U; i < len;)
+    {
+        unsigned char b = rs.in[i];
+        if (!reference_sequences(&rs, i))
+        {
+            return;
+        }
+        if (b == '\n')
+        {
+            if (!reference_eol(&rs, EOL_LF, i))
+            {
+                return;
+            }
+            i++;
+        }
+        else if (b == '\r')
+        {
+            /* CR or CRLF, only known from the next byte unless locked */
+            bool crlf = false;
+            if ((rs.eol == EOL_AUTO_NA) || (rs.eol == EOL_CRLF))
+            {
+                if ((i + 1U) == len)
+                {
+                    cr_pending = true;
+                    break;
+                }
+                crlf = (rs.in[i + 1U] == '\n');
+            }
+            if (!reference_eol(&rs, crlf ? EOL_CRLF : EOL_CR, i))
+            {
+                return;
+            }
+            i += crlf ? 2U : 1U;
+        }
+        else if (r->utf8 && (b >= 0x80U))
+        {
+            uint32_t cp = 0U;
+            size_t n;
+            reference_utf8_t d = reference_decode(rs.in, len, i, &cp, &n);
+            if (d == REFERENCE_UTF8_OPEN)
+            {
+                open = n;
+                break;
+            }
+            if (((d == REFERENCE_UTF8_MALFORMED)
+                 || !reference_allowed(r, cp, i))
+                && !reference_violation(&rs, SCAN_VIOLATION_CHAR, i, n))
+            {
+                return;
+            }
+            i += n;
+        }
+        else
+        {
+            if (!r->valid[b]
+                && !reference_violation(&rs, SCAN_VIOLATION_CHAR, i, 1U))
+            {
+                return;
+            }
+            i++;
+        }
+    }
+    if (!reference_sequences(&rs, len))
+    {
+        return;
+    }
+    o->ok = true;
+
+    if ((open != 0U)
+        && !reference_violation(&rs, SCAN_VIOLATION_CHAR, len - open, open))
+    {
+        return;
+    }
+    if (cr_pending)
+    {
+        (void)reference_eol(&rs, EOL_CR, len - 1U);
+    }
+}
+
+/* Scans input by reading path, chunk-wise into buf of size or mapped. */
+static void
+file_scan(outcome_t* o, const char* path, char* buf, size_t size,
+          bool use_mmap, const char_table_t* table, const match_t* match,
+          bool first)
+{
+    reader_t reader;
+    scan_t s;
+    memset(&o->seen, 0, sizeof(o->seen));
+    report_init(&o->out, NULL);
+    scan_init(&s, table, EOL_AUTO_NA, NULL, first);
+    scan_set_callback(&s, on_scan_violation, &o->seen);
+    scan_set_matcher(&s, match);
+
+    o->ok = true;
+    if (CHECK(reader_open(&reader, path, buf, size, use_mmap)))
+    {
+        const char* data;
+        size_t len;
+        while (reader_next(&reader, &data, &len))
+        {
+            o->ok = scan_chunk(&s, data, len);
+        }
+        CHECK(!reader.error);
+        reader_close(&reader);
+    }
+    scan_finish(&s);
+    outcome_take(o, &s);
+}
+
+/*
+ * Random inputs, some larger than a chunk of cvc, scanned with every SIMD
+ * backend there is, in chunks of random size, as read in chunks of sizes
+ * around the SIMD block and CHUNK_SIZE and as mapped, end as the reference,
+ * in bytes and in UTF-8.
+ */
+static void
+test_differential(void)
+{
+    static const char* const patterns[] = {"?\?/", "\xE2\x80\xAE", "$$", "*/$"};
+    static const size_t lengths[] = {3U, 3U, 2U, 3U};
+    static const size_t reads[] =
+    {
+        SIMD_BLOCK_SIZE - 1U, SIMD_BLOCK_SIZE + 1U, (4U * SIMD_BLOCK_SIZE) + 3U,
+        READER_MMAP_THRESHOLD - 1U, READER_MMAP_THRESHOLD
+    };
+    char path[] = "/tmp/" PROGRAM_NAME "-XXXXXX";
+    bool valid[CHAR_TABLE_SIZE];
+    char* input = malloc(LARGE_MAX_LEN);
+    char* buf = malloc(READER_MMAP_THRESHOLD);
+    int fd = mkstemp(path);
+    if (!CHECK((input != NULL) && (buf != NULL) && (fd >= 0)))
+    {
+        free(input);
+        free(buf);
+        return;
+    }
+    close(fd);
+
+    default_chars(valid);
+    for (unsigned int c = 0xA0U; c < CHAR_TABLE_SIZE; c++)
+    {
+        valid[c] = true; /* high bytes, without UTF-8 */
+    }
+    uint64_t seed = 2U;
+    for (unsigned int i = 0U; i < RANDOM_INPUTS; i++)
+    {
+        size_t max = ((i % 8U) == 7U) ? LARGE_MAX_LEN : RANDOM_MAX_LEN;
+        size_t len = random_input(input, max, &seed);
+        uint64_t chunks = random_next(&seed);
+        FILE* f = fopen(path, "wb");
+        CHECK((f != NULL) && (fwrite(input, 1U, len, f) == len)
+              && (fclose(f) == 0));
+
+        for (unsigned int mode = 0U; mode < 4U; mode++)
+        {
+            const reference_t r =
+            {
+                .valid = valid, .utf8 = ((mode & 1U) != 0U),
+                .ranges = test_ranges, .range_count = 2U,
+                .patterns = patterns, .lengths = lengths, .pattern_count = 4U,
+                .first = ((mode & 2U) != 0U)
+            };
+            outcome_t expected;
+            reference_scan(&expected, &r, input, len);
+
+            for (int backend = SIMD_NONE; backend <= SIMD_NEON; backend++)
+            {
+                if (!simd_supported((simd_backend_t)backend))
+                {
+                    continue;
+                }
+                char_table_t table;
+                char_table_build(&table, valid, (simd_backend_t)backend);
+                if (r.utf8)
+                {
+                    char_table_set_utf8(&table, test_ranges, 2U);
+                }
+                match_t* match = match_build(patterns, lengths, 4U,
+                                             (simd_backend_t)backend);
+                if (!CHECK(match != NULL))
+                {
+                    continue;
+                }
+
+                outcome_t o;
+                kernel_scan(&o, input, len, 1U, false, r.first, chunks,
+                            &table, NULL, match);
+                if (!CHECK(outcome_equal(&o, &expected, false)))
+                {
+                    fprintf(stderr, "input %u, mode %u, %s, chunks\n", i, mode,
+                            simd_backend_name((simd_backend_t)backend));
+                }
+                report_free(&o.out);
+                const size_t count = sizeof(reads) / sizeof(reads[0]);
+                for (size_t k = 0U; k <= count; k++)
+                {
+                    bool mapped = (k == count);
+                    file_scan(&o, path, buf, mapped ? READER_MMAP_THRESHOLD
+                                                    : reads[k],
+                              mapped, &table, match, r.first);
+                    if (!CHECK(outcome_equal(&o, &expected, false)))
+                    {
+                        fprintf(stderr, "input %u, mode %u, %s, read %zu%s\n",
+                                i, mode,
+                                simd_backend_name((simd_backend_t)backend),
+                                mapped ? len : reads[k],
+                                mapped ? " mapped" : "");
+                    }
+                    report_free(&o.out);
+                }
+                match_free(match);
+            }
+            report_free(&expected.out);
+        }
+    }
+    CHECK(unlink(path) == 0);
+    free(buf);
+    free(input);
+}
+
+/*
+ * An input large enough for SEGMENTS_MAX segments, split by segment_scan() in
+ * one to SEGMENTS_MAX segments or scanned at once, ends as the reference.
+ * The lines of a block are repeated, so that the EOL mismatch, if any, is in
+ * the last segment.
+ */
+static void
+test_segments(void)
+{
+    bool valid[CHAR_TABLE_SIZE];
+    char* input = malloc(SEGMENTED_LEN);
+    if (!CHECK(input != NULL))
+    {
+        return;
+    }
+
+    default_chars(valid);
+    uint64_t seed = 3U;
+    for (unsigned int i = 0U; i < 2U; i++)
+    {
+        /* a block without EOL mismatch, up to its last EOL indicator */
+        size_t block;
+        outcome_t expected;
+        const reference_t plain =
+        {
+            .valid = valid, .utf8 = false, .ranges = test_ranges,
+            .range_count = 2U,
+            .patterns = NULL, .lengths = NULL, .pattern_count = 0U,
+            .first = false
+        };
+        do
+        {
+            block = random_input(input, RANDOM_MAX_LEN, &seed);
+            while ((block > 0U) && (input[block - 1U] != '\n'))
+            {
+                block--;
+            }
+            reference_scan(&expected, &plain, input, block);
+            report_free(&expected.out);
+        } while ((block == 0U) || (expected.eol_error_line != 0U));
+        size_t len = block;
+        for (; (len + block) <= SEGMENTED_LEN; len += block)
+        {
+            memcpy(input + len, input, block);
+        }
+        if (i == 1U)
+        {
+            memcpy(input + len - 2U, "\r\r", 2U); /* a mismatch for any EOL */
+        }
+
+        for (unsigned int mode = 0U; mode < 4U; mode++)
+        {
+            reference_t r = plain;
+            r.utf8 = ((mode & 1U) != 0U);
+            r.first = ((mode & 2U) != 0U);
+            reference_scan(&expected, &r, input, len);
+            char_table_t table;
+            char_table_build(&table, valid, simd_detect());
+            if (r.utf8)
+            {
+                char_table_set_utf8(&table, test_ranges, 2U);
+            }
+
+            for (unsigned int threads = 1U; threads <= SEGMENTS_MAX; threads++)
+            {
+                scan_t s;
+                scan_init(&s, &table, EOL_AUTO_NA, NULL, r.first);
+                bool split = segment_scan(&s, input, len, threads);
+                CHECK(split == (threads > 1U));
+                if (!split)
+                {
+                    (void)scan_chunk(&s, input, len);
+                }
+                scan_finish(&s);
+                if (!CHECK((s.errors == expected.errors)
+                           && (s.line == expected.line)
+                           && (s.eol_error_line == expected.eol_error_line)
+                           && (s.eol_error_offset
+                               == expected.eol_error_offset)))
+                {
+                    fprintf(stderr, "input %u, mode %u, %u threads\n", i,
+                            mode, threads);
+                }
+            }
+            report_free(&expected.out);
+        }
+    }
+    free(input);
+}
+
+static const struct
+{
+    const char* name;
+    void (*run)(void);
+} tests[] =
+{
+    {"verbose_eol_mismatch", test_verbose_eol_mismatch},
+    {"first_stop_finish", test_first_stop_finish},
+    {"lib_forbid", test_lib_forbid},
+    {"lib_first_stop_finish", test_lib_first_stop_finish},
+    {"fix_file", test_fix_file},
+    {"walk_hidden", test_walk_hidden},
+    {"cache_key", test_cache_key},
+    {"kernels", test_kernels},
+    {"differential", test_differential},
+    {"segments", test_segments}
+};
+
+int
+main(void)
+{
+    for (size_t i = 0U; i < (sizeof(tests) / sizeof(tests[0])); i++)
+    {
+        unsigned int before = failures;
+        tests[i].run();
+        printf("%s %s\n", (failures == before) ? "ok  " : "FAIL",
+               tests[i].name);
+    }
+    printf(PROGRAM_NAME ": %u checks, %u failed\n", checks, failures);
+
+    return (failures == 0U) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,170 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#include "utf8.h"
+
+#include <stdlib.h>
+
+/*
+ * Byte classes: 0 ASCII, 1 continuation 80-8F, 2 continuation 90-9F,
+ * 3 continuation A0-BF, 4 never valid (C0, C1, F5-FF), 5 lead of two bytes,
+ * 6 E0, 7 other leads of three bytes, 8 ED, 9 F0, 10 F1-F3, 11 F4.
+ */
+const uint8_t utf8_byte_class[256] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 00 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 40 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 80 */
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    4, 4, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, /* C0 */
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 7, /* E0 */
+    9, 10, 10, 10, 11, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4
+};
+
+/* Payload bits of the first byte of a sequence, by class. */
+const uint8_t utf8_lead_mask[UTF8_CLASSES] =
+{
+    0x7F, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x0F, 0x0F, 0x0F, 0x07, 0x07, 0x07
+};
+
+#define R UTF8_REJECT
+
+/*
+ * States: 0 accept, 1 to 3 continuation bytes to go, 4 after E0 (A0-BF),
+ * 5 after ED (80-9F), 6 after F0 (90-BF), 7 after F4 (80-8F), 8 reject.
+ */
+const uint8_t utf8_transition[UTF8_STATES][UTF8_CLASSES] =
+{
+    {0, R, R, R, R, 1, 4, 2, 5, 6, 3, 7},
+    {R, 0, 0, 0, R, R, R, R, R, R, R, R},
+    {R, 1, 1, 1, R, R, R, R, R, R, R, R},
+    {R, 2, 2, 2, R, R, R, R, R, R, R, R},
+    {R, R, R, 1, R, R, R, R, R, R, R, R},
+    {R, 1, 1, R, R, R, R, R, R, R, R, R},
+    {R, R, 2, 2, R, R, R, R, R, R, R, R},
+    {R, 2, R, R, R, R, R, R, R, R, R, R},
+    {R, R, R, R, R, R, R, R, R, R, R, R}
+};
+
+#undef R
+
+static const utf8_range_t flagged[] =
+{
+    {0x061CU, 0x061CU}, /* arabic letter mark */
+    {0x180EU, 0x180EU}, /* mongolian vowel separator */
+    {0x200BU, 0x200FU}, /* zero width space, (non-)joiner, LRM, RLM */
+    {0x202AU, 0x202EU}, /* embeddings and overrides */
+    {0x2060U, 0x2064U}, /* word joiner, invisible operators */
+    {0x2066U, 0x2069U}, /* isolates */
+    {0xFEFFU, 0xFEFFU}  /* zero width no-break space */
+};
+
+bool
+utf8_flagged(uint32_t cp)
+{
+    for (size_t i = 0U; i < (sizeof(flagged) / sizeof(flagged[0])); i++)
+    {
+        if ((cp >= flagged[i].first) && (cp <= flagged[i].last))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool
+utf8_allowed(const utf8_range_t* ranges, unsigned int count, uint32_t cp)
+{
+    if (utf8_flagged(cp))
+    {
+        return false;
+    }
+    for (unsigned int i = 0U; i < count; i++)
+    {
+        if ((cp >= ranges[i].first) && (cp <= ranges[i].last))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool
+parse_code_point(const char** s, uint32_t* cp)
+{
+    const char* p = *s;
+    if (((p[0] == 'U') || (p[0] == 'u')) && (p[1] == '+'))
+    {
+        p += 2;
+    }
+    if ((*p == '-') || (*p == '+')) /* strtoul() would accept a sign */
+    {
+        return false;
+    }
+
+    char* end;
+    unsigned long value = strtoul(p, &end, 16);
+    if ((end == p) || (value > UTF8_MAX))
+    {
+        return false;
+    }
+    *cp = (uint32_t)value;
+    *s = end;
+
+    return true;
+}
+
+bool
+utf8_ranges_parse(const char* s, utf8_range_t* ranges, unsigned int max,
+                  unsigned int* count)
+{
+    *count = 0U;
+    for (;;)
+    {
+        utf8_range_t r;
+        if (!parse_code_point(&s, &r.first))
+        {
+            return false;
+        }
+        r.last = r.first;
+        if (*s == '-')
+        {
+            s++;
+            if (!parse_code_point(&s, &r.last) || (r.last < r.first))
+            {
+                return false;
+            }
+        }
+        if (*count == max)
+        {
+            return false;
+        }
+        ranges[(*count)++] = r;
+
+        if (*s == '\0')
+        {
+            return true;
+        }
+        if (*s++ != ',')
+        {
+            return false;
+        }
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_UTF8_H
+#define CVC_UTF8_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define UTF8_ACCEPT     (0U) /* between characters */
+#define UTF8_REJECT     (8U) /* malformed sequence */
+#define UTF8_STATES     (9U)
+#define UTF8_CLASSES    (12U)
+#define UTF8_SEQ_MAX    (4U)
+#define UTF8_RANGES_MAX (32U)
+#define UTF8_MAX        (0x10FFFFUL)
+#define UTF8_MALFORMED  (0xFFFDUL) /* code point reported for bad sequences */
+#define UTF8_BOM        (0xFEFFUL)
+
+/* Inclusive range of permitted code points. */
+typedef struct
+{
+    uint32_t first;
+    uint32_t last;
+} utf8_range_t;
+
+/*
+ * Decoder as a DFA over byte classes, which rejects overlong forms,
+ * surrogates and code points beyond U+10FFFF at the first offending byte.
+ */
+extern const uint8_t utf8_byte_class[256];
+extern const uint8_t utf8_lead_mask[UTF8_CLASSES];
+extern const uint8_t utf8_transition[UTF8_STATES][UTF8_CLASSES];
+
+/* Returns the next state, *cp holds the code point once it is UTF8_ACCEPT. */
+static inline unsigned int
+utf8_step(unsigned int state, uint32_t* cp, unsigned char b)
+{
+    unsigned int cls = utf8_byte_class[b];
+
+    *cp = (state == UTF8_ACCEPT) ? (uint32_t)(b & utf8_lead_mask[cls])
+                                 : ((*cp << 6) | (uint32_t)(b & 0x3FU));
+
+    return utf8_transition[state][cls];
+}
+
+/*
+ * Bidirectional formatting and invisible characters, which are never
+ * permitted as they may hide what code really does (trojan source).
+ */
+bool
+utf8_flagged(uint32_t cp);
+
+/* Whether cp is within one of the ranges and not flagged. */
+bool
+utf8_allowed(const utf8_range_t* ranges, unsigned int count, uint32_t cp);
+
+/*
+ * Parses a comma-separated list of code points and ranges in hex, e.g.
+ * "A0-FF,U+2010-U+2027,20AC". Returns false if malformed or more than max.
+ */
+bool
+utf8_ranges_parse(const char* s, utf8_range_t* ranges, unsigned int max,
+                  unsigned int* count);
+
+#endif /* CVC_UTF8_H */
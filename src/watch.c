@@ -0,0 +1,325 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "watch.h"
+
+#include <stdlib.h>
+
+#if defined(__linux__)
+
+#include <dirent.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* IN_CREATE only matters for directories, files are taken once written */
+#define WATCH_MASK  (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR \
+                     | IN_DONT_FOLLOW)
+
+struct watch
+{
+    int fd;
+    const char* exts;
+    char* root;
+    char** dirs;     /* path of each watch descriptor, NULL if unused */
+    size_t capacity; /* of dirs */
+    bool lost;       /* the queue overflowed, events are missing */
+};
+
+static char*
+join(const char* dir, const char* name)
+{
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    bool slash = (dir_len > 0U) && (dir[dir_len - 1U] != '/');
+    char* path = malloc(dir_len + (slash ? 1U : 0U) + name_len + 1U);
+    if (path != NULL)
+    {
+        memcpy(path, dir, dir_len);
+        if (slash)
+        {
+            path[dir_len++] = '/';
+        }
+        memcpy(path + dir_len, name, name_len + 1U);
+    }
+
+    return path;
+}
+
+/* Watches dir and the directories below, before listing them. */
+static bool
+add_dir(watch_t* w, const char* dir)
+{
+    int wd = inotify_add_watch(w->fd, dir, WATCH_MASK);
+    if (wd < 0)
+    {
+        return false;
+    }
+    if ((size_t)wd >= w->capacity)
+    {
+        size_t capacity = ((size_t)wd + 1U) * 2U;
+        char** dirs = realloc(w->dirs, capacity * sizeof(char*));
+        if (dirs == NULL)
+        {
+            return false;
+        }
+        memset(dirs + w->capacity, 0, (capacity - w->capacity) * sizeof(char*));
+        w->dirs = dirs;
+        w->capacity = capacity;
+    }
+    free(w->dirs[wd]); /* the same directory, moved */
+    w->dirs[wd] = join(dir, "");
+    if (w->dirs[wd] == NULL)
+    {
+        return false;
+    }
+
+    DIR* d = opendir(dir);
+    if (d == NULL)
+    {
+        return true; /* gone again */
+    }
+    bool ok = true;
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL)
+    {
+        struct stat st;
+        if (de->d_name[0] == '.')
+        {
+            continue; /* ., .. and hidden directories */
+        }
+        char* path = join(dir, de->d_name);
+        if (path == NULL)
+        {
+            ok = false;
+            break;
+        }
+        if ((lstat(path, &st) == 0) && S_ISDIR(st.st_mode))
+        {
+            ok = add_dir(w, path) && ok;
+        }
+        free(path);
+    }
+    closedir(d);
+
+    return ok;
+}
+
+watch_t*
+watch_open(const char* dir, const char* exts)
+{
+    watch_t* w = calloc(1U, sizeof(watch_t));
+    if (w == NULL)
+    {
+        return NULL;
+    }
+    w->exts = exts;
+    w->fd = inotify_init1(IN_CLOEXEC);
+    w->root = join(dir, "");
+    if ((w->fd < 0) || (w->root == NULL) || !add_dir(w, dir))
+    {
+        watch_close(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+static bool
+handle(watch_t* w, const struct inotify_event* e, file_list_t* changed)
+{
+    if ((e->mask & IN_Q_OVERFLOW) != 0U)
+    {
+        w->lost = true;
+        return true;
+    }
+    if ((e->wd < 0) || ((size_t)e->wd >= w->capacity)
+        || (w->dirs[e->wd] == NULL))
+    {
+        return true;
+    }
+    if ((e->mask & IN_IGNORED) != 0U)
+    {
+        free(w->dirs[e->wd]); /* removed */
+        w->dirs[e->wd] = NULL;
+        return true;
+    }
+    if ((e->len == 0U) || (e->name[0] == '\0') || (e->name[0] == '.'))
+    {
+        return true; /* hidden files and directories are skipped */
+    }
+
+    char* path = join(w->dirs[e->wd], e->name);
+    bool ok = (path != NULL);
+    if (ok && ((e->mask & IN_ISDIR) != 0U))
+    {
+        /* created or moved in, its files are not announced one by one */
+        if (add_dir(w, path))
+        {
+            ok = file_list_walk(changed, path, w->exts);
+        }
+        else
+        {
+            fprintf(stderr, "Error: Failed to watch directory '%s'!\n", path);
+        }
+    }
+    else if (ok && ((e->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0U)
+             && has_extension(e->name, w->exts))
+    {
+        ok = file_list_add(changed, path);
+    }
+    free(path);
+
+    return ok;
+}
+
+static int
+compare_paths(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+bool
+watch_wait(watch_t* w, file_list_t* changed, unsigned int quiet_ms)
+{
+    union
+    {
+        struct inotify_event event;
+        char bytes[4096];
+    } buf;
+    size_t first = changed->count;
+    int timeout = -1; /* until the first event */
+
+    for (;;)
+    {
+        struct pollfd p = {.fd = w->fd, .events = POLLIN, .revents = 0};
+        int n = poll(&p, 1U, timeout);
+        if (n < 0)
+        {
+            return false;
+        }
+        if (n == 0)
+        {
+            if ((changed->count > first) || w->lost)
+            {
+                break;
+            }
+            timeout = -1; /* only files left out */
+            continue;
+        }
+
+        ssize_t len = read(w->fd, buf.bytes, sizeof(buf.bytes));
+        if (len < 0)
+        {
+            return false; /* EINTR as well */
+        }
+        for (size_t pos = 0U; pos < (size_t)len;)
+        {
+            const struct inotify_event* e =
+                (const struct inotify_event*)(const void*)(buf.bytes + pos);
+            if (!handle(w, e, changed))
+            {
+                return false;
+            }
+            pos += sizeof(struct inotify_event) + e->len;
+        }
+        timeout = (int)quiet_ms;
+    }
+
+    if (w->lost)
+    {
+        w->lost = false;
+        if (!file_list_walk(changed, w->root, w->exts))
+        {
+            return false;
+        }
+    }
+
+    /* sorted, once each, and only files still there */
+    char** paths = changed->paths + first;
+    size_t count = changed->count - first;
+    size_t kept = 0U;
+    if (count > 1U)
+    {
+        qsort(paths, count, sizeof(char*), compare_paths);
+    }
+    for (size_t i = 0U; i < count; i++)
+    {
+        struct stat st;
+        if (((kept > 0U) && (strcmp(paths[kept - 1U], paths[i]) == 0))
+            || (stat(paths[i], &st) != 0) || !S_ISREG(st.st_mode))
+        {
+            free(paths[i]);
+            continue;
+        }
+        paths[kept++] = paths[i];
+    }
+    changed->count = first + kept;
+
+    return true;
+}
+
+void
+watch_close(watch_t* w)
+{
+    if (w == NULL)
+    {
+        return;
+    }
+    if (w->fd >= 0)
+    {
+        (void)close(w->fd);
+    }
+    for (size_t i = 0U; i < w->capacity; i++)
+    {
+        free(w->dirs[i]);
+    }
+    free(w->dirs);
+    free(w->root);
+    free(w);
+}
+
+#else
+
+struct watch
+{
+    int unused;
+};
+
+watch_t*
+watch_open(const char* dir, const char* exts)
+{
+    (void)dir;
+    (void)exts;
+
+    return NULL;
+}
+
+bool
+watch_wait(watch_t* w, file_list_t* changed, unsigned int quiet_ms)
+{
+    (void)w;
+    (void)changed;
+    (void)quiet_ms;
+
+    return false;
+}
+
+void
+watch_close(watch_t* w)
+{
+    free(w);
+}
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ * Character Set Validator for C/C++ Code.
+ *
+ * Copyright (C) 2024 Julian Kraemer
+ *
+ * Distributed under MIT license.
+ * See LICENSE file for details or copy at https://opensource.org/licenses/MIT
+ */
+
+#ifndef CVC_WATCH_H
+#define CVC_WATCH_H
+
+#include "files.h"
+
+#include <stdbool.h>
+
+#define WATCH_QUIET_MS  (100U) /* a batch ends after as long without events */
+
+/*
+ * Changes to the files below a directory, as with file_list_walk(): hidden
+ * directories and symbolic links to directories are left out. Needs inotify,
+ * i.e. Linux, directories created later are watched as well.
+ */
+typedef struct watch watch_t;
+
+/*
+ * Starts watching dir for files with one of exts (NULL for all), which has
+ * to outlive the watch. Returns NULL if dir or the platform does not allow.
+ */
+watch_t*
+watch_open(const char* dir, const char* exts);
+
+/*
+ * Waits for files to be written or moved in, collects them until there were
+ * no events for quiet_ms milliseconds and adds those still present to
+ * changed, sorted and each once. All files are added if events were lost.
+ * Returns false if interrupted by a signal or on errors.
+ */
+bool
+watch_wait(watch_t* w, file_list_t* changed, unsigned int quiet_ms);
+
+void
+watch_close(watch_t* w);
+
+#endif /* CVC_WATCH_H */